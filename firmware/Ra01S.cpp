@@ -1,5 +1,6 @@
 #include "Arduino.h"
 #include <SPI.h>
+#include "esp_timer.h"
 #include "Ra01S.h"
 
 
@@ -10,8 +11,52 @@ SX126x::SX126x(int spiSelect, int reset, int busy, int txen, int rxen)
   SX126x_BUSY       = busy;
   SX126x_TXEN       = txen;
   SX126x_RXEN       = rxen;
+  SX126x_DIO1       = -1;
+  dio1Event         = NULL;
   
   txActive          = false;
+  txPreloaded       = false;
+  txPreloadLen      = 0;
+  txDoneMode        = SX126x_TXMODE_BACK2RX;
+  txDoneCallback    = NULL;
+  txDoneArg         = NULL;
+  rxContinuous      = false;
+  rxStopOnPreamble  = false;
+  rxWindowOpen      = false;
+  rxFrameGuardMs    = 0;
+  rxIrqStatus       = 0;
+  dio1EdgeUs        = 0;
+  rxDoneUs          = 0;
+  cadSymbolNum      = SX126X_CAD_ON_2_SYMB;
+  cadDetPeak        = 22;
+  cadDetMin         = 10;
+  cadExitMode       = SX126X_CAD_GOTO_STDBY;
+  spiFrequency      = SX126x_SPI_DEFAULT_FREQ;
+  spiStartUs        = 0;
+  memset(&spiStats, 0, sizeof(spiStats));
+  sleeping          = false;
+  sleepStartUs      = 0;
+  radioState        = SX126x_STATE_STBY;
+  stateSinceUs      = micros();
+  memset(&powerStats, 0, sizeof(powerStats));
+  radioError        = ERR_NONE;
+  memset(&faultStats, 0, sizeof(faultStats));
+  packetParamsValid = false;
+  modParamsValid    = false;
+  frequencyValid    = false;
+  rfSwitch          = SX126x_RFSW_UNKNOWN;
+  cfgFrequency      = 0;
+  cfgTxPower        = 0;
+  cfgTcxoVoltage    = 0.0;
+  cfgUseRegulatorLDO = false;
+  cfgLoRa           = false;
+  cfgSpreadingFactor = 0;
+  cfgBandwidth      = 0;
+  cfgCodingRate     = 0;
+  cfgPreambleLength = 0;
+  cfgPayloadLen     = 0;
+  cfgCrcOn          = false;
+  cfgInvertIrq      = false;
   debugPrint        = false;
   
   pinMode(SX126x_SPI_SELECT, OUTPUT);
@@ -40,6 +85,12 @@ int16_t SX126x::begin(uint32_t frequencyInHz, int8_t txPowerInDbm, float tcxoVol
   Serial.print("SX126x_RXEN=");
   Serial.println(SX126x_RXEN);
   
+  // kept for Recover()
+  cfgFrequency = frequencyInHz;
+  cfgTxPower = txPowerInDbm;
+  cfgTcxoVoltage = tcxoVoltage;
+  cfgUseRegulatorLDO = useRegulatorLDO;
+
   if ( txPowerInDbm > 22 )
     txPowerInDbm = 22;
   if ( txPowerInDbm < -3 )
@@ -86,7 +137,7 @@ int16_t SX126x::begin(uint32_t frequencyInHz, int8_t txPowerInDbm, float tcxoVol
     SetRegulatorMode(SX126X_REGULATOR_DC_DC); // set regulator mode: DC-DC
   }
 
-  SetBufferBaseAddress(0, 0);
+  SetBufferBaseAddress(SX126x_TX_BASE_ADDRESS, SX126x_RX_BASE_ADDRESS);
 #if 0
   // SX1261_TRANCEIVER
   SetPaConfig(0x06, 0x00, 0x01, 0x01); // PA Optimal Settings +15 dBm
@@ -129,12 +180,23 @@ void SX126x::FixInvertedIQ(uint8_t iqConfig)
 
 void SX126x::LoRaConfig(uint8_t spreadingFactor, uint8_t bandwidth, uint8_t codingRate, uint16_t preambleLength, uint8_t payloadLen, bool crcOn, bool invertIrq) 
 {
-
-  SetStopRxTimerOnPreambleDetect(false);
+  // kept for Recover()
+  cfgLoRa = true;
+  cfgSpreadingFactor = spreadingFactor;
+  cfgBandwidth = bandwidth;
+  cfgCodingRate = codingRate;
+  cfgPreambleLength = preambleLength;
+  cfgPayloadLen = payloadLen;
+  cfgCrcOn = crcOn;
+  cfgInvertIrq = invertIrq;
+
+  SetStopRxTimerOnPreambleDetect(rxStopOnPreamble);
   SetLoRaSymbNumTimeout(0); 
   SetPacketType(SX126X_PACKET_TYPE_LORA); // SX126x.ModulationParams.PacketType : MODEM_LORA
-  uint8_t ldro = 0; // LowDataRateOptimize OFF
+  uint8_t ldro = SX126xLdroRequired(spreadingFactor, bandwidth) ? SX126X_LORA_LOW_DATA_RATE_OPTIMIZE_ON
+                                                                : SX126X_LORA_LOW_DATA_RATE_OPTIMIZE_OFF;
   SetModulationParams(spreadingFactor, bandwidth, codingRate, ldro);
+  SetCadDetector(spreadingFactor);
   
   PacketParams[0] = (preambleLength >> 8) & 0xFF;
   PacketParams[1] = preambleLength;
@@ -162,17 +224,11 @@ void SX126x::LoRaConfig(uint8_t spreadingFactor, uint8_t bandwidth, uint8_t codi
   // fixes IQ configuration for inverted IQ
   FixInvertedIQ(PacketParams[5]);
 
-  WriteCommand(SX126X_CMD_SET_PACKET_PARAMS, PacketParams, 6); // 0x8C
+  WritePacketParams();
 
-#if 0
-  SetDioIrqParams(SX126X_IRQ_ALL,  //all interrupts enabled
-                  (SX126X_IRQ_RX_DONE | SX126X_IRQ_TX_DONE | SX126X_IRQ_TIMEOUT), //interrupts on DIO1
-                  SX126X_IRQ_NONE,  //interrupts on DIO2
-                  SX126X_IRQ_NONE); //interrupts on DIO3
-#endif
-  // Do not use DIO interruptst
+  // Route completion IRQs to DIO1 only when the interrupt mode is enabled
   SetDioIrqParams(SX126X_IRQ_ALL,   //all interrupts enabled
-                  SX126X_IRQ_NONE,  //interrupts on DIO1
+                  (SX126x_DIO1 != -1) ? SX126x_DIO1_IRQ_MASK : SX126X_IRQ_NONE, //interrupts on DIO1
                   SX126X_IRQ_NONE,  //interrupts on DIO2
                   SX126X_IRQ_NONE); //interrupts on DIO3
 
@@ -181,12 +237,332 @@ void SX126x::LoRaConfig(uint8_t spreadingFactor, uint8_t bandwidth, uint8_t codi
 }
 
 
+// Change SF/BW/CR on the fly (e.g. per TDMA slot), packet params stay as they are.
+// Costs no SPI traffic when the radio already uses this modulation.
+void SX126x::SetModulation(uint8_t spreadingFactor, uint8_t bandwidth, uint8_t codingRate)
+{
+  uint8_t ldro = SX126xLdroRequired(spreadingFactor, bandwidth) ? SX126X_LORA_LOW_DATA_RATE_OPTIMIZE_ON
+                                                                : SX126X_LORA_LOW_DATA_RATE_OPTIMIZE_OFF;
+  uint8_t data[4] = {spreadingFactor, bandwidth, codingRate, ldro};
+  if (modParamsValid && memcmp(data, modParamsShadow, 4) == 0) {
+    spiStats.skipped++;
+    return;
+  }
+
+  // modulation params are only accepted in standby, the caller re-arms RX
+  SetStandby(SX126X_STANDBY_RC);
+  SetModulationParams(spreadingFactor, bandwidth, codingRate, ldro);
+  SetCadDetector(spreadingFactor);
+
+  // see SX1262 datasheet, chapter 15 Known Limitations, section 15.1:
+  // bit 2 at 0x0889 must be 0 for BW500 and 1 for all other bandwidths
+  uint8_t txModulation = 0;
+  ReadRegister(SX126X_REG_TX_MODULETION, &txModulation, 1); // 0x0889
+  if (bandwidth == SX126X_LORA_BW_500_0) {
+    txModulation &= 0xFB;
+  } else {
+    txModulation |= 0x04;
+  }
+  WriteRegister(SX126X_REG_TX_MODULETION, &txModulation, 1); // 0x0889
+}
+
+
+// Retune between packets (channel hopping). Same-band hops skip the image
+// calibration, so the switch is standby + one SET_RF_FREQUENCY.
+void SX126x::SetChannel(uint32_t frequency)
+{
+  if (frequencyValid && frequency == frequencyShadow) {
+    spiStats.skipped++;
+    return;
+  }
+
+  // frequency is only accepted in standby, the caller re-arms RX
+  SetStandby(SX126X_STANDBY_RC);
+  SetRfFrequency(frequency);
+}
+
+
+// CAD detector settings per Semtech AN1200.48 (BW125 table)
+void SX126x::SetCadDetector(uint8_t spreadingFactor)
+{
+  cadSymbolNum = (spreadingFactor <= 8) ? SX126X_CAD_ON_2_SYMB : SX126X_CAD_ON_4_SYMB;
+  cadDetPeak = (spreadingFactor <= 8) ? 22 : (spreadingFactor == 12) ? 28 : spreadingFactor + 14;
+  cadDetMin = 10;
+}
+
+
 void SX126x::DebugPrint(bool enable) 
 {
   debugPrint = enable;
 }
 
 
+// DIO1 goes high when any IRQ in SX126x_DIO1_IRQ_MASK is set and stays high
+// until the flags are cleared. The ISR only latches the edge and its time; the
+// waiter reads GetIrqStatus() afterwards to find out which event it was.
+void IRAM_ATTR SX126x::Dio1Isr(void *arg)
+{
+  SX126x *self = (SX126x *)arg;
+  portENTER_CRITICAL_ISR(&self->dio1Mux);
+  self->dio1EdgeUs = esp_timer_get_time();
+  portEXIT_CRITICAL_ISR(&self->dio1Mux);
+  BaseType_t woken = pdFALSE;
+  xSemaphoreGiveFromISR(self->dio1Event, &woken);
+  if (woken == pdTRUE) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+
+bool SX126x::EnableDio1Irq(int dio1)
+{
+  if (dio1Event == NULL) {
+    dio1Event = xSemaphoreCreateBinary();
+    if (dio1Event == NULL) {
+      Serial.println("EnableDio1Irq: semaphore allocation failed");
+      return false;
+    }
+  }
+
+  SX126x_DIO1 = dio1;
+  pinMode(SX126x_DIO1, INPUT);
+  attachInterruptArg(digitalPinToInterrupt(SX126x_DIO1), Dio1Isr, this, RISING);
+
+  SetDioIrqParams(SX126X_IRQ_ALL, SX126x_DIO1_IRQ_MASK, SX126X_IRQ_NONE, SX126X_IRQ_NONE);
+  ClearIrqStatus(SX126X_IRQ_ALL);
+  ArmDio1();
+  return true;
+}
+
+
+// Drop a stale latch and make sure the line is low, so the next IRQ produces a fresh edge
+void SX126x::ArmDio1(void)
+{
+  if (SX126x_DIO1 == -1) return;
+  if (digitalRead(SX126x_DIO1)) {
+    ClearIrqStatus(SX126X_IRQ_ALL);
+  }
+  TakeDio1Edge();
+  xSemaphoreTake(dio1Event, 0);
+}
+
+
+// Time of the last DIO1 edge (0 = none since the last call) and clear it. The ISR may
+// write it on the other core while a task reads the two halves: copy it in a critical section.
+int64_t SX126x::TakeDio1Edge(void)
+{
+  portENTER_CRITICAL(&dio1Mux);
+  int64_t edgeUs = dio1EdgeUs;
+  dio1EdgeUs = 0;
+  portEXIT_CRITICAL(&dio1Mux);
+  return edgeUs;
+}
+
+
+// Block until DIO1 fires (interrupt mode) or 1 ms has passed (polling mode)
+bool SX126x::WaitDio1(uint32_t timeoutMs)
+{
+  if (SX126x_DIO1 == -1) {
+    delay(1);
+    return true;
+  }
+  return xSemaphoreTake(dio1Event, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+
+uint8_t SX126x::WaitRx(uint8_t *pData, uint16_t len, uint32_t timeoutMs)
+{
+  uint32_t start = millis();
+  uint32_t elapsed = 0;
+
+  while (true) {
+    uint16_t irqRegs = GetIrqStatus();
+
+    rxIrqStatus = irqRegs;
+    if (irqRegs & SX126X_IRQ_RX_DONE) {
+      // the DIO1 edge is the end of the frame, polling only knows it is done by now
+      int64_t edgeUs = TakeDio1Edge();
+      rxDoneUs = (edgeUs != 0) ? edgeUs : esp_timer_get_time();
+      ClearIrqStatus(SX126X_IRQ_ALL);
+      if (!rxContinuous) SetState(SX126x_STATE_STBY);
+      if (irqRegs & SX126X_IRQ_CRC_ERR) {
+        // Corrupted frame: drop it. Continuous RX keeps listening for the rest of
+        // the window, a single-shot RX has ended and the caller re-arms it.
+        // Its bytes still moved the RX pointer, maybe into the TX half.
+        if (debugPrint) Serial.println("WaitRx CRC error");
+        uint8_t payloadLength, offset;
+        GetRxBufferStatus(&payloadLength, &offset);
+        CheckRxWrap(offset, payloadLength);
+        if (!rxContinuous) return 0;
+      } else {
+        return ReadBuffer(pData, len);
+      }
+    } else if (irqRegs & SX126X_IRQ_TIMEOUT) {
+      ClearIrqStatus(SX126X_IRQ_ALL);
+      SetState(SX126x_STATE_STBY);
+      return 0;
+    } else if (irqRegs & SX126X_IRQ_HEADER_ERR) {
+      // Preamble without a valid header. With the RX timer stopped on the preamble
+      // (SetRxStopOnPreamble) nothing would close a single-shot window any more:
+      // end it here, the caller re-arms it. Continuous RX just keeps listening.
+      ClearIrqStatus(SX126X_IRQ_ALL);
+      if (!rxContinuous) {
+        SetStandby(SX126X_STANDBY_RC);
+        return 0;
+      }
+    }
+
+    elapsed = millis() - start;
+    if (elapsed >= timeoutMs) break;
+    WaitDio1(timeoutMs - elapsed);
+  }
+
+  return 0;
+}
+
+
+// Listen for at most windowUs using the chip's RX timer (15.625 us steps).
+// The radio raises TIMEOUT by itself and drops to STDBY_RC when the window ends,
+// so the task just sleeps on DIO1. Returns the packet length, 0 if nothing usable arrived.
+// maxWaitUs < windowUs returns after maxWaitUs with the window still armed; the next
+// call carries on with it instead of a new SetRx, so a frame already on air is kept.
+uint8_t SX126x::ReceiveWindow(uint8_t *pData, uint16_t len, uint32_t windowUs, uint32_t maxWaitUs)
+{
+  uint32_t start = micros();
+  uint32_t elapsed = 0;
+  bool armed = rxWindowOpen && (radioState == SX126x_STATE_RX) && !rxContinuous;
+  rxWindowOpen = false;
+
+  while (elapsed < windowUs) {
+    uint32_t remainingUs = windowUs - elapsed;
+    if (!armed) SetRx(UsToRxTicks(remainingUs));
+    armed = false;
+
+    // Backstop only: covers a lost IRQ and a frame whose preamble arrived late in the window
+    uint32_t waitMs = remainingUs / 1000 + 1 + rxFrameGuardMs;
+    bool split = (maxWaitUs < remainingUs);
+    if (split) waitMs = (maxWaitUs + 999) / 1000;
+    uint8_t rxLen = WaitRx(pData, len, waitMs);
+    if (rxLen > 0) return rxLen;
+
+    if (split && radioState == SX126x_STATE_RX) {
+      rxWindowOpen = true;
+      break;
+    }
+    // Re-arm for what is left only if the window was cut short by a corrupted frame
+    if (!(rxIrqStatus & (SX126X_IRQ_CRC_ERR | SX126X_IRQ_HEADER_ERR))) break;
+    elapsed = micros() - start;
+    maxWaitUs = (maxWaitUs > elapsed) ? maxWaitUs - elapsed : 0;
+  }
+
+  return 0;
+}
+
+
+// With enable=true the RX timer stops on preamble detection instead of on header,
+// so a frame that starts before the window closes is received in full.
+// frameGuardMs (one frame's air time) extends the software backstop accordingly.
+void SX126x::SetRxStopOnPreamble(bool enable, uint32_t frameGuardMs)
+{
+  rxStopOnPreamble = enable;
+  rxFrameGuardMs = enable ? frameGuardMs : 0;
+  SetStopRxTimerOnPreambleDetect(enable);
+}
+
+
+// One CAD probe, the radio ends in STDBY_RC. Returns true if a preamble was seen.
+bool SX126x::ScanChannel(void)
+{
+  bool detected = false;
+  SetStandby(SX126X_STANDBY_RC);
+  SetCadParams(cadSymbolNum, cadDetPeak, cadDetMin, SX126X_CAD_GOTO_STDBY, 0);
+  SetCad();
+  if (!WaitCadDone(&detected)) SetStandby(SX126X_STANDBY_RC);
+  return detected;
+}
+
+
+// One CAD probe. On a detected preamble the radio switches straight to RX
+// (SX126X_CAD_GOTO_RX) for at most rxWindowUs and the frame is returned.
+// Returns 0 when the channel was idle or nothing usable arrived.
+uint8_t SX126x::CadReceive(uint8_t *pData, uint16_t len, uint32_t rxWindowUs, bool *detected)
+{
+  *detected = false;
+  SetStandby(SX126X_STANDBY_RC);
+  SetCadParams(cadSymbolNum, cadDetPeak, cadDetMin, SX126X_CAD_GOTO_RX, UsToRxTicks(rxWindowUs));
+  SetCad();
+  if (!WaitCadDone(detected)) {
+    SetStandby(SX126X_STANDBY_RC);
+    return 0;
+  }
+  if (!*detected) return 0;
+
+  return WaitRx(pData, len, rxWindowUs / 1000 + 1 + rxFrameGuardMs);
+}
+
+
+bool SX126x::WaitCadDone(bool *detected)
+{
+  uint32_t start = millis();
+  uint32_t elapsed = 0;
+  uint16_t irqRegs = GetIrqStatus();
+
+  while (!(irqRegs & SX126X_IRQ_CAD_DONE)) {
+    elapsed = millis() - start;
+    if (elapsed >= SX126x_CAD_TIMEOUT_MS) {
+      Serial.println("WaitCadDone timeout");
+      return false;
+    }
+    WaitDio1(SX126x_CAD_TIMEOUT_MS - elapsed);
+    irqRegs = GetIrqStatus();
+  }
+  *detected = (irqRegs & SX126X_IRQ_CAD_DETECTED) != 0;
+  ClearIrqStatus(SX126X_IRQ_CAD_DONE | SX126X_IRQ_CAD_DETECTED);
+  // Idle channel or SX126X_CAD_GOTO_STDBY: the chip is back in STDBY_RC
+  if (!*detected || cadExitMode == SX126X_CAD_GOTO_STDBY) SetState(SX126x_STATE_STBY);
+  return true;
+}
+
+
+// RX timeout in 15.625 us steps (1/64 ms). 0 and 0xFFFFFF are the chip's
+// "single without timeout" and "continuous" codes, so the result avoids both.
+uint32_t SX126x::UsToRxTicks(uint32_t us)
+{
+  uint64_t ticks = ((uint64_t)us * 64 + 999) / 1000;
+  if (ticks == 0) ticks = 1;
+  if (ticks > 0xFFFFFE) ticks = 0xFFFFFE;
+  return (uint32_t)ticks;
+}
+
+
+bool SX126x::WaitTx(uint32_t timeoutMs)
+{
+  uint32_t start = millis();
+  uint32_t elapsed = 0;
+  uint16_t irqStatus = GetIrqStatus();
+
+  while ( (!(irqStatus & SX126X_IRQ_TX_DONE)) && (!(irqStatus & SX126X_IRQ_TIMEOUT)) )
+  {
+    elapsed = millis() - start;
+    if (elapsed >= timeoutMs) break;
+    WaitDio1(timeoutMs - elapsed);
+    irqStatus = GetIrqStatus();
+  }
+  if (irqStatus & (SX126X_IRQ_TX_DONE | SX126X_IRQ_TIMEOUT)) SetState(SX126x_STATE_STBY);
+  if (debugPrint) {
+    Serial.print("irqStatus=");
+    Serial.println(irqStatus, HEX);
+    if (irqStatus & SX126X_IRQ_TX_DONE) {
+      Serial.println("SX126X_IRQ_TX_DONE");
+    }
+    if (irqStatus & SX126X_IRQ_TIMEOUT) {
+      Serial.println("SX126X_IRQ_TIMEOUT");
+    }
+  }
+  return (irqStatus & SX126X_IRQ_TX_DONE) != 0;
+}
+
+
 uint8_t SX126x::Receive(uint8_t *pData, uint16_t len) 
 {
   uint8_t rxLen = 0;
@@ -206,47 +582,19 @@ uint8_t SX126x::Receive(uint8_t *pData, uint16_t len)
 
 bool SX126x::Send(uint8_t *pData, uint8_t len, uint8_t mode)
 {
-  uint16_t irqStatus;
   bool rv = false;
   
   if ( txActive == false )
   {
-    txActive = true;
-    PacketParams[2] = 0x00; //Variable length packet (explicit header)
-    PacketParams[3] = len;
-    WriteCommand(SX126X_CMD_SET_PACKET_PARAMS, PacketParams, 6); // 0x8C
-
-    //ClearIrqStatus(SX126X_IRQ_TX_DONE | SX126X_IRQ_TIMEOUT);
-    ClearIrqStatus(SX126X_IRQ_ALL);
-
-    WriteBuffer(pData, len);
-    SetTx(500);
+    txDoneMode = SX126x_TXMODE_BACK2RX;
+    txDoneCallback = NULL;
+    txDoneArg = NULL;
+    StartTx(pData, len);
 
     if ( mode & SX126x_TXMODE_SYNC )
     {
-      irqStatus = GetIrqStatus();
-      while ( (!(irqStatus & SX126X_IRQ_TX_DONE)) && (!(irqStatus & SX126X_IRQ_TIMEOUT)) )
-      {
-        delay(1);
-        irqStatus = GetIrqStatus();
-      }
-      if (debugPrint) {
-        Serial.print("irqStatus=");
-        Serial.println(irqStatus, HEX);
-        if (irqStatus & SX126X_IRQ_TX_DONE) {
-          Serial.println("SX126X_IRQ_TX_DONE");
-        }
-        if (irqStatus & SX126X_IRQ_TIMEOUT) {
-          Serial.println("SX126X_IRQ_TIMEOUT");
-        }
-      }
-      txActive = false;
-
-      SetRx(0xFFFFFF);
-
-      if ( irqStatus & SX126X_IRQ_TX_DONE) {
-        rv = true;
-      }
+      // SetTx(500) arms the chip's own TX timeout, this bound is only a backstop
+      rv = FinishTx(1000);
     }
     else
     {
@@ -261,6 +609,122 @@ bool SX126x::Send(uint8_t *pData, uint8_t len, uint8_t mode)
 }
 
 
+// Start a TX and return immediately. The packet is on air once this returns;
+// FinishTx() (or ReceiveMode()) completes it, applies doneMode
+// (SX126x_TXMODE_BACK2RX, SX126x_TXMODE_BACK2STBY or SX126x_TXMODE_BACK2SLEEP)
+// and runs the callback.
+bool SX126x::SendAsync(uint8_t *pData, uint8_t len, SX126xTxDoneCallback callback, void *arg, uint8_t doneMode)
+{
+  if ( txActive == true ) return false;
+
+  txDoneMode = doneMode;
+  txDoneCallback = callback;
+  txDoneArg = arg;
+  StartTx(pData, len);
+  return true;
+}
+
+
+// Write the next frame into the TX half of the data buffer ahead of time (RX may be running),
+// so that SendPreloaded() only has to issue SetTx at the slot start
+bool SX126x::PreloadTx(uint8_t *pData, uint8_t len)
+{
+  if ( txActive == true ) return false;
+  if ( len > SX126x_RX_BASE_ADDRESS - SX126x_TX_BASE_ADDRESS ) return false;
+
+  WriteBuffer(pData, len);
+  txPreloaded = (radioError == ERR_NONE);
+  txPreloadLen = len;
+  return txPreloaded;
+}
+
+
+// False once the frame is gone: warm sleep, reset or RX data wrapping into the TX half
+bool SX126x::TxPreloaded(void)
+{
+  return txPreloaded;
+}
+
+
+bool SX126x::SendPreloaded(SX126xTxDoneCallback callback, void *arg, uint8_t doneMode)
+{
+  if ( txActive == true || txPreloaded == false ) return false;
+
+  txDoneMode = doneMode;
+  txDoneCallback = callback;
+  txDoneArg = arg;
+  StartTx(NULL, txPreloadLen);
+  return true;
+}
+
+
+// Block until the in-flight TX completes (DIO1 wakes the task in interrupt mode).
+// On timeout the TX is aborted. Returns false if nothing was in flight or the TX failed.
+bool SX126x::FinishTx(uint32_t timeoutMs)
+{
+  if ( txActive == false ) return false;
+
+  // a fault during StartTx() means no TX_DONE will come
+  bool rv = (radioError == ERR_NONE) && WaitTx(timeoutMs);
+  CompleteTx(rv);
+  return rv;
+}
+
+
+bool SX126x::TxBusy(void)
+{
+  return txActive;
+}
+
+
+void SX126x::StartTx(uint8_t *pData, uint8_t len)
+{
+  uint32_t start = micros();
+  uint32_t commands = spiStats.transactions;
+  txActive = true;
+  PacketParams[2] = 0x00; //Variable length packet (explicit header)
+  PacketParams[3] = len;
+  WritePacketParams(); // only the first frame of a given length costs a command
+
+  //ClearIrqStatus(SX126X_IRQ_TX_DONE | SX126X_IRQ_TIMEOUT);
+  ClearIrqStatus(SX126X_IRQ_ALL);
+
+  // pData == NULL: frame already in the buffer (PreloadTx)
+  if (pData != NULL) WriteBuffer(pData, len);
+  txPreloaded = false;
+  SetTx(500);
+  spiStats.lastTxPrepareUs = micros() - start;
+  spiStats.lastTxPrepareCmds = spiStats.transactions - commands;
+}
+
+
+void SX126x::CompleteTx(bool success)
+{
+  ClearIrqStatus(SX126X_IRQ_ALL);
+  txActive = false;
+
+  if ( txDoneMode & SX126x_TXMODE_BACK2SLEEP )
+  {
+    Sleep();
+  }
+  else if ( txDoneMode & SX126x_TXMODE_BACK2STBY )
+  {
+    SetStandby(SX126X_STANDBY_RC);
+  }
+  else
+  {
+    SetRx(0xFFFFFF);
+  }
+
+  if ( txDoneCallback != NULL )
+  {
+    SX126xTxDoneCallback callback = txDoneCallback;
+    txDoneCallback = NULL;
+    callback(success, txDoneArg);
+  }
+}
+
+
 bool SX126x::ReceiveMode(void)
 {
   uint16_t irq;
@@ -268,6 +732,11 @@ bool SX126x::ReceiveMode(void)
 
   if ( txActive == false )
   {
+    // Back from sleep, standby or a single-shot RX: listen continuously again
+    if ( (radioState != SX126x_STATE_RX) || !rxContinuous )
+    {
+      SetRx(0xFFFFFF);
+    }
     rv = true;
   }
   else
@@ -275,8 +744,7 @@ bool SX126x::ReceiveMode(void)
     irq = GetIrqStatus();
     if ( irq & (SX126X_IRQ_TX_DONE | SX126X_IRQ_TIMEOUT) )
     { 
-      SetRx(0xFFFFFF);
-      txActive = false;
+      CompleteTx((irq & SX126X_IRQ_TX_DONE) != 0);
       rv = true;
     }
   }
@@ -296,6 +764,7 @@ void SX126x::GetPacketStatus(int8_t *rssiPacket, int8_t *snrPacket)
 
 void SX126x::SetTxPower(int8_t txPowerInDbm)
 {
+  cfgTxPower = txPowerInDbm;
   SetPowerConfig(txPowerInDbm, SX126X_PA_RAMP_200U);
 }
 
@@ -307,29 +776,197 @@ void SX126x::Reset(void)
   delay(20);
   digitalWrite(SX126x_RESET,1);
   delay(10);
+  InvalidateShadow();
+  txPreloaded = false;
   // ensure BUSY is low (state meachine ready)
   WaitForIdle(BUSY_WAIT, "Reset", true);
 }
 
 
+// Warm-start sleep: configuration is retained, the data buffer is not.
+// Any later command wakes the chip again (see WaitForIdle), Wakeup() does it ahead of time.
+void SX126x::Sleep(void)
+{
+  if (sleeping || txActive) return;
+
+  SetStandby(SX126X_STANDBY_RC);
+  if ((SX126x_TXEN != -1) && (SX126x_RXEN != -1) && rfSwitch != SX126x_RFSW_OFF){
+    digitalWrite(SX126x_RXEN, LOW);
+    digitalWrite(SX126x_TXEN, LOW);
+  }
+  rfSwitch = SX126x_RFSW_OFF;
+  SetSleep(SX126X_SLEEP_START_WARM | SX126X_SLEEP_RTC_OFF);
+  txPreloaded = false;  // warm sleep keeps the configuration, not the data buffer
+  sleeping = true;
+  sleepStartUs = micros();
+  SetState(SX126x_STATE_SLEEP);
+}
+
+
+// Wake from warm sleep: an NSS falling edge starts the chip, BUSY drops once it is in STDBY_RC
 void SX126x::Wakeup(void)
 {
-  //GetStatus();
-  digitalWrite(SX126x_SPI_SELECT, LOW); delay(1); digitalWrite(SX126x_SPI_SELECT, HIGH);
+  if (!sleeping) return;
+
+  uint32_t settled = micros() - sleepStartUs;
+  if (settled < SX126x_SLEEP_SETTLE_US) delayMicroseconds(SX126x_SLEEP_SETTLE_US - settled);
+
+  uint32_t start = micros();
+  sleeping = false;
+  uint8_t buf[2] = {SX126X_CMD_GET_STATUS, SX126X_CMD_NOP}; // 0xC0
+  SpiBegin();
+  SpiWrite(buf, 2);
+  SpiEnd();
+  WaitForIdle(BUSY_WAIT, "Wakeup", false);
+
+  uint32_t wakeUs = micros() - start;
+  powerStats.wakeups++;
+  powerStats.lastWakeUs = wakeUs;
+  if (wakeUs > powerStats.maxWakeUs) powerStats.maxWakeUs = wakeUs;
+  SetState(SX126x_STATE_STBY);
+}
+
+
+bool SX126x::IsSleeping(void)
+{
+  return sleeping;
+}
+
+
+void SX126x::GetPowerStats(SX126xPowerStats *stats)
+{
+  SetState(radioState); // book the time spent in the current state
+  *stats = powerStats;
+}
+
+
+void SX126x::ResetPowerStats(void)
+{
+  memset(&powerStats, 0, sizeof(powerStats));
+  stateSinceUs = micros();
+}
+
+
+void SX126x::SetState(uint8_t state)
+{
+  uint32_t now = micros();
+  powerStats.stateUs[radioState] += now - stateSinceUs;
+  stateSinceUs = now;
+  radioState = state;
+}
+
+
+// Latch the first error until Recover(), later ones are usually its fallout
+void SX126x::SetError(int16_t error, const char *text)
+{
+  if (radioError != ERR_NONE) return;
+  radioError = error;
+  faultStats.faults++;
+  faultStats.lastError = error;
+  Serial.print("SX126x fault [");
+  Serial.print(text);
+  Serial.print("] error=");
+  Serial.println(error);
+}
+
+
+// Instantaneous RSSI in dBm, only meaningful while the receiver runs.
+// Returns SX126x_RSSI_INVALID while the receiver is off (standby, sleep, TX).
+int16_t SX126x::SampleRssi(void)
+{
+  if (radioState != SX126x_STATE_RX || sleeping || txActive) return SX126x_RSSI_INVALID;
+  return -(int16_t)GetRssiInst() / 2;
+}
+
+
+// esp_timer_get_time() at RX_DONE of the last frame returned by WaitRx()/ReceiveWindow()/CadReceive()
+int64_t SX126x::GetRxTimestamp(void)
+{
+  return rxDoneUs;
+}
+
+
+// ERR_NONE while the radio is healthy, otherwise the latched fault
+int16_t SX126x::GetError(void)
+{
+  return radioError;
+}
+
+
+// Hardware reset, begin() and the last LoRaConfig()/SetTxPower() again.
+// DIO1 routing and stop-on-preamble come back with LoRaConfig(), the radio ends in continuous RX.
+int16_t SX126x::Recover(void)
+{
+  uint32_t start = micros();
+  Serial.print("Recover: error=");
+  Serial.println(radioError);
+
+  // whatever was in flight is lost with the reset
+  radioError = ERR_NONE;
+  sleeping = false;
+  rxContinuous = false;
+  if ( txActive )
+  {
+    txActive = false;
+    if ( txDoneCallback != NULL )
+    {
+      SX126xTxDoneCallback callback = txDoneCallback;
+      txDoneCallback = NULL;
+      callback(false, txDoneArg);
+    }
+  }
+
+  int16_t rv = begin(cfgFrequency, cfgTxPower, cfgTcxoVoltage, cfgUseRegulatorLDO);
+  if (rv == ERR_NONE && cfgLoRa) {
+    LoRaConfig(cfgSpreadingFactor, cfgBandwidth, cfgCodingRate, cfgPreambleLength, cfgPayloadLen, cfgCrcOn, cfgInvertIrq);
+  }
+  if (rv == ERR_NONE) rv = radioError;
+
+  if (rv == ERR_NONE) {
+    faultStats.recoveries++;
+  } else {
+    // stays faulted, the caller retries on its next check
+    radioError = rv;
+    faultStats.failures++;
+  }
+  uint32_t took = micros() - start;
+  faultStats.lastRecoveryUs = took;
+  if (took > faultStats.maxRecoveryUs) faultStats.maxRecoveryUs = took;
+  return rv;
+}
+
+
+void SX126x::GetFaultStats(SX126xFaultStats *stats)
+{
+  *stats = faultStats;
+}
+
+
+void SX126x::ResetFaultStats(void)
+{
+  memset(&faultStats, 0, sizeof(faultStats));
 }
 
 
 void SX126x::SetSleep(uint8_t mode)
 {
   uint8_t data = mode;
-  WriteCommand(SX126X_CMD_SET_SLEEP, &data, 1); // 0x84
+  // BUSY stays high while asleep, so don't wait for it
+  WriteCommand(SX126X_CMD_SET_SLEEP, &data, 1, false); // 0x84
+  if (!(mode & SX126X_SLEEP_START_WARM)) InvalidateShadow();
 }
 
 
 void SX126x::SetStandby(uint8_t mode)
 {
+  // RX/TX/CAD may have fallen back to STDBY_RC on their own, so only a known STDBY_RC is skipped
+  if (mode == SX126X_STANDBY_RC && radioState == SX126x_STATE_STBY && !sleeping) {
+    spiStats.skipped++;
+    return;
+  }
   uint8_t data = mode;
   WriteCommand(SX126X_CMD_SET_STANDBY, &data, 1); // 0x80
+  SetState(SX126x_STATE_STBY);
 }
 
 
@@ -400,7 +1037,15 @@ void SX126x::SetRfFrequency(uint32_t frequency)
   uint8_t buf[4];
   uint32_t freq = 0;
 
-  CalibrateImage(frequency);
+  if (frequencyValid && frequency == frequencyShadow) {
+    spiStats.skipped++;
+    return;
+  }
+
+  // image calibration only depends on the band, a hop inside the band keeps it
+  if (!frequencyValid || SX126xImageCalBand(frequency) != SX126xImageCalBand(frequencyShadow)) {
+    CalibrateImage(frequency);
+  }
 
   freq = (uint32_t)((double)frequency / (double)FREQ_STEP);
   buf[0] = (uint8_t)((freq >> 24) & 0xFF);
@@ -408,6 +1053,8 @@ void SX126x::SetRfFrequency(uint32_t frequency)
   buf[2] = (uint8_t)((freq >> 8) & 0xFF);
   buf[3] = (uint8_t)(freq & 0xFF);
   WriteCommand(SX126X_CMD_SET_RF_FREQUENCY, buf, 4); // 0x86
+  frequencyShadow = frequency;
+  frequencyValid = (radioError == ERR_NONE);
 }
 
 
@@ -526,6 +1173,32 @@ void SX126x::SetStopRxTimerOnPreambleDetect( bool enable )
 }
 
 
+void SX126x::SetCadParams(uint8_t symbolNum, uint8_t detPeak, uint8_t detMin, uint8_t exitMode, uint32_t timeout)
+{
+  uint8_t buf[7];
+  buf[0] = symbolNum;
+  buf[1] = detPeak;
+  buf[2] = detMin;
+  buf[3] = exitMode;
+  cadExitMode = exitMode;
+  buf[4] = (uint8_t)((timeout >> 16) & 0xFF);
+  buf[5] = (uint8_t)((timeout >> 8) & 0xFF);
+  buf[6] = (uint8_t)(timeout & 0xFF);
+  WriteCommand(SX126X_CMD_SET_CAD_PARAMS, buf, 7); // 0x88
+}
+
+
+// CAD listens on the receive path, so the RF switch goes to RX
+void SX126x::SetCad(void)
+{
+  SetRxEnable();
+  ArmDio1();
+  rxContinuous = false;
+  WriteCommand(SX126X_CMD_SET_CAD, NULL, 0); // 0xC5
+  SetState(SX126x_STATE_RX);
+}
+
+
 void SX126x::SetLoRaSymbNumTimeout(uint8_t SymbNum)
 {
   uint8_t data = SymbNum;
@@ -537,6 +1210,9 @@ void SX126x::SetPacketType(uint8_t packetType)
 {
   uint8_t data = packetType;
   WriteCommand(SX126X_CMD_SET_PACKET_TYPE, &data, 1); // 0x01
+  // the chip expects modulation and packet params again after a packet type change
+  packetParamsValid = false;
+  modParamsValid = false;
 }
 
 
@@ -548,7 +1224,36 @@ void SX126x::SetModulationParams(uint8_t spreadingFactor, uint8_t bandwidth, uin
   data[1] = bandwidth;
   data[2] = codingRate;
   data[3] = lowDataRateOptimize;
+  if (modParamsValid && memcmp(data, modParamsShadow, 4) == 0) {
+    spiStats.skipped++;
+    return;
+  }
   WriteCommand(SX126X_CMD_SET_MODULATION_PARAMS, data, 4); // 0x8B
+  memcpy(modParamsShadow, data, 4);
+  modParamsValid = (radioError == ERR_NONE);
+}
+
+
+// SET_PACKET_PARAMS from PacketParams[], skipped when the chip already has them
+void SX126x::WritePacketParams(void)
+{
+  if (packetParamsValid && memcmp(PacketParams, packetParamsShadow, 6) == 0) {
+    spiStats.skipped++;
+    return;
+  }
+  WriteCommand(SX126X_CMD_SET_PACKET_PARAMS, PacketParams, 6); // 0x8C
+  memcpy(packetParamsShadow, PacketParams, 6);
+  packetParamsValid = (radioError == ERR_NONE);
+}
+
+
+// Reset or cold sleep: the chip is back to its defaults, nothing in the shadow holds
+void SX126x::InvalidateShadow(void)
+{
+  packetParamsValid = false;
+  modParamsValid = false;
+  frequencyValid = false;
+  rfSwitch = SX126x_RFSW_UNKNOWN;
 }
 
 
@@ -576,22 +1281,33 @@ void SX126x::SetRx(uint32_t timeout)
     Serial.print("----- SetRx timeout=0x");
     Serial.println(timeout, HEX);
   }
+  uint32_t start = micros();
+  uint32_t commands = spiStats.transactions;
   SetStandby(SX126X_STANDBY_RC);
   SetRxEnable();
+  ArmDio1();
+  rxContinuous = (timeout == 0xFFFFFF);
   uint8_t buf[3];
   buf[0] = (uint8_t)((timeout >> 16) & 0xFF);
   buf[1] = (uint8_t)((timeout >> 8) & 0xFF);
   buf[2] = (uint8_t )(timeout & 0xFF);
   WriteCommand(SX126X_CMD_SET_RX, buf, 3); // 0x82
+  if (radioError != ERR_NONE) return;
 
+  // normally the first status read already shows RX
+  uint8_t chipMode = 0;
   for(int retry=0;retry<10;retry++) {
-    if ((GetStatus() & 0x70) == 0x50) break;
+    chipMode = GetStatus() & 0x70;
+    if (chipMode == 0x50) break;
     delay(1);
   }
-  if ((GetStatus() & 0x70) != 0x50) {
-    Serial.println("SetRx Illegal Status");
-    while(1) {delay(1);}
+  if (chipMode != 0x50) {
+    SetError(ERR_ILLEGAL_STATUS, "SetRx Illegal Status");
+    return;
   }
+  SetState(SX126x_STATE_RX);
+  spiStats.lastRxSetupUs = micros() - start;
+  spiStats.lastRxSetupCmds = spiStats.transactions - commands;
 }
 
 
@@ -604,10 +1320,12 @@ void SX126x::SetRxEnable(void)
     Serial.print(SX126x_RXEN);
     Serial.println();
   }
+  if (rfSwitch == SX126x_RFSW_RX) return;
   if ((SX126x_TXEN != -1) && (SX126x_RXEN != -1)) {
     digitalWrite(SX126x_RXEN, HIGH);
     digitalWrite(SX126x_TXEN, LOW);
   }
+  rfSwitch = SX126x_RFSW_RX;
 }
 
 
@@ -619,6 +1337,7 @@ void SX126x::SetTx(uint32_t timeoutInMs)
   }
   SetStandby(SX126X_STANDBY_RC);
   SetTxEnable();
+  ArmDio1();
   uint8_t buf[3];
   uint32_t tout = timeoutInMs;
   if (timeoutInMs != 0) {
@@ -636,15 +1355,20 @@ void SX126x::SetTx(uint32_t timeoutInMs)
   buf[1] = (uint8_t)((tout >> 8) & 0xFF);
   buf[2] = (uint8_t )(tout & 0xFF);
   WriteCommand(SX126X_CMD_SET_TX, buf, 3); // 0x83
+  if (radioError != ERR_NONE) return;
 
+  // normally the first status read already shows TX
+  uint8_t chipMode = 0;
   for(int retry=0;retry<10;retry++) {
-    if ((GetStatus() & 0x70) == 0x60) break;
+    chipMode = GetStatus() & 0x70;
+    if (chipMode == 0x60) break;
     delay(1);
   }
-  if ((GetStatus() & 0x70) != 0x60) {
-    Serial.println("SetTx Illegal Status");
-    while(1) {delay(1);}
+  if (chipMode != 0x60) {
+    SetError(ERR_ILLEGAL_STATUS, "SetTx Illegal Status");
+    return;
   }
+  SetState(SX126x_STATE_TX);
 }
 
 
@@ -657,10 +1381,12 @@ void SX126x::SetTxEnable(void)
     Serial.print(SX126x_RXEN);
     Serial.println();
   }
+  if (rfSwitch == SX126x_RFSW_TX) return;
   if ((SX126x_TXEN != -1) && (SX126x_RXEN != -1)){
     digitalWrite(SX126x_RXEN, LOW);
     digitalWrite(SX126x_TXEN, HIGH);
   }
+  rfSwitch = SX126x_RFSW_TX;
 }
 
 
@@ -681,31 +1407,53 @@ void SX126x::GetRxBufferStatus(uint8_t *payloadLength, uint8_t *rxStartBufferPoi
 }
 
 
-void SX126x::WaitForIdle(unsigned long timeout, char *text, bool stop)
+void SX126x::WaitForIdle(unsigned long timeout, const char *text, bool stop)
 {
+  // BUSY is high for as long as the chip sleeps
+  if (sleeping) Wakeup();
+
+  // once a fault is latched the chip is not trusted, don't stall every command on it
+  if (radioError != ERR_NONE) timeout = 0;
+
   unsigned long start = millis();
   delayMicroseconds(1);
   while(digitalRead(SX126x_BUSY)) {
     delayMicroseconds(1);
     if(millis() - start >= timeout) {
-      Serial.print("WaitForIdle [");
-      Serial.print(text);
-      Serial.print("] Timeout timeout=");
-      Serial.println(timeout);
       if (stop) {
-        while(1) {delay(1);}
+        SetError(ERR_BUSY_TIMEOUT, text);
+      } else if (radioError == ERR_NONE) {
+        Serial.print("WaitForIdle [");
+        Serial.print(text);
+        Serial.print("] Timeout timeout=");
+        Serial.println(timeout);
       }
+      return;
     }
   }
 }
 
 
 
-uint8_t SX126x::ReadBuffer(uint8_t *rxData, uint8_t maxLen)
+// Back-to-back frames in continuous RX advance the pointer, past 0xFF it wraps into the TX
+// half: a frame written there (good or CRC error) overwrote the preloaded TX frame
+void SX126x::CheckRxWrap(uint8_t offset, uint8_t payloadLength)
+{
+  if( (uint16_t)offset + payloadLength > 0x100 || offset < SX126x_RX_BASE_ADDRESS )
+  {
+    txPreloaded = false;
+  }
+}
+
+
+uint8_t SX126x::ReadBuffer(uint8_t *rxData, uint16_t maxLen)
 {
+  uint32_t start = micros();
+  uint32_t commands = spiStats.transactions;
   uint8_t offset = 0;
   uint8_t payloadLength = 0;
   GetRxBufferStatus(&payloadLength, &offset);
+  CheckRxWrap(offset, payloadLength);
   if( payloadLength > maxLen )
   {
     Serial.println("ReadBuffer maxLen too small");
@@ -715,21 +1463,17 @@ uint8_t SX126x::ReadBuffer(uint8_t *rxData, uint8_t maxLen)
   // ensure BUSY is low (state meachine ready)
   WaitForIdle(BUSY_WAIT, "start ReadBuffer", true);
 
-  digitalWrite(SX126x_SPI_SELECT, LOW);
-  SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
-  SPI.transfer(SX126X_CMD_READ_BUFFER); // 0x1E
-  SPI.transfer(offset);
-  SPI.transfer(SX126X_CMD_NOP);
-  for( uint16_t i = 0; i < payloadLength; i++ )
-  {
-    rxData[i] = SPI.transfer(SX126X_CMD_NOP);  
-  }
-  SPI.endTransaction();
-  digitalWrite(SX126x_SPI_SELECT, HIGH);
+  uint8_t header[3] = {SX126X_CMD_READ_BUFFER, offset, SX126X_CMD_NOP}; // 0x1E
+  SpiBegin();
+  SpiWrite(header, 3);
+  SpiRead(rxData, payloadLength);
+  SpiEnd();
 
   // wait for BUSY to go low
   WaitForIdle(BUSY_WAIT, "end ReadBuffer", false);
 
+  spiStats.lastRxReadUs = micros() - start;
+  spiStats.lastRxReadCmds = spiStats.transactions - commands;
   return payloadLength;
 }
 
@@ -738,16 +1482,11 @@ void SX126x::WriteBuffer(uint8_t *txData, uint8_t txDataLen)
   // ensure BUSY is low (state meachine ready)
   WaitForIdle(BUSY_WAIT, "start WriteBuffer", true);
 
-  digitalWrite(SX126x_SPI_SELECT, LOW);
-  SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
-  SPI.transfer(SX126X_CMD_WRITE_BUFFER); // 0x0E
-  SPI.transfer(0); //offset in tx fifo
-  for( uint16_t i = 0; i < txDataLen; i++ )
-  { 
-     SPI.transfer( txData[i]);  
-  }
-  SPI.endTransaction();
-  digitalWrite(SX126x_SPI_SELECT, HIGH);
+  uint8_t header[2] = {SX126X_CMD_WRITE_BUFFER, SX126x_TX_BASE_ADDRESS}; // 0x0E, offset in tx fifo
+  SpiBegin();
+  SpiWrite(header, 2);
+  SpiWrite(txData, txDataLen);
+  SpiEnd();
 
   // wait for BUSY to go low
   WaitForIdle(BUSY_WAIT, "end WriteBuffer", false);
@@ -759,34 +1498,19 @@ void SX126x::WriteRegister(uint16_t reg, uint8_t* data, uint8_t numBytes, bool w
   WaitForIdle(BUSY_WAIT, "start WriteRegister", true);
 
   // start transfer
+  uint8_t header[3] = {SX126X_CMD_WRITE_REGISTER, (uint8_t)((reg & 0xFF00) >> 8), (uint8_t)(reg & 0xff)}; // 0x0D
+  SpiBegin();
+  SpiWrite(header, 3);
+  SpiWrite(data, numBytes);
+
+  // stop transfer
+  SpiEnd();
+
   if(debugPrint) {
     Serial.print("WriteRegister: REG=0x");
     Serial.print(reg, HEX);
+    DumpBytes("  DataOut: ", data, numBytes);
   }
-  digitalWrite(SX126x_SPI_SELECT, LOW);
-  SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
-
-  // send command byte
-  SPI.transfer(SX126X_CMD_WRITE_REGISTER); // 0x0D
-  SPI.transfer((reg & 0xFF00) >> 8);
-  SPI.transfer(reg & 0xff);
-  
-  if(debugPrint) {
-    Serial.print(" ");
-    Serial.print(" DataOut: ");
-  }
-  for(uint8_t n = 0; n < numBytes; n++) {
-    uint8_t in = SPI.transfer(data[n]);
-    if(debugPrint) {
-      Serial.print(data[n], HEX);
-      Serial.print(" ");
-    }
-  }
-  if(debugPrint)Serial.println();
-
-  // stop transfer
-  SPI.endTransaction();
-  digitalWrite(SX126x_SPI_SELECT, HIGH);
 
   // wait for BUSY to go low
   if(waitForBusy) {
@@ -800,35 +1524,19 @@ void SX126x::ReadRegister(uint16_t reg, uint8_t* data, uint8_t numBytes, bool wa
   WaitForIdle(BUSY_WAIT, "start ReadRegister", true);
 
   // start transfer
-  if(debugPrint) {
-    Serial.print("ReadRegister:  REG=0x");
-    Serial.print(reg, HEX);
-  }
-  digitalWrite(SX126x_SPI_SELECT, LOW);
-  SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
+  uint8_t header[4] = {SX126X_CMD_READ_REGISTER, (uint8_t)((reg & 0xFF00) >> 8), (uint8_t)(reg & 0xff), SX126X_CMD_NOP}; // 0x1D
+  SpiBegin();
+  SpiWrite(header, 4);
+  SpiRead(data, numBytes);
 
-  // send command byte
-  SPI.transfer(SX126X_CMD_READ_REGISTER); // 0x1D
-  SPI.transfer((reg & 0xFF00) >> 8);
-  SPI.transfer(reg & 0xff);
-  SPI.transfer(SX126X_CMD_NOP);
+  // stop transfer
+  SpiEnd();
 
   if(debugPrint) {
-    Serial.print(" ");
-    Serial.print(" DataIn: ");
-  }
-  for(uint8_t n = 0; n < numBytes; n++) {
-    data[n] = SPI.transfer(SX126X_CMD_NOP);
-    if(debugPrint) {
-      Serial.print(data[n], HEX);
-      Serial.print(" ");
-    }
+    Serial.print("ReadRegister:  REG=0x");
+    Serial.print(reg, HEX);
+    DumpBytes("  DataIn: ", data, numBytes);
   }
-  if(debugPrint) Serial.println();
-
-  // stop transfer
-  SPI.endTransaction();
-  digitalWrite(SX126x_SPI_SELECT, HIGH);
 
   // wait for BUSY to go low
   if(waitForBusy) {
@@ -841,61 +1549,57 @@ void SX126x::WriteCommand(uint8_t cmd, uint8_t* data, uint8_t numBytes, bool wai
   uint8_t status;
   for (int retry=1; retry<10; retry++) {
     status = WriteCommand2(cmd, data, numBytes,  waitForBusy);
-    if (status == 0) break;
+    if (status == 0 || radioError != ERR_NONE) break;
   }
   if (status != 0) {
-    Serial.print("SPI Transaction error:");
-    Serial.println(status);
-    while(1) {delay(1);}
+    SetError(ERR_SPI_TRANSACTION, "SPI Transaction error");
   }
 }
 
 uint8_t SX126x::WriteCommand2(uint8_t cmd, uint8_t* data, uint8_t numBytes, bool waitForBusy) {
+  // a truncated parameter list would still be a valid command, with the wrong parameters:
+  // refuse it instead of sending it
+  if (numBytes > SX126x_SPI_MAX_PARAMS) {
+    SetError(ERR_PARAMS_TOO_LONG, "WriteCommand parameter list too long");
+    return SX126X_STATUS_CMD_INVALID;
+  }
+
   // ensure BUSY is low (state meachine ready)
   WaitForIdle(BUSY_WAIT, "start WriteCommand2", true);
 
+  // the chip clocks its status out on every parameter byte
+  uint8_t in[SX126x_SPI_MAX_PARAMS];
+
   // start transfer
-  digitalWrite(SX126x_SPI_SELECT, LOW);
-  SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
+  SpiBegin();
+  SpiWrite(&cmd, 1);
+  SpiTransfer(data, in, numBytes);
 
-  // send command byte
-  if(debugPrint) {
-    Serial.print("WriteCommand:  CMD=0x");
-    Serial.print(cmd, HEX);
-    Serial.print(" ");
-    Serial.print(" DataOut: ");
-  }
-  SPI.transfer(cmd);
+  // stop transfer
+  SpiEnd();
 
   // variable to save error during SPI transfer
   uint8_t status = 0;
 
-  // send/receive all bytes
+  // check status of every byte
   for(uint8_t n = 0; n < numBytes; n++) {
-    uint8_t in = SPI.transfer(data[n]);
-    if(debugPrint) {
-      Serial.print(data[n], HEX);
-      Serial.print("-->");
-      Serial.print(in, HEX);
-      Serial.print(" ");
-    }
-
-    // check status
-    if(((in & 0b00001110) == SX126X_STATUS_CMD_TIMEOUT) ||
-     ((in & 0b00001110) == SX126X_STATUS_CMD_INVALID) ||
-     ((in & 0b00001110) == SX126X_STATUS_CMD_FAILED)) {
-    status = in & 0b00001110;
+    if(((in[n] & 0b00001110) == SX126X_STATUS_CMD_TIMEOUT) ||
+     ((in[n] & 0b00001110) == SX126X_STATUS_CMD_INVALID) ||
+     ((in[n] & 0b00001110) == SX126X_STATUS_CMD_FAILED)) {
+    status = in[n] & 0b00001110;
     break;
-    } else if(in == 0x00 || in == 0xFF) {
+    } else if(in[n] == 0x00 || in[n] == 0xFF) {
     status = SX126X_STATUS_SPI_FAILED;
     break;
     }
   }
-  if(debugPrint) Serial.println();
 
-  // stop transfer
-  SPI.endTransaction();
-  digitalWrite(SX126x_SPI_SELECT, HIGH);
+  if(debugPrint) {
+    Serial.print("WriteCommand:  CMD=0x");
+    Serial.print(cmd, HEX);
+    DumpBytes("  DataOut: ", data, numBytes);
+    DumpBytes("  Status:  ", in, numBytes);
+  }
 
   // wait for BUSY to go low
   if(waitForBusy) {
@@ -916,37 +1620,108 @@ void SX126x::ReadCommand(uint8_t cmd, uint8_t* data, uint8_t numBytes, bool wait
   WaitForIdle(BUSY_WAIT, "start ReadCommand", true);
 
   // start transfer
-  digitalWrite(SX126x_SPI_SELECT, LOW);
-  SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
+  SpiBegin();
+  SpiWrite(&cmd, 1);
+  SpiRead(data, numBytes);
+
+  // stop transfer
+  SpiEnd();
 
-  // send command byte
   if(debugPrint) {
     Serial.print("ReadCommand:   CMD=0x");
     Serial.print(cmd, HEX);
+    DumpBytes("  DataIn: ", data, numBytes);
   }
-  SPI.transfer(cmd);
 
-  if(debugPrint) {
-    Serial.print(" ");
-    Serial.print(" DataIn: ");
+  // wait for BUSY to go low
+  if(waitForBusy) {
+    WaitForIdle(BUSY_WAIT, "end ReadCommand", false);
   }
+}
 
-  // send/receive all bytes
-  for(uint8_t n = 0; n < numBytes; n++) {
-    data[n] = SPI.transfer(SX126X_CMD_NOP);
-    if(debugPrint) {
-      Serial.print(data[n], HEX);
-      Serial.print(" ");
-    }
-  }
-  if(debugPrint) Serial.println();
 
-  // stop transfer
+// ---------------------------------------------------------------------------
+// SPI HAL: every transaction goes through these so the bus clock, burst
+// transfers and the traffic counters live in one place.
+// ---------------------------------------------------------------------------
+
+void SX126x::SetSpiFrequency(uint32_t frequencyInHz)
+{
+  if (frequencyInHz > SX126x_SPI_MAX_FREQ) frequencyInHz = SX126x_SPI_MAX_FREQ;
+  spiFrequency = frequencyInHz;
+}
+
+
+// Bus clock actually used, after the SX126x_SPI_MAX_FREQ clamp
+uint32_t SX126x::GetSpiFrequency(void)
+{
+  return spiFrequency;
+}
+
+
+void SX126x::GetSpiStats(SX126xSpiStats *stats)
+{
+  *stats = spiStats;
+}
+
+
+void SX126x::ResetSpiStats(void)
+{
+  memset(&spiStats, 0, sizeof(spiStats));
+}
+
+
+void SX126x::SpiBegin(void)
+{
+  spiStartUs = micros();
+  digitalWrite(SX126x_SPI_SELECT, LOW);
+  SPI.beginTransaction(SPISettings(spiFrequency, MSBFIRST, SPI_MODE0));
+}
+
+
+void SX126x::SpiEnd(void)
+{
   SPI.endTransaction();
   digitalWrite(SX126x_SPI_SELECT, HIGH);
+  spiStats.transactions++;
+  spiStats.busyUs += micros() - spiStartUs;
+}
 
-  // wait for BUSY to go low
-  if(waitForBusy) {
-    WaitForIdle(BUSY_WAIT, "end ReadCommand", false);
+
+// Burst write, whatever the chip clocks back is discarded
+void SX126x::SpiWrite(const uint8_t *data, uint16_t len)
+{
+  if (len == 0) return;
+  SPI.writeBytes(data, len);
+  spiStats.bytes += len;
+}
+
+
+// Burst read, clocks out NOPs
+void SX126x::SpiRead(uint8_t *data, uint16_t len)
+{
+  if (len == 0) return;
+  memset(data, SX126X_CMD_NOP, len);
+  SPI.transferBytes(data, data, len);
+  spiStats.bytes += len;
+}
+
+
+// Full-duplex burst
+void SX126x::SpiTransfer(const uint8_t *dataOut, uint8_t *dataIn, uint16_t len)
+{
+  if (len == 0) return;
+  SPI.transferBytes(dataOut, dataIn, len);
+  spiStats.bytes += len;
+}
+
+
+void SX126x::DumpBytes(const char *label, const uint8_t *data, uint8_t numBytes)
+{
+  Serial.print(label);
+  for(uint8_t n = 0; n < numBytes; n++) {
+    Serial.print(data[n], HEX);
+    Serial.print(" ");
   }
+  Serial.println();
 }
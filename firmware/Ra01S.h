@@ -1,6 +1,8 @@
 #ifndef _RA01S_H
 #define _RA01S_H
 
+#include "Arduino.h"
+
 //return values
 #define ERR_NONE                        0
 #define ERR_PACKET_TOO_LONG             1
@@ -20,12 +22,16 @@
 #define ERR_INVALID_OUTPUT_POWER        15
 #define ERR_INVALID_MODE                16
 #define ERR_INVALID_TRANCEIVER          17
+#define ERR_BUSY_TIMEOUT                18
+#define ERR_SPI_TRANSACTION             19
+#define ERR_ILLEGAL_STATUS              20
+#define ERR_PARAMS_TOO_LONG             21
 
 // SX126X physical layer properties
 #define XTAL_FREQ                       ( double )32000000
 #define FREQ_DIV                        ( double )pow( 2.0, 25.0 )
 #define FREQ_STEP                       ( double )( XTAL_FREQ / FREQ_DIV )
-#define BUSY_WAIT                       5000
+#define BUSY_WAIT                       100         // [ms] longest legal BUSY (full calibration) is a few ms
 
 // SX126X Model
 #define SX1261_TRANCEIVER                             0x01
@@ -361,6 +367,134 @@
 #define SX126x_TXMODE_ASYNC                           0x01
 #define SX126x_TXMODE_SYNC                            0x02
 #define SX126x_TXMODE_BACK2RX                         0x04
+#define SX126x_TXMODE_BACK2STBY                       0x08
+#define SX126x_TXMODE_BACK2SLEEP                      0x10
+
+// Called from FinishTx()/ReceiveMode() in task context once an async TX has completed
+typedef void (*SX126xTxDoneCallback)(bool success, void *arg);
+
+// Radio states tracked for the power counters
+#define SX126x_STATE_SLEEP                            0
+#define SX126x_STATE_STBY                             1
+#define SX126x_STATE_RX                               2           // RX and CAD
+#define SX126x_STATE_TX                               3
+#define SX126x_STATE_COUNT                            4
+
+// Warm-start sleep: the chip ignores NSS for this long after SetSleep
+#define SX126x_SLEEP_SETTLE_US                        500
+
+// Time per radio state and wake-up latency since the last ResetPowerStats()
+typedef struct {
+  uint64_t stateUs[SX126x_STATE_COUNT];
+  uint32_t wakeups;
+  uint32_t lastWakeUs;      // NSS edge until BUSY low
+  uint32_t maxWakeUs;
+} SX126xPowerStats;
+
+// ---------------------------------------------------------------------------
+// LoRa time on air (Semtech SX126x datasheet, section 6.1.4), usable at compile time
+// ---------------------------------------------------------------------------
+
+// Bandwidth register code -> Hz
+constexpr uint32_t SX126xBandwidthHz(uint8_t bandwidth)
+{
+  return (bandwidth == SX126X_LORA_BW_7_8)   ? 7810   :
+         (bandwidth == SX126X_LORA_BW_10_4)  ? 10420  :
+         (bandwidth == SX126X_LORA_BW_15_6)  ? 15630  :
+         (bandwidth == SX126X_LORA_BW_20_8)  ? 20830  :
+         (bandwidth == SX126X_LORA_BW_31_25) ? 31250  :
+         (bandwidth == SX126X_LORA_BW_41_7)  ? 41670  :
+         (bandwidth == SX126X_LORA_BW_62_5)  ? 62500  :
+         (bandwidth == SX126X_LORA_BW_125_0) ? 125000 :
+         (bandwidth == SX126X_LORA_BW_250_0) ? 250000 :
+         (bandwidth == SX126X_LORA_BW_500_0) ? 500000 : 0;
+}
+
+constexpr uint32_t SX126xSymbolTimeUs(uint8_t spreadingFactor, uint8_t bandwidth)
+{
+  return (uint32_t)((1000000ULL << spreadingFactor) / SX126xBandwidthHz(bandwidth));
+}
+
+// Low data rate optimisation is mandatory once a symbol lasts 16.38 ms or more
+constexpr bool SX126xLdroRequired(uint8_t spreadingFactor, uint8_t bandwidth)
+{
+  return SX126xSymbolTimeUs(spreadingFactor, bandwidth) >= 16380;
+}
+
+// codingRate is the register code (SX126X_LORA_CR_4_5 = 1 .. SX126X_LORA_CR_4_8 = 4)
+constexpr uint32_t SX126xTimeOnAirUs(uint8_t spreadingFactor, uint8_t bandwidth, uint8_t codingRate,
+                                     uint16_t preambleLength, uint8_t payloadLen, bool implicitHeader, bool crcOn)
+{
+  // Everything is kept in quarter symbols so the 4.25/6.25 preamble terms stay integral
+  const bool sf56 = (spreadingFactor <= 6);
+  const int32_t bitsIn = 8 * (int32_t)payloadLen + (crcOn ? 16 : 0) + (implicitHeader ? 0 : 20)
+                         - 4 * (int32_t)spreadingFactor + (sf56 ? 0 : 8);
+  const int32_t bitsPerBlock = 4 * ((int32_t)spreadingFactor - (SX126xLdroRequired(spreadingFactor, bandwidth) ? 2 : 0));
+  const int32_t blocks = (bitsIn > 0) ? (bitsIn + bitsPerBlock - 1) / bitsPerBlock : 0;
+  const uint32_t quarterSymbols = 4 * (uint32_t)preambleLength + (sf56 ? 25 : 17) + 4 * 8
+                                  + 4 * (uint32_t)blocks * (codingRate + 4);
+  return (uint32_t)(((uint64_t)quarterSymbols * (1000000ULL << spreadingFactor) / SX126xBandwidthHz(bandwidth) + 3) / 4);
+}
+
+// Image calibration band of a frequency (the ranges CalibrateImage() picks from).
+// Moving between frequencies of one band needs no new image calibration.
+constexpr uint8_t SX126xImageCalBand(uint32_t frequency)
+{
+  return (frequency > 900000000) ? 5 :
+         (frequency > 850000000) ? 4 :
+         (frequency > 770000000) ? 3 :
+         (frequency > 460000000) ? 2 :
+         (frequency > 425000000) ? 1 : 0;
+}
+
+// SPI bus limits
+#define SX126x_SPI_DEFAULT_FREQ                       2000000
+#define SX126x_SPI_MAX_FREQ                           16000000    // SX1262 datasheet maximum
+#define SX126x_SPI_MAX_PARAMS                         16          // longest WriteCommand parameter list
+
+// SPI traffic counters, all transactions since the last ResetSpiStats()
+typedef struct {
+  uint32_t transactions;    // NSS low/high cycles
+  uint32_t bytes;           // bytes clocked, command bytes included
+  uint32_t busyUs;          // time spent with NSS low
+  uint32_t lastTxPrepareUs; // last StartTx(): packet params + FIFO write + SetTx
+  uint32_t lastRxReadUs;    // last ReadBuffer(): buffer status + FIFO read
+  uint32_t lastRxSetupUs;   // last SetRx(): standby + RF switch + SetRx + status check
+  uint16_t lastTxPrepareCmds; // SPI commands issued by the last StartTx()
+  uint16_t lastRxSetupCmds;   // SPI commands issued by the last SetRx()
+  uint16_t lastRxReadCmds;    // SPI commands issued by the last ReadBuffer()
+  uint32_t skipped;         // commands left out because the shadow state already matched
+} SX126xSpiStats;
+
+// RF switch (TXEN/RXEN) positions kept in the shadow state
+#define SX126x_RFSW_OFF                               0
+#define SX126x_RFSW_RX                                1
+#define SX126x_RFSW_TX                                2
+#define SX126x_RFSW_UNKNOWN                           0xFF
+
+// SampleRssi() outside RX
+#define SX126x_RSSI_INVALID                           0x7FFF
+
+// IRQ sources routed to DIO1 when the interrupt mode is enabled
+#define SX126x_DIO1_IRQ_MASK                          (SX126X_IRQ_RX_DONE | SX126X_IRQ_TX_DONE | SX126X_IRQ_TIMEOUT | SX126X_IRQ_CRC_ERR | \
+                                                       SX126X_IRQ_CAD_DONE | SX126X_IRQ_CAD_DETECTED)
+
+// Data buffer split: TX frames are preloaded into the lower half while RX fills the upper one
+#define SX126x_TX_BASE_ADDRESS                        0x00
+#define SX126x_RX_BASE_ADDRESS                        0x80
+
+// Software bound on one CAD probe (4 symbols at SF12/BW125 take ~131 ms)
+#define SX126x_CAD_TIMEOUT_MS                         200
+
+// Driver faults and Recover() outcomes since the last ResetFaultStats()
+typedef struct {
+  uint32_t faults;          // errors latched (one per fault until Recover())
+  uint32_t recoveries;      // successful Recover() calls
+  uint32_t failures;        // Recover() calls that left the radio faulted
+  int16_t  lastError;       // ERR_* code of the last fault
+  uint32_t lastRecoveryUs;  // duration of the last Recover()
+  uint32_t maxRecoveryUs;
+} SX126xFaultStats;
 
 
 // common low-level SPI interface
@@ -370,26 +504,125 @@ class SX126x {
 
     int16_t  begin(uint32_t frequencyInHz, int8_t txPowerInDbm, float tcxoVoltage = 0.0, bool useRegulatorLDO = false);
     void     LoRaConfig(uint8_t spreadingFactor, uint8_t bandwidth, uint8_t codingRate, uint16_t preambleLength, uint8_t payloadLen, bool crcOn, bool invertIrq);
+    void     SetModulation(uint8_t spreadingFactor, uint8_t bandwidth, uint8_t codingRate);
+    void     SetChannel(uint32_t frequency);
     uint8_t  Receive(uint8_t *pData, uint16_t len);
     bool     Send(uint8_t *pData, uint8_t len, uint8_t mode);
+    bool     SendAsync(uint8_t *pData, uint8_t len, SX126xTxDoneCallback callback, void *arg = NULL, uint8_t doneMode = SX126x_TXMODE_BACK2RX);
+    bool     PreloadTx(uint8_t *pData, uint8_t len);
+    bool     TxPreloaded(void);
+    bool     SendPreloaded(SX126xTxDoneCallback callback, void *arg = NULL, uint8_t doneMode = SX126x_TXMODE_BACK2RX);
+    bool     FinishTx(uint32_t timeoutMs);
+    bool     TxBusy(void);
+    void     SetSpiFrequency(uint32_t frequencyInHz);
+    uint32_t GetSpiFrequency(void);
+    void     GetSpiStats(SX126xSpiStats *stats);
+    void     ResetSpiStats(void);
+    void     Sleep(void);
+    void     Wakeup(void);
+    bool     IsSleeping(void);
+    void     GetPowerStats(SX126xPowerStats *stats);
+    void     ResetPowerStats(void);
     bool     ReceiveMode(void);
     void     GetPacketStatus(int8_t *rssiPacket, int8_t *snrPacket);
     void     SetTxPower(int8_t txPowerInDbm);
     uint32_t GetRandomNumber(void);
     void     DebugPrint(bool enable);
     void     SetDioIrqParams(uint16_t irqMask, uint16_t dio1Mask, uint16_t dio2Mask, uint16_t dio3Mask);
+    bool     EnableDio1Irq(int dio1);
+    uint8_t  WaitRx(uint8_t *pData, uint16_t len, uint32_t timeoutMs);
+    bool     WaitTx(uint32_t timeoutMs);
+    uint8_t  ReceiveWindow(uint8_t *pData, uint16_t len, uint32_t windowUs, uint32_t maxWaitUs = 0xFFFFFFFF);
+    void     SetRxStopOnPreamble(bool enable, uint32_t frameGuardMs);
+    void     SetCadParams(uint8_t symbolNum, uint8_t detPeak, uint8_t detMin, uint8_t exitMode, uint32_t timeout);
+    void     SetCad(void);
+    bool     ScanChannel(void);
+    uint8_t  CadReceive(uint8_t *pData, uint16_t len, uint32_t rxWindowUs, bool *detected);
+    int64_t  GetRxTimestamp(void);
+    int16_t  SampleRssi(void);
+    int16_t  GetError(void);
+    int16_t  Recover(void);
+    void     GetFaultStats(SX126xFaultStats *stats);
+    void     ResetFaultStats(void);
 
 
   private:    
     uint8_t  PacketParams[6] = {0};
+    uint8_t  packetParamsShadow[6];
+    bool     packetParamsValid;
+    uint8_t  modParamsShadow[4];
+    bool     modParamsValid;
+    uint32_t frequencyShadow;
+    bool     frequencyValid;
+    uint8_t  rfSwitch;
     bool     txActive;
+    bool     txPreloaded;
+    uint8_t  txPreloadLen;
+    uint8_t  txDoneMode;
+    SX126xTxDoneCallback txDoneCallback;
+    void     *txDoneArg;
+    bool     rxContinuous;
+    bool     rxStopOnPreamble;
+    bool     rxWindowOpen;
+    uint32_t rxFrameGuardMs;
+    uint16_t rxIrqStatus;
+    volatile int64_t dio1EdgeUs;  // 64-bit, two words on the ESP32: only under dio1Mux
+    portMUX_TYPE dio1Mux = portMUX_INITIALIZER_UNLOCKED;
+    int64_t  rxDoneUs;
+    uint8_t  cadSymbolNum;
+    uint8_t  cadDetPeak;
+    uint8_t  cadDetMin;
+    uint8_t  cadExitMode;
+    uint32_t spiFrequency;
+    uint32_t spiStartUs;
+    SX126xSpiStats spiStats;
+    bool     sleeping;
+    uint32_t sleepStartUs;
+    uint8_t  radioState;
+    uint32_t stateSinceUs;
+    SX126xPowerStats powerStats;
+    int16_t  radioError;
+    SX126xFaultStats faultStats;
+    uint32_t cfgFrequency;
+    int8_t   cfgTxPower;
+    float    cfgTcxoVoltage;
+    bool     cfgUseRegulatorLDO;
+    bool     cfgLoRa;
+    uint8_t  cfgSpreadingFactor;
+    uint8_t  cfgBandwidth;
+    uint8_t  cfgCodingRate;
+    uint16_t cfgPreambleLength;
+    uint8_t  cfgPayloadLen;
+    bool     cfgCrcOn;
+    bool     cfgInvertIrq;
     bool     debugPrint;
     int      SX126x_SPI_SELECT;
     int      SX126x_RESET;
     int      SX126x_BUSY;
     int      SX126x_TXEN;
     int      SX126x_RXEN;
-
+    int      SX126x_DIO1;
+    SemaphoreHandle_t dio1Event;
+
+    static void IRAM_ATTR Dio1Isr(void *arg);
+    void     ArmDio1(void);
+    int64_t  TakeDio1Edge(void);
+    uint32_t UsToRxTicks(uint32_t us);
+    bool     WaitCadDone(bool *detected);
+    void     SetCadDetector(uint8_t spreadingFactor);
+    void     SetState(uint8_t state);
+    void     SetError(int16_t error, const char *text);
+    void     StartTx(uint8_t *pData, uint8_t len);
+    void     WritePacketParams(void);
+    void     InvalidateShadow(void);
+    void     SpiBegin(void);
+    void     SpiEnd(void);
+    void     SpiWrite(const uint8_t *data, uint16_t len);
+    void     SpiRead(uint8_t *data, uint16_t len);
+    void     SpiTransfer(const uint8_t *dataOut, uint8_t *dataIn, uint16_t len);
+    void     DumpBytes(const char *label, const uint8_t *data, uint8_t numBytes);
+    void     CompleteTx(bool success);
+    bool     WaitDio1(uint32_t timeoutMs);
     void     FixInvertedIQ(uint8_t iqConfig);
     void     SetDio3AsTcxoCtrl(float voltage, uint32_t delay);
     void     SetDio2AsRfSwitchCtrl(uint8_t enable);
@@ -417,9 +650,9 @@ class SX126x {
     void     SetTx(uint32_t timeoutInMs);
     uint8_t  GetRssiInst();
     void     GetRxBufferStatus(uint8_t *payloadLength, uint8_t *rxStartBufferPointer);
-    void     Wakeup(void);
-    void     WaitForIdle(unsigned long timeout, char *text, bool stop);
-    uint8_t  ReadBuffer(uint8_t *rxData, uint8_t maxLen);
+    void     WaitForIdle(unsigned long timeout, const char *text, bool stop);
+    uint8_t  ReadBuffer(uint8_t *rxData, uint16_t maxLen);
+    void     CheckRxWrap(uint8_t offset, uint8_t payloadLength);
     void     WriteBuffer(uint8_t *txData, uint8_t txDataLen);
     void     WriteRegister(uint16_t reg, uint8_t* data, uint8_t numBytes, bool waitForBusy = true);
     void     ReadRegister(uint16_t reg, uint8_t* data, uint8_t numBytes, bool waitForBusy = true);
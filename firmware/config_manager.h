@@ -3,6 +3,8 @@
   
   Features:
   - Store/load WiFi credentials, Server IP, DEBUG_MODE to EEPROM
+  - Store/load the TDMA frame geometry (slot count, slot length, processing phase)
+  - Store/load this node's reporting schedule (period, phase)
   - Serial commands for runtime configuration
   - TDMA enable/disable with data reset
   - Non-blocking serial processing (only during processing phase)
@@ -28,6 +30,12 @@
 #define ADDR_RSSI_GOOD    122  // 2 bytes (int16_t)
 #define ADDR_TX_POWER     124  // 1 byte (int8_t, -9 to +22 dBm)
 #define ADDR_CHECKSUM     126  // 1 byte
+#define ADDR_FRAME_SEQ    128  // 1 byte (frame geometry version, bumped by the gateway)
+#define ADDR_FRAME_NSLOT  129  // 1 byte (0xFF = not stored)
+#define ADDR_FRAME_TSLOT  130  // 2 bytes (uint16_t, ms)
+#define ADDR_FRAME_TPROC  132  // 2 bytes (uint16_t, ms)
+#define ADDR_REPORT_PERIOD 134 // 2 bytes (uint16_t, frames; 0xFFFF = not stored)
+#define ADDR_REPORT_PHASE 136  // 2 bytes (uint16_t, frame within the period)
 
 // Limits
 #define MAX_SSID_LEN      32
@@ -51,6 +59,22 @@ struct RuntimeConfig {
   bool valid;
 };
 
+// TDMA frame geometry, network-wide. Stored apart from RuntimeConfig (no magic, no
+// reboot): a node keeps the geometry it last switched to across power cycles.
+struct FrameGeometry {
+  uint8_t seq;            // version, the gateway bumps it on every SET_FRAME
+  uint8_t nslot;          // slots per frame
+  uint16_t tslotMs;       // slot length (ms)
+  uint16_t tprocessingMs; // processing phase (ms)
+};
+
+// When this node originates its own readings: frames where the network frame counter
+// modulo periodFrames equals phase. Local to the node, kept across power cycles.
+struct ReportSchedule {
+  uint16_t periodFrames;  // frames between readings, divides REPORT_FRAME_WRAP
+  uint16_t phase;         // REPORT_PHASE_HASHED = derived from the node ID
+};
+
 // ============= SERIAL COMMAND BUFFER =============
 #define SERIAL_CMD_BUFFER_SIZE 128
 static char serialCmdBuffer[SERIAL_CMD_BUFFER_SIZE];
@@ -180,6 +204,111 @@ inline void configSave(const RuntimeConfig& cfg) {
 inline void configClear() {
   EEPROM.write(ADDR_MAGIC, 0);
   EEPROM.write(ADDR_MAGIC + 1, 0);
+  EEPROM.write(ADDR_FRAME_NSLOT, 0xFF);
+  EEPROM.write(ADDR_REPORT_PERIOD, 0xFF);
+  EEPROM.write(ADDR_REPORT_PERIOD + 1, 0xFF);
+  EEPROM.commit();
+}
+
+// ============= FRAME GEOMETRY =============
+
+inline FrameGeometry frameGeometryDefaults() {
+  FrameGeometry g;
+  g.seq = 0;
+  g.nslot = NSLOT_DEFAULT;
+  g.tslotMs = TSLOT_DEFAULT_US / 1000;
+  g.tprocessingMs = TPROCESSING_DEFAULT_US / 1000;
+  return g;
+}
+
+// nullptr if the geometry is usable with this build's LoRa parameters, else the reason
+inline const char* frameGeometryCheck(const FrameGeometry& g) {
+  if (g.nslot < 2 || g.nslot > NSLOT_MAX) {
+    return "slot count out of range";
+  }
+  if ((uint32_t)g.tslotMs * 1000UL < tslotFloorUs()) {
+    return "slot too short for the LoRa parameters";
+  }
+  if ((uint32_t)g.tprocessingMs * 1000UL < TPROCESSING_MIN_US) {
+    return "processing phase too short";
+  }
+  // Housekeeping runs in the rest of the TX slot or, without room there, in the processing phase
+  if ((uint32_t)g.tprocessingMs * 1000UL < TPROCESSING_MIN_US + HOUSEKEEPING_MIN_US &&
+      (uint32_t)g.tslotMs * 1000UL - TtxDelay_us - Tpacket_us < HOUSEKEEPING_MIN_US) {
+    return "no room for housekeeping in the slot or the processing phase";
+  }
+  return nullptr;
+}
+
+// Load frame geometry from EEPROM (defaults from settings.h if none stored or invalid)
+inline FrameGeometry frameGeometryLoad() {
+  FrameGeometry g;
+  g.seq = EEPROM.read(ADDR_FRAME_SEQ);
+  g.nslot = EEPROM.read(ADDR_FRAME_NSLOT);
+  g.tslotMs = (uint16_t)(EEPROM.read(ADDR_FRAME_TSLOT) | (EEPROM.read(ADDR_FRAME_TSLOT + 1) << 8));
+  g.tprocessingMs = (uint16_t)(EEPROM.read(ADDR_FRAME_TPROC) | (EEPROM.read(ADDR_FRAME_TPROC + 1) << 8));
+  
+  if (frameGeometryCheck(g) != nullptr) {
+    return frameGeometryDefaults();
+  }
+  return g;
+}
+
+inline void frameGeometrySave(const FrameGeometry& g) {
+  EEPROM.write(ADDR_FRAME_SEQ, g.seq);
+  EEPROM.write(ADDR_FRAME_NSLOT, g.nslot);
+  EEPROM.write(ADDR_FRAME_TSLOT, g.tslotMs & 0xFF);
+  EEPROM.write(ADDR_FRAME_TSLOT + 1, (g.tslotMs >> 8) & 0xFF);
+  EEPROM.write(ADDR_FRAME_TPROC, g.tprocessingMs & 0xFF);
+  EEPROM.write(ADDR_FRAME_TPROC + 1, (g.tprocessingMs >> 8) & 0xFF);
+  EEPROM.commit();
+}
+
+// Make g the live geometry (Nslot, Tslot_us, ... in settings.h)
+inline void frameGeometryApply(const FrameGeometry& g) {
+  Nslot = g.nslot;
+  Tslot_us = (uint32_t)g.tslotMs * 1000UL;
+  Tprocessing_us = (uint32_t)g.tprocessingMs * 1000UL;
+  frameGeometryDerive();
+}
+
+// ============= REPORTING SCHEDULE =============
+
+inline ReportSchedule reportScheduleDefaults() {
+  ReportSchedule r;
+  r.periodFrames = REPORT_PERIOD_DEFAULT;
+  r.phase = REPORT_PHASE_HASHED;
+  return r;
+}
+
+// nullptr if the schedule is usable, else the reason
+inline const char* reportScheduleCheck(const ReportSchedule& r) {
+  if (r.periodFrames == 0 || REPORT_FRAME_WRAP % r.periodFrames != 0) {
+    return "period must divide the frame counter wrap (REPORT_FRAME_WRAP)";
+  }
+  if (r.phase != REPORT_PHASE_HASHED && r.phase >= r.periodFrames) {
+    return "phase must be below the period";
+  }
+  return nullptr;
+}
+
+// Load reporting schedule from EEPROM (defaults from settings.h if none stored or invalid)
+inline ReportSchedule reportScheduleLoad() {
+  ReportSchedule r;
+  r.periodFrames = (uint16_t)(EEPROM.read(ADDR_REPORT_PERIOD) | (EEPROM.read(ADDR_REPORT_PERIOD + 1) << 8));
+  r.phase = (uint16_t)(EEPROM.read(ADDR_REPORT_PHASE) | (EEPROM.read(ADDR_REPORT_PHASE + 1) << 8));
+  
+  if (reportScheduleCheck(r) != nullptr) {
+    return reportScheduleDefaults();
+  }
+  return r;
+}
+
+inline void reportScheduleSave(const ReportSchedule& r) {
+  EEPROM.write(ADDR_REPORT_PERIOD, r.periodFrames & 0xFF);
+  EEPROM.write(ADDR_REPORT_PERIOD + 1, (r.periodFrames >> 8) & 0xFF);
+  EEPROM.write(ADDR_REPORT_PHASE, r.phase & 0xFF);
+  EEPROM.write(ADDR_REPORT_PHASE + 1, (r.phase >> 8) & 0xFF);
   EEPROM.commit();
 }
 
@@ -189,6 +318,10 @@ inline void configClear() {
 //   SET_PASS <password>   - Set WiFi password (saves & reboots)  
 //   SET_SERVER <ip>       - Set server IP (saves & reboots)
 //   SET_MODE <0/1/2>      - Set debug mode (saves & reboots)
+//   SET_FRAME <n> <slot_ms> <proc_ms> - Gateway: announce a new frame geometry
+//   SHOW_FRAME            - Show frame geometry (active and pending)
+//   SET_REPORT <frames> [phase] - Reporting period and phase of this node (saved)
+//   SHOW_REPORT           - Show reporting schedule
 //   SAVE                  - Save current config and reboot
 //   SHOW                  - Show current configuration
 //   RESET_CONFIG          - Clear EEPROM, use defaults (reboots)
@@ -10,6 +10,7 @@
 #include "settings.h"
 #include "config_manager.h"
 #include <sys/time.h>
+#include <esp_timer.h>
 
 #if ENABLE_WIFI == 1
   #include <WiFi.h>
@@ -37,6 +38,13 @@ portMUX_TYPE timerMux = portMUX_INITIALIZER_UNLOCKED;
 #define LOG_ERROR(fmt, ...)           Serial.printf("[ERROR] " fmt, ##__VA_ARGS__)
 #define LOG_INFO(fmt, ...)            Serial.printf("[INFO] " fmt, ##__VA_ARGS__)
 
+// Radio state after my own TX: nothing is scheduled for the rest of my slot
+#if RADIO_SLEEP_ENABLE == 1
+  #define TX_DONE_RADIO_MODE          SX126x_TXMODE_BACK2SLEEP
+#else
+  #define TX_DONE_RADIO_MODE          SX126x_TXMODE_BACK2RX
+#endif
+
 // Hardware objects
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, -1);
 SX126x radio(LORA_PIN_NSS, LORA_PIN_RESET, LORA_PIN_BUSY, LORA_TXEN, LORA_RXEN);
@@ -99,8 +107,41 @@ bool configLoaded = false;
 
 volatile bool tdmaEnabled = true;
 
-volatile bool tdmaSlotTick = false;
 volatile uint32_t tdmaInterruptCount = 0;
+SemaphoreHandle_t tdmaWake = NULL;    // Given by onTdmaTimer() at a scheduled wake-up
+
+// TDMA schedule: frame f starts at tdmaEpochUs + f * Tframe_us (esp_timer time).
+// Every slot edge is derived from it; a resync moves the epoch, the frame counter runs on.
+int64_t tdmaEpochUs = 0;
+uint32_t tdmaFrame = 0;
+bool tdmaScheduleValid = false;       // false: the next frame starts the grid from now
+int32_t tdmaLastShiftUs = 0;          // Epoch correction of the last resync
+
+// Slot clock discipline (CLOCK_DISCIPLINE_ENABLE): my slot clock against the edges I hear
+int32_t clockFreqPpb = 0;             // Rate error applied to every slot edge (+ = my frames run long)
+int64_t clockDriftNano = 0;           // Sub-microsecond rest of the per-frame correction (us * 1e-9)
+int64_t clockAnchorUs = 0;            // Start of the current measuring interval, 0 = none
+int32_t clockStepSumUs = 0;           // Phase steps taken since clockAnchorUs
+uint16_t clockSourceId = 0;           // Sync parent clockAnchorUs was taken on
+uint32_t clockSyncFrame = 0;          // Frame of the last resync
+uint32_t clockErrAvgUs = 0;           // Smoothed |phase error| (1/8)
+uint32_t clockErrMaxUs = 0;           // Worst |phase error| since the last lock
+bool housekeepingDone = false;        // this frame's deferred housekeeping has run (housekeepingRun)
+uint32_t housekeepingLastUs = 0;      // Duration of the last run
+uint32_t housekeepingSkipped = 0;     // Frames it found no room (HOUSEKEEPING_MIN_US) anywhere
+uint32_t housekeepingOverruns = 0;    // Runs that ended past their deadline
+
+// Frame geometry (FrameGeometry in config_manager.h): the live one and, once the gateway
+// announced a new one, the geometry that takes over at the start of frame geometrySwitchFrame
+FrameGeometry frameGeometry;
+FrameGeometry pendingGeometry;
+bool geometryPending = false;
+uint32_t geometrySwitchFrame = 0;
+
+// Slot grid is trusted for CAD listening only after a resync in the previous cycle
+bool resyncedThisCycle = false;
+bool resyncedLastCycle = false;
+uint32_t cadScanAllFrame = 0;         // TDMA_CAD_LISTEN: frame that probes every slot again
 
 // Encoder
 volatile int32_t encoderRaw = 0;
@@ -127,7 +168,33 @@ uint8_t txBuffer[TXBUFFER_SIZE];
 uint8_t rxPacketLength = 0;
 uint8_t txPacketLength = 0;
 
-bool slotAvailability[Nslot];
+bool slotAvailability[NSLOT_MAX];   // Two-hop slot map: true = no other node seen on it (slotMapBuild)
+
+// Distributed slot selection (FIX_SLOT 0)
+bool slotSelected = (FIX_SLOT == 1);  // false: listening, no TX until the first pick
+uint8_t slotListenCycles = 0;
+uint8_t slotBackoff = 0;              // Frames left before leaving a conflicting slot, 0 = no conflict
+uint8_t slotRivalGone = 0;            // Frames in a row the conflict's rival was not seen
+uint16_t slotRivalId = 0;             // Node the current conflict is with
+uint8_t slotMoveWatch = 0;            // Frames left to watch for a neighbour that moved with me
+uint32_t slotMoveHeard = 0;           // Neighbour table entries heard the frame I moved (bit = index)
+uint32_t slotMoves = 0;
+uint8_t slotOrderHold = 0;            // Frames before the next convergecast re-order (SLOT_CONVERGECAST)
+uint16_t slotOrderParent = 0;         // Next hop and its slot last frame, re-order waits for them to settle
+uint8_t slotOrderParentSlot = 0xFF;
+uint8_t slotOrderStable = 0;          // Frames in a row they stayed the same
+uint8_t extraSlots[SLOT_EXTRA_MAX + 1];  // Extra TX slots for the forwarding backlog
+uint8_t extraSlotCount = 0;
+uint8_t extraSlotBackoff = 0;         // Frames before the next extra slot may be taken
+
+// Contention slot (CONTENTION_SLOT_ENABLE)
+uint8_t contentionPending = 0;        // CONTENTION_* waiting for the contention slot
+uint8_t contentionSending = 0;        // The part of it in the frame being sent
+uint8_t contentionBackoff = 0;        // Frames to sit out after a busy channel
+uint8_t contentionExp = 0;            // Back-off exponent, reset by a send
+uint16_t alarmMessageId = 0;
+uint32_t contentionSent = 0;
+uint32_t contentionBusy = 0;
 
 char sensorDataToSend[SENSOR_DATA_LENGTH + 1];
 char sensorDataReceived[SENSOR_DATA_LENGTH + 1];
@@ -144,6 +211,7 @@ struct ForwardMessage {
   #if ENABLE_LATENCY_CALC == 1
     int64_t txTimestampUs;  // TX timestamp (works even after WiFi disconnect)
   #endif
+  bool alarm;               // Alarm (byte 11 bit 1): queued first on every hop
 };
 ForwardMessage forwardQueue[FORWARD_QUEUE_SIZE];
 uint8_t forwardQueueHead = 0;
@@ -252,14 +320,26 @@ int8_t rxSnr = 0;
 
 uint8_t loopCounter = 0;
 
-#define AUTO_SEND_INTERVAL_CYCLES 6
 uint8_t autoSendCounter = 0;
 
+static_assert(AUTO_SEND_INTERVAL_CYCLES % ADR_BASE_INTERVAL_CYCLES == 0,
+              "ADR base cycles must line up with the cycle counter wrap");
+static_assert(AUTO_SEND_INTERVAL_CYCLES % CH_HOP_BASE_INTERVAL_CYCLES == 0,
+              "channel hopping base cycles must line up with the cycle counter wrap");
+
 bool cycleValidated = false;
 uint8_t cycleValidationCount = 0;
 int8_t lastReceivedCycle = -1;
 #define CYCLE_VALIDATION_THRESHOLD 3
 
+// Join latency: from boot / TDMA_ON to a validated network cycle (FAST_JOIN_ENABLE)
+int64_t joinStartUs = 0;
+uint16_t joinFrames = 0;           // Frames spent joining so far
+bool joinBeaconFrame = false;      // This frame sends in my owned slot although still joining
+uint32_t joinLatencyMs = 0;        // Last join, 0 = none yet
+uint16_t joinLatencyFrames = 0;
+bool joinWasFast = false;
+
 // Sensor data
 float currentTemperature = 25.0;
 float currentHumidity = 60.0;
@@ -310,6 +390,38 @@ char nodeStatus[12] = "INIT";
 
 uint32_t lastTxDuration_us = 0;
 uint32_t lastRxDuration_us = 0;
+uint32_t txStart_us = 0;
+bool txFrameReady = false;    // txBuffer holds this cycle's frame (prepareUnifiedPacket)
+int64_t lastRxDoneUs = 0;     // RX_DONE time of the frame in rxBuffer (esp_timer, taken in the DIO1 ISR)
+uint32_t lastRxStampAge_us = 0;  // RX_DONE to slot resync, what the timestamp corrects
+
+uint8_t netCycle = 0;              // Network cycle number as of this cycle's processing phase
+uint8_t netEpoch = 0;              // Network frame counter, high part: netCycle wraps (beacon byte 47)
+int16_t netCycleHeard = -1;        // Cycle of the last upstream frame, taken over at the next frame start
+int16_t netEpochHeard = -1;        // Its epoch byte (no-data beacons only)
+
+// Reporting schedule (ReportSchedule in config_manager.h), phase resolved for this node
+ReportSchedule reportSchedule;
+uint16_t reportPhase = 0;
+
+// Adaptive data rate (ADR_ENABLE), profile indices into adrProfiles[]
+bool adrFastCycle = false;         // Slots use their owners' profiles (false: all on profile 0)
+uint8_t adrTxProfile = 0;          // My TX profile this cycle (announced last cycle)
+uint8_t adrTxProfileNext = 0;      // Announced in this cycle's beacon
+uint8_t adrRadioProfile = 0;       // Profile the radio is set to right now
+
+// Channel hopping (CH_HOP_ENABLE), channel indices into chHopChannels[]
+bool chHopActive = false;          // Slots hop (false: all on chHopChannels[0])
+uint8_t chHopRadioChannel = 0;     // Channel the radio is tuned to right now
+
+// Channel sampling (NOISE_SAMPLING_ENABLE)
+SlotNoiseStats slotNoise[NSLOT_MAX];
+uint16_t noiseCycle = 0;           // Tags ring entries, counts up every cycle
+bool noiseWindowOpen = false;      // responder() is running for listenWindow()
+uint32_t noisePhaseEndUs = 0;      // micros() at which the listened RX phase ends
+uint8_t noiseEndSlot = 0;          // Slot index at that point
+int8_t noiseTakenSlot = -1;        // Last sample taken (slot, point) in noiseCycle
+int8_t noiseTakenPoint = -1;
 
 void IRAM_ATTR encoderISR();
 void IRAM_ATTR buttonISR();
@@ -328,13 +440,95 @@ void updateDisplay();
 void updateNeighbourStatus();
 void printStatusLine();
 
+void prepareUnifiedPacket(uint8_t slot);
 void transmitUnifiedPacket();
+void onTxDone(bool success, void* arg);
+void waitMicros(uint32_t us);
+void waitUntil(int64_t deadlineUs);
+void radioIdleFor(uint32_t us);
+void radioIdleUntil(int64_t deadlineUs);
+int64_t frameStartUs();
+int64_t slotStartUs(int slot);
+long usUntil(int64_t deadlineUs);
+void tdmaStartFrame();
+void tdmaResync(int slot, int64_t edgeUs, uint16_t senderId);
+void tdmaNextFrame();
+void clockDiscipline(int32_t stepUs, uint16_t senderId);
+void clockRestart();
+uint8_t frameGeometryCountdown();
+void frameGeometrySchedule(const FrameGeometry& g, uint32_t switchFrame);
+const char* frameGeometryRequest(uint8_t nslot, uint16_t tslotMs, uint16_t tprocessingMs);
+bool frameGeometryFromBeacon(uint8_t senderHop);
+void frameGeometrySwitch();
+bool nbrOwnsSlot(const NeighbourInfo& nbr, uint8_t slot);
+bool isMySlot(int slot);
+void slotMapBuild();
+uint16_t slotRival(uint8_t slot);
+bool slotRivalHeardElsewhere();
+void slotMoveWatchStart();
+uint8_t slotMoveSilentLimit();
+uint16_t slotMoveRival();
+uint32_t slotOccupancy();
+uint8_t slotParentSlot();
+uint8_t slotPickFree(uint8_t fallback);
+void slotReorder();
+void slotSelectUpdate();
+uint8_t slotExtraWanted();
+void slotExtraRelease(uint8_t e);
+void slotExtraUpdate();
+uint8_t mySlotsInOrder(uint8_t* slots);
+void slotSelectRestart();
+void printSlotMap();
+void joinRestart();
+bool joinListening();
+void joinComplete(bool fast);
+bool nbrRoutable(const NeighbourInfo& nbr);
+uint8_t contentionSlot();
+uint8_t slotOwnableCount();
+void contentionRequest(uint8_t what);
+bool contentionReady();
+uint8_t contentionAddSlot(uint8_t* slots, uint8_t count);
+void contendInSlot(uint8_t slot);
+bool recoverRadioIfFaulted();
+void advanceNetCycle();
+uint16_t netFrame();
+void reportScheduleApply(const ReportSchedule& r);
+bool reportDue();
+int slotOwner(int slot);
+uint8_t adrProfileForSnr(int8_t snrDb);
+void adrApplyProfile(uint8_t profile);
+uint8_t adrSlotProfile(int slot);
+void adrUpdateLink(uint8_t idx, uint8_t announcedProfile);
+void adrStartCycle();
+uint8_t chHopChannel(int slot, uint16_t ownerId);
+void chHopApplyChannel(uint8_t channel);
+uint8_t chHopSlotChannel(int slot);
+void chHopStartCycle();
+void resetNoiseStats();
+long noiseSlotPosition(int* slot);
+uint32_t noiseNextSampleUs();
+void noiseSample();
+int16_t noiseFloorDbm(int slot);
+int16_t noiseReferenceFloor();
+int noiseBusyPercent(uint8_t slot, uint8_t point, int16_t refFloor);
+void printNoiseStats();
+void sendNoiseStatsWifi();
 uint8_t processRxPacket();
-uint16_t selectBestNextHop();
+bool syncSourceOk(uint16_t senderId, uint8_t senderStratum, uint8_t senderHop);
+uint16_t selectBestNextHop(bool logChoice = true);
 bool enqueueForward(ForwardMessage* msg);
+bool enqueueForwardFront(ForwardMessage* msg);
 bool dequeueForward(ForwardMessage* msg);
 
-ResponderOutput responder(uint32_t timeoutMs);
+ResponderOutput responder(uint32_t timeoutUs);
+ResponderOutput cadResponder(long remaining_us, long window_us, uint8_t endSlot);
+bool cadSlotOwned(int slot);
+bool cadSlotWatched(int slot);
+ResponderOutput listenWindow(long remaining_us, uint8_t endSlot, long stopEarly_us);
+bool handleRxFrame(uint8_t rxLen, uint32_t rxStartUs, ResponderOutput* output);
+void listenUntilSlot(uint8_t endSlot);
+void transmitInSlot(uint8_t slot);
+bool housekeepingRun(int64_t deadlineUs);
 
 #if ENABLE_PDR_TRACKING == 1
 void updatePdrStats(uint16_t nodeId, uint16_t messageId);
@@ -452,9 +646,13 @@ void formatTimestamp(int64_t timeUs, char* buffer, size_t bufSize) {
 
 void IRAM_ATTR onTdmaTimer() {
   portENTER_CRITICAL_ISR(&timerMux);
-  tdmaSlotTick = true;
   tdmaInterruptCount++;
   portEXIT_CRITICAL_ISR(&timerMux);
+  BaseType_t woken = pdFALSE;
+  xSemaphoreGiveFromISR(tdmaWake, &woken);
+  if (woken == pdTRUE) {
+    portYIELD_FROM_ISR();
+  }
 }
 
 #if ENABLE_PDR_TRACKING == 1
@@ -500,14 +698,15 @@ void updatePdrStats(uint16_t nodeId, uint16_t messageId) {
       stats->initialized = true;
       stats->pdr = 100.0;
     } else {
-      // Calculate expected packets based on sequence jump
-      uint16_t seqDiff;
+      // Calculate expected packets based on sequence jump (wraps at 256)
+      uint16_t seqDiff = (uint8_t)(seqNum - stats->lastSeqReceived);
       
-      if (seqNum > stats->lastSeqReceived) {
-        seqDiff = seqNum - stats->lastSeqReceived;
-      } else {
-        // Handle sequence number wrap-around (0-255)
-        seqDiff = (256 - stats->lastSeqReceived) + seqNum;
+      // Same or older sequence: a copy that came in over a second route, or one overtaken by
+      // a newer packet (already counted as lost). Not a wrap, it changes nothing.
+      if (seqDiff == 0 || seqDiff >= 128) {
+        DEBUG_PRINT("[PDR] Node %d: Seq %d after %d, duplicate or late, ignored\n",
+                    nodeId, seqNum, stats->lastSeqReceived);
+        return;
       }
       
       // Update counts
@@ -816,6 +1015,7 @@ void initLoRa() {
   
   // Initialize SPI with custom pins
   SPI.begin(LORA_PIN_SCLK, LORA_PIN_MISO, LORA_PIN_MOSI, LORA_PIN_NSS);
+  radio.SetSpiFrequency(LORA_SPI_FREQ_HZ);
   
   // Enable debug output (optional)
   radio.DebugPrint(true);
@@ -833,12 +1033,26 @@ void initLoRa() {
     while(1);
   }
   
+  #if LORA_USE_DIO1_IRQ == 1
+    // Enabled before LoRaConfig() so its IRQ routing already includes DIO1
+    if (!radio.EnableDio1Irq(LORA_PIN_DIO_1)) {
+      Serial.println("[ERROR] DIO1 interrupt setup failed, falling back to polling");
+    }
+  #endif
+  
+  #if LORA_USE_HW_RX_TIMEOUT == 1
+    // A frame whose preamble lands before the window closes is still received in full
+    radio.SetRxStopOnPreamble(true, RX_FRAME_GUARD_MS);
+  #endif
+  
   radio.LoRaConfig(
     LORA_SPREADING_FACTOR,   // SF7 = 7
     LORA_BANDWIDTH,          // BW125 = 0x04
     LORA_CODINGRATE,         // CR4/5 = 0x01
     LORA_PREAMBLE_LENGTH,    // 8 symbols
-    FIXED_PACKET_LENGTH,     // Fixed 48 bytes (implicit header)
+    // RX must use the header mode StartTx() sends with, or a node that never sent yet
+    // cannot decode anything: 0 = explicit header (length from the header)
+    LORA_IMPLICIT_HEADER ? FIXED_PACKET_LENGTH : 0,
     true,                    // CRC on
     false                    // Standard IQ
   );
@@ -860,18 +1074,21 @@ void initLoRa() {
   Serial.printf("  CR: 4/%d\n", LORA_CODINGRATE + 4);
   
   Serial.println("\nTiming Analysis:");
+  Serial.printf("  Air time: %lu μs (%d bytes, %s header, LDRO %s)\n", (uint32_t)TX_ONAIR_TIME_US,
+                FIXED_PACKET_LENGTH, LORA_IMPLICIT_HEADER ? "implicit" : "explicit",
+                SX126xLdroRequired(LORA_SPREADING_FACTOR, LORA_BANDWIDTH) ? "on" : "off");
   Serial.printf("  Measured ToA: %lu μs (%.2f ms)\n", MEASURED_TOA_US, MEASURED_TOA_US / 1000.0);
   Serial.printf("  Effective ToA: %lu μs (%.2f ms) [+20%% margin]\n", 
                 EFFECTIVE_TOA_US, EFFECTIVE_TOA_US / 1000.0);
-  Serial.printf("  Slot duration: %lu μs (%.2f ms)\n", Tslot_us, Tslot_us / 1000.0);
+  Serial.printf("  Slot duration: %lu μs (%.2f ms), minimum safe: %lu μs\n", Tslot_us, Tslot_us / 1000.0, TSLOT_MIN_US);
   Serial.printf("  Safety margin: %.1fx\n", (float)Tslot_us / (float)EFFECTIVE_TOA_US);
   
+  // One-shot alarms, armed by waitUntil() for the next slot edge
+  tdmaWake = xSemaphoreCreateBinary();
   tdmaTimer = timerBegin(1000000);  // 1 MHz = 1 microsecond resolution
   timerAttachInterrupt(tdmaTimer, &onTdmaTimer);
-  // Set alarm to trigger every Tperiod_us (full TDMA cycle)
-  timerAlarm(tdmaTimer, Tperiod_us, true, 0);  // autoreload=true, unlimited=0
-  Serial.printf("  Timer period: %lu μs (%.2f ms)\n", Tperiod_us, Tperiod_us / 1000.0);
-  Serial.printf("  Timer accuracy: ±%d μs\n", TIMER_ERROR_MARGIN_US);
+  Serial.printf("  Frame: %lu μs (%.2f ms) = processing + %d slots\n", Tframe_us, Tframe_us / 1000.0, Nslot);
+  Serial.printf("  Timer accuracy: ±%d μs, wake-up %d μs before each edge\n", TIMER_ERROR_MARGIN_US, TDMA_WAKE_SPIN_US);
 }
 
 void initMyInfo() {
@@ -1541,6 +1758,9 @@ void wifiMonitorTask(void* parameter) {
                         myInfo.id, myInfo.slotIndex, myInfo.hoppingDistance, 
                         neighbourCount, tdmaEnabled ? "ON" : "OFF");
                 sendWifiEvent("STATUS", status);
+                #if NOISE_SAMPLING_ENABLE == 1
+                  sendNoiseStatsWifi();
+                #endif
               }
               else if (cmd == "CYCLE_STATUS") {
                 char cycleStatus[128];
@@ -1617,6 +1837,22 @@ bool enqueueForward(ForwardMessage* msg) {
   return true;
 }
 
+// Alarms skip the line: the next frame I send carries it
+bool enqueueForwardFront(ForwardMessage* msg) {
+  if (forwardQueueCount >= FORWARD_QUEUE_SIZE) {
+    Serial.printf("[Node %d] [QUEUE] Forward queue full, alarm MsgID:%d dropped!\n", myInfo.id, msg->messageId);
+    return false;
+  }
+  
+  forwardQueueTail = (forwardQueueTail + FORWARD_QUEUE_SIZE - 1) % FORWARD_QUEUE_SIZE;
+  memcpy(&forwardQueue[forwardQueueTail], msg, sizeof(ForwardMessage));
+  forwardQueueCount++;
+  
+  Serial.printf("[Node %d] [QUEUE] Alarm MsgID:%d queued first, count:%d\n", 
+                myInfo.id, msg->messageId, forwardQueueCount);
+  return true;
+}
+
 bool dequeueForward(ForwardMessage* msg) {
   if (forwardQueueCount == 0) {
     return false;
@@ -1629,7 +1865,7 @@ bool dequeueForward(ForwardMessage* msg) {
   return true;
 }
 
-uint16_t selectBestNextHop() {
+uint16_t selectBestNextHop(bool logChoice) {
   // Select best next hop from bidirectional neighbors
   // Priority: Good RSSI (> -100) > Low hop count > Best SNR
   
@@ -1644,8 +1880,9 @@ uint16_t selectBestNextHop() {
     // Filter 1: RSSI must be above rssiThresholdDbm (configurable, default -115)
     if (neighbours[idx].rssi < rssiThresholdDbm) continue;
     
-    // Filter 2: Must be bidirectional and have valid hop distance
+    // Filter 2: Must be bidirectional, recently heard and have valid hop distance
     if (!neighbours[idx].amIListedAsNeighbour) continue;
+    if (!nbrRoutable(neighbours[idx])) continue;
     if (neighbours[idx].hoppingDistance >= myInfo.hoppingDistance) continue;
     if (neighbours[idx].hoppingDistance == 0x7F) continue;
     
@@ -1689,7 +1926,7 @@ uint16_t selectBestNextHop() {
     }
   }
   
-  if (bestNodeId > 0) {
+  if (bestNodeId > 0 && logChoice) {
     Serial.printf("[Node %d] [ROUTE] Selected next hop: Node %d (hop:%d RSSI:%d SNR:%d)\n",
                   myInfo.id, bestNodeId, bestHop, bestRssi, bestSnr);
   }
@@ -1697,39 +1934,57 @@ uint16_t selectBestNextHop() {
   return bestNodeId;
 }
 
-void transmitUnifiedPacket() {
+// Build the frame for one of my slots in txBuffer and load it into the radio's TX buffer.
+// Runs during RX phase 1 (see TX_PRELOAD_LEAD_US) or, for slot 0, at the slot start.
+void prepareUnifiedPacket(uint8_t slot) {
+  bool contention = (slot == contentionSlot());
   memset(txBuffer, 0, FIXED_PACKET_LENGTH);
   
   // HEADER SECTION (12 bytes)
   txBuffer[0] = (uint8_t)((ADR_BROADCAST >> 8) & 0xFF);
   txBuffer[1] = (uint8_t)((ADR_BROADCAST) & 0xFF);
-  txBuffer[2] = CMD_ID_AND_POS;
+  txBuffer[2] = contention ? CMD_CONTENTION : CMD_ID_AND_POS;
   txBuffer[3] = (uint8_t)((myInfo.id >> 8) & 0xFF);
   txBuffer[4] = (uint8_t)((myInfo.id) & 0xFF);
-  txBuffer[5] = myInfo.slotIndex;
+  // Byte 5: slot (bits 5-0) + sent in an extra slot (bit 7).
+  // In the contention slot: the slot I claim, 0x3F = none yet.
+  if (contention) {
+    txBuffer[5] = slotSelected ? (myInfo.slotIndex & 0x3F) : 0x3F;
+  } else {
+    txBuffer[5] = (slot & 0x3F) | (slot != myInfo.slotIndex ? 0x80 : 0x00);
+  }
   txBuffer[6] = (myInfo.isLocalized << 7) | myInfo.hoppingDistance;
   
   uint8_t neighborsToSend = min((uint8_t)neighbourCount, (uint8_t)MAX_NEIGHBOURS_IN_PACKET);
-  // Pack cycle (5 bits) and neighbor count (3 bits) into byte 7
-  txBuffer[7] = (myInfo.syncedCycle << 3) | (neighborsToSend & 0x07);
+  // Pack cycle (5 bits) and neighbor count (3 bits) into byte 7. netCycle, not the last cycle
+  // heard: a relay whose slot comes before its parent's has not heard this frame's yet.
+  txBuffer[7] = (netCycle << 3) | (neighborsToSend & 0x07);
   
   // Byte 8: Data mode (will be set below)
   // Bytes 9-10: Hop decision target ID (will be set below)
-  // Byte 11: Stratum (bits 7-6) + reserved (bits 5-1) + TimeSyncFlag (bit 0)
+  // Byte 11: Stratum (bits 7-6) + ADR (bits 5-4) + reserved (bits 3-2) + alarm (bit 1) + TimeSyncFlag (bit 0)
   // Stratum encoding: 0=GATEWAY, 1=DIRECT, 2=INDIRECT, 3=LOCAL
   #if ENABLE_WIFI == 1
     txBuffer[11] = ((myInfo.syncStratum & 0x03) << 6) | (timeSynced ? 0x01 : 0x00);
   #else
     txBuffer[11] = ((myInfo.syncStratum & 0x03) << 6);
   #endif
+  #if ADR_ENABLE == 1
+    // ADR: bits 5-4 = my TX profile from next cycle on
+    txBuffer[11] |= (adrTxProfileNext & 0x03) << 4;
+  #endif
   
   // NEIGHBOR SECTION (24 bytes: 12-35, max 6 neighbors)
+  // Slot byte: slot (bits 5-0) + ADR profile I hear that neighbour at (bits 7-6)
   uint8_t byteIdx = 12;
   for (uint8_t i = 0; i < neighborsToSend; i++) {
     uint8_t idx = neighbourIndices[i];
     txBuffer[byteIdx] = (uint8_t)((neighbours[idx].id >> 8) & 0xFF);
     txBuffer[byteIdx + 1] = (uint8_t)((neighbours[idx].id) & 0xFF);
-    txBuffer[byteIdx + 2] = neighbours[idx].slotIndex;
+    txBuffer[byteIdx + 2] = neighbours[idx].slotIndex & 0x3F;
+    #if ADR_ENABLE == 1
+      txBuffer[byteIdx + 2] |= (neighbours[idx].adrRxProfile & 0x03) << 6;
+    #endif
     txBuffer[byteIdx + 3] = (neighbours[idx].isLocalized << 7) | neighbours[idx].hoppingDistance;
     byteIdx += 4;
   }
@@ -1747,12 +2002,33 @@ void transmitUnifiedPacket() {
   #if ENABLE_WIFI == 1 && ENABLE_LATENCY_CALC == 1
     int64_t embeddedTxTimestamp = 0;  // For forwarding (works even after WiFi disconnect)
   #endif
+  bool alarm = false;
+  
+  // Contention slot: a pending alarm or no data, the queue and my readings wait for my slots.
+  // What it announces is only done once the frame went out (contendInSlot).
+  if (contention) {
+    contentionSending = contentionPending & (CONTENTION_JOIN | CONTENTION_CLAIM);
+    if ((contentionPending & CONTENTION_ALARM) &&
+        myInfo.hoppingDistance != 0x7F && myInfo.hoppingDistance != 0) {
+      hopDecisionTarget = selectBestNextHop();
+      if (hopDecisionTarget > 0) {
+        dataMode = DATA_MODE_OWN;
+        alarm = true;
+        origSender = myInfo.id;
+        msgId = alarmMessageId;
+        hopCount = 1;
+        tracking[0] = myInfo.id;
+        contentionSending |= CONTENTION_ALARM;
+      }
+    }
+  }
   
   // Priority 1: Check forward queue (send one forwarded message per cycle)
   ForwardMessage fwdMsg;
-  if (forwardQueueCount > 0 && myInfo.hoppingDistance != 0x7F && myInfo.hoppingDistance != 0) {
+  if (!contention && forwardQueueCount > 0 && myInfo.hoppingDistance != 0x7F && myInfo.hoppingDistance != 0) {
     if (dequeueForward(&fwdMsg)) {
       dataMode = DATA_MODE_FORWARD;
+      alarm = fwdMsg.alarm;
       origSender = fwdMsg.originalSender;
       msgId = fwdMsg.messageId;
       hopCount = fwdMsg.hopCount;
@@ -1776,7 +2052,7 @@ void transmitUnifiedPacket() {
   }
   
   // Priority 2: Own sensor data (only when queue is empty)
-  if (dataMode == DATA_MODE_NONE && hasSensorDataToSend && 
+  if (!contention && dataMode == DATA_MODE_NONE && hasSensorDataToSend && 
       myInfo.hoppingDistance != 0x7F && myInfo.hoppingDistance != 0) {
     dataMode = DATA_MODE_OWN;
     origSender = ownMessageOrigSender;
@@ -1821,6 +2097,7 @@ void transmitUnifiedPacket() {
   
   // Set header bytes 8-10
   txBuffer[8] = dataMode;
+  if (alarm) txBuffer[11] |= 0x02;
   txBuffer[9] = (uint8_t)((hopDecisionTarget >> 8) & 0xFF);
   txBuffer[10] = (uint8_t)(hopDecisionTarget & 0xFF);
   
@@ -1893,11 +2170,67 @@ void transmitUnifiedPacket() {
         #endif
       }
     #endif
+  } else {
+    // Frame geometry (36-42), see frameGeometryFromBeacon():
+    // 36: Version (of the pending geometry while counting down)
+    // 37: Frames until the switch (0 = none pending)
+    // 38: Slots per frame
+    // 39-40: Slot length (ms)
+    // 41-42: Processing phase (ms)
+    const FrameGeometry& g = geometryPending ? pendingGeometry : frameGeometry;
+    txBuffer[36] = g.seq;
+    txBuffer[37] = geometryPending ? frameGeometryCountdown() : 0;
+    txBuffer[38] = g.nslot;
+    txBuffer[39] = (uint8_t)((g.tslotMs >> 8) & 0xFF);
+    txBuffer[40] = (uint8_t)(g.tslotMs & 0xFF);
+    txBuffer[41] = (uint8_t)((g.tprocessingMs >> 8) & 0xFF);
+    txBuffer[42] = (uint8_t)(g.tprocessingMs & 0xFF);
+    
+    // 43-46: Slot occupancy around me (bit per slot), see slotMapBuild()
+    uint32_t occupancy = slotOccupancy();
+    txBuffer[43] = (uint8_t)((occupancy >> 24) & 0xFF);
+    txBuffer[44] = (uint8_t)((occupancy >> 16) & 0xFF);
+    txBuffer[45] = (uint8_t)((occupancy >> 8) & 0xFF);
+    txBuffer[46] = (uint8_t)(occupancy & 0xFF);
     
+    // 47: Network frame counter, high part (netEpoch), see reportDue()
+    txBuffer[47] = netEpoch;
+  }
+  
+  if (!radio.PreloadTx(txBuffer, FIXED_PACKET_LENGTH)) {
+    Serial.printf("[Node %d] [RADIO_TX] Preload failed, frame is written at the slot start\n", myInfo.id);
+  }
+  txFrameReady = true;
+}
+
+// Slot start: the frame is normally in the radio already, so this is just SetTx
+void transmitUnifiedPacket() {
+  // Radio slept or its buffer was overwritten since the preload: write txBuffer again
+  if (!radio.TxPreloaded()) {
+    radio.PreloadTx(txBuffer, FIXED_PACKET_LENGTH);
+  }
+  
+  // Ra01S: Start TX without blocking. The loop completes it with radio.FinishTx(),
+  // so the logging below runs during air time instead of delaying the slot edge.
+  txStart_us = micros();
+  if (!radio.SendPreloaded(onTxDone, NULL, TX_DONE_RADIO_MODE)) {
+    Serial.printf("[Node %d] [RADIO_TX] Previous TX still in flight, skipped\n", myInfo.id);
+  }
+  txFrameReady = false;
+  
+  uint8_t txSlot = txBuffer[5] & 0x3F;
+  uint8_t neighborsToSend = txBuffer[7] & 0x07;
+  uint8_t dataMode = txBuffer[8];
+  uint16_t hopDecisionTarget = (txBuffer[9] << 8) | txBuffer[10];
+  uint16_t origSender = (txBuffer[28] << 8) | txBuffer[29];
+  uint16_t msgId = (txBuffer[30] << 8) | txBuffer[31];
+  uint8_t hopCount = txBuffer[32];
+  
+  if (dataMode != DATA_MODE_NONE) {
     // Stratum names for display
     const char* stratumNames[] = {"GW", "D1", "D2", "LC"};
     Serial.printf("[Node %d] [TX] slot:%d hop:%d cycle:%d nbr:%d stratum:%s(%d) | %s: MsgID:%d orig:%d hops:%d target:%d\n", 
-                  myInfo.id, myInfo.slotIndex, myInfo.hoppingDistance, myInfo.syncedCycle, neighborsToSend,
+                  myInfo.id, txSlot, myInfo.hoppingDistance, netCycle, neighborsToSend,
                   stratumNames[myInfo.syncStratum], myInfo.syncStratum,
                   (dataMode == DATA_MODE_OWN) ? "OWN" : "FWD",
                   msgId, origSender, hopCount, hopDecisionTarget);
@@ -1906,171 +2239,1256 @@ void transmitUnifiedPacket() {
   } else {
     const char* stratumNames[] = {"GW", "D1", "D2", "LC"};
     Serial.printf("[Node %d] [TX] slot:%d hop:%d cycle:%d nbr:%d stratum:%s(%d) | NO_DATA\n", 
-                  myInfo.id, myInfo.slotIndex, myInfo.hoppingDistance, myInfo.syncedCycle, neighborsToSend,
+                  myInfo.id, txSlot, myInfo.hoppingDistance, netCycle, neighborsToSend,
                   stratumNames[myInfo.syncStratum], myInfo.syncStratum);
     strcpy(nodeStatus, "TX_ID");
   }
+}
+
+// TX-done hook, runs from radio.FinishTx() once the radio is back in RX
+void onTxDone(bool success, void* arg) {
+  lastTxDuration_us = micros() - txStart_us;
   
-  // Ra01S: Send with synchronous mode (blocks until TX complete)
-  uint32_t txStart = micros();
-  bool txSuccess = radio.Send(txBuffer, FIXED_PACKET_LENGTH, SX126x_TXMODE_SYNC);
-  lastTxDuration_us = micros() - txStart;
-  
-  if (txSuccess) {
+  if (success) {
     txPacketCount++;
   } else {
     Serial.printf("[Node %d] [RADIO_TX] FAILED!\n", myInfo.id);
   }
 }
 
-uint8_t processRxPacket() {
-  uint8_t selectedNeighbourIdx = 0;
+void waitMicros(uint32_t us) {
+  waitUntil(esp_timer_get_time() + us);
+}
+
+// Block until deadlineUs (esp_timer time). The hardware timer wakes the task
+// TDMA_WAKE_SPIN_US early and only that last stretch is spun, so the core is
+// free (or asleep) in between and the edge still lands on the microsecond.
+void waitUntil(int64_t deadlineUs) {
+  int64_t remaining = deadlineUs - esp_timer_get_time();
+  if (remaining > 2 * TDMA_WAKE_SPIN_US) {
+    if (tdmaTimer != NULL) {
+      xSemaphoreTake(tdmaWake, 0);  // drop a wake-up left over from an earlier wait
+      timerWrite(tdmaTimer, 0);
+      timerAlarm(tdmaTimer, (uint64_t)(remaining - TDMA_WAKE_SPIN_US), false, 0);
+      xSemaphoreTake(tdmaWake, pdMS_TO_TICKS(remaining / 1000 + 2));
+    } else {
+      vTaskDelay((remaining - TDMA_WAKE_SPIN_US) / (portTICK_PERIOD_MS * 1000));
+    }
+  }
+  while (esp_timer_get_time() < deadlineUs) {
+  }
+}
+
+void radioIdleFor(uint32_t us) {
+  radioIdleUntil(esp_timer_get_time() + us);
+}
+
+// A gap with no RX/TX for this node: put the radio in warm sleep when the gap is
+// long enough and wake it RADIO_WAKEUP_BUDGET_US early so the next slot starts on time
+void radioIdleUntil(int64_t deadlineUs) {
+  #if RADIO_SLEEP_ENABLE == 1
+    if (deadlineUs - esp_timer_get_time() >= RADIO_SLEEP_MIN_US) {
+      radio.Sleep();
+    }
+    if (radio.IsSleeping()) {
+      waitUntil(deadlineUs - RADIO_WAKEUP_BUDGET_US);
+      radio.Wakeup();
+    }
+  #endif
+  waitUntil(deadlineUs);
+}
+
+// ============= TDMA SCHEDULE =============
+
+int64_t frameStartUs() {
+  return tdmaEpochUs + (int64_t)tdmaFrame * Tframe_us;
+}
+
+// Start of a slot of the current frame; slot Nslot is the end of the frame.
+// Stretched by my clock's frequency offset, see clockDiscipline().
+int64_t slotStartUs(int slot) {
+  int64_t offsetUs = Tprocessing_us + (int64_t)slot * Tslot_us;
+  return frameStartUs() + offsetUs + offsetUs * clockFreqPpb / 1000000000LL;
+}
+
+long usUntil(int64_t deadlineUs) {
+  return (long)(deadlineUs - esp_timer_get_time());
+}
+
+// Top of loop(): move on to the next frame of the grid
+void tdmaStartFrame() {
+  int64_t now = esp_timer_get_time();
+  if (!tdmaScheduleValid) {
+    tdmaEpochUs = now;
+    tdmaFrame = 0;
+    tdmaScheduleValid = true;
+    clockRestart();
+    // The frame count restarted, a pending switch can no longer be timed: take it now
+    if (geometryPending) frameGeometrySwitch();
+    return;
+  }
+  tdmaNextFrame();
+  if (geometryPending && (int32_t)(tdmaFrame - geometrySwitchFrame) >= 0) {
+    frameGeometrySwitch();
+  }
+  // Whole frames lost (blocking serial command etc.): skip them, the grid stays where it is
+  while (frameStartUs() + Tframe_us <= now) {
+    tdmaNextFrame();
+  }
+}
+
+// One frame on: the frame just ended was stretched by my clock's frequency offset
+void tdmaNextFrame() {
+  tdmaFrame++;
+  clockDriftNano += (int64_t)Tframe_us * clockFreqPpb;
+  int64_t wholeUs = clockDriftNano / 1000000000LL;
+  clockDriftNano -= wholeUs * 1000000000LL;
+  tdmaEpochUs += wholeUs;
+}
+
+// A resync put the start of `slot` at edgeUs: shift the grid by my phase error, counters keep
+// running. The heard edge is taken as the nearest one of that slot, so the frame I am in stays
+// the frame I am in; a grid more than half a frame off (first lock) lands on the neighbouring
+// frame's edge and tdmaStartFrame() counts the frames that passed.
+void tdmaResync(int slot, int64_t edgeUs, uint16_t senderId) {
+  int64_t shift = (edgeUs - slotStartUs(slot)) % (int64_t)Tframe_us;
+  if (shift >= (int64_t)Tframe_us / 2) shift -= Tframe_us;
+  if (shift < -(int64_t)Tframe_us / 2) shift += Tframe_us;
+  tdmaEpochUs += shift;
+  tdmaLastShiftUs = (int32_t)shift;
+  clockSyncFrame = tdmaFrame;
+  #if CLOCK_DISCIPLINE_ENABLE == 1
+    clockDiscipline(tdmaLastShiftUs, senderId);
+  #endif
+}
+
+// ============= SLOT CLOCK DISCIPLINE (CLOCK_DISCIPLINE_ENABLE) =============
+
+// Integral part of the slot clock PLL; the proportional part is the full phase step the
+// resync just took. Steps summed between two edges of my sync parent are the drift the
+// current rate left against it, stepUs > 0 means my edges came early, so my frames have to
+// run longer. Steps from other upstream senders count into the sum, but only a parent
+// edge closes an interval: their own rate error never becomes mine.
+void clockDiscipline(int32_t stepUs, uint16_t senderId) {
+  int64_t now = esp_timer_get_time();
+  uint32_t errUs = (uint32_t)abs(stepUs);
+  bool fromParent = (senderId == myInfo.syncSource);
+  
+  if (errUs > CLOCK_STEP_MAX_US || (fromParent && senderId != clockSourceId)) {
+    // Grid jump (lock, wrap, new parent): not drift, measure again from the parent's next edge
+    clockAnchorUs = 0;
+    clockErrMaxUs = 0;
+  }
+  if (clockAnchorUs == 0) {
+    if (fromParent) {
+      clockAnchorUs = now;
+      clockStepSumUs = 0;
+      clockSourceId = senderId;
+    }
+    return;
+  }
   
-  // PARSE HEADER (12 bytes)
-  uint16_t senderId = (rxBuffer[3] << 8) | rxBuffer[4];
-  uint8_t senderSlot = rxBuffer[5];
-  uint8_t senderHop = rxBuffer[6] & 0x7F;
-  bool senderLocalized = (rxBuffer[6] >> 7) & 0x01;
-  uint8_t senderCycle = (rxBuffer[7] >> 3) & 0x1F;
-  uint8_t numNeighborsInPacket = rxBuffer[7] & 0x07;
-  uint8_t dataMode = rxBuffer[8];
-  uint16_t hopDecisionTarget = (rxBuffer[9] << 8) | rxBuffer[10];
+  clockErrAvgUs = (7 * clockErrAvgUs + errUs) / 8;
+  if (errUs > clockErrMaxUs) clockErrMaxUs = errUs;
+  clockStepSumUs += stepUs;
   
-  // Parse byte 11: Stratum (bits 7-6) + TimeSyncFlag (bit 0)
-  uint8_t senderStratum = (rxBuffer[11] >> 6) & 0x03;
-  bool senderTimeSynced = rxBuffer[11] & 0x01;
+  int64_t elapsedUs = now - clockAnchorUs;
+  if (!fromParent || elapsedUs < (int64_t)Tframe_us) return;
   
-  if (numNeighborsInPacket > MAX_NEIGHBOURS_IN_PACKET) {
-    numNeighborsInPacket = MAX_NEIGHBOURS_IN_PACKET;
-  }
+  int64_t residualPpb = (int64_t)clockStepSumUs * 1000000000LL / elapsedUs;
+  clockFreqPpb = constrain(clockFreqPpb + (int32_t)(residualPpb >> CLOCK_FREQ_GAIN_SHIFT),
+                           -CLOCK_FREQ_MAX_PPB, CLOCK_FREQ_MAX_PPB);
+  clockAnchorUs = now;
+  clockStepSumUs = 0;
   
   #ifdef VERBOSE
-    Serial.printf("[Node %d] [RX_PKT] from ID:%d slot:%d hop:%d cycle:%d nbr:%d RSSI:%d SNR:%d\n",
-                  myInfo.id, senderId, senderSlot, senderHop, senderCycle, numNeighborsInPacket, rxRssi, rxSnr);
+    Serial.printf("[Node %d] [CLOCK] Residual %lld ppb over %lld us, offset now %ld ppb\n",
+                  myInfo.id, residualPpb, elapsedUs, clockFreqPpb);
   #endif
+}
+
+// Grid restarted: the next resync is a jump. The rate belongs to crystal and network, it stays.
+void clockRestart() {
+  clockAnchorUs = 0;
+  clockStepSumUs = 0;
+  clockDriftNano = 0;
+  clockSyncFrame = tdmaFrame;
+}
+
+// ============= FRAME GEOMETRY =============
+// The gateway's SET_FRAME bumps the geometry version and announces it with a countdown in
+// frames (no-data beacons, bytes 36-42). Every node relays the countdown it was given, so the
+// whole network switches at the start of the same frame.
+
+// Frames left until the pending geometry takes over, as carried in the beacon
+uint8_t frameGeometryCountdown() {
+  int32_t left = (int32_t)(geometrySwitchFrame - tdmaFrame);
+  return (uint8_t)constrain(left, 1, 255);
+}
+
+void frameGeometrySchedule(const FrameGeometry& g, uint32_t switchFrame) {
+  pendingGeometry = g;
+  geometrySwitchFrame = switchFrame;
+  geometryPending = true;
   
-  // RSSI FILTER: Ignore packets with RSSI below threshold
-  // Debug: Always log RSSI check for troubleshooting
-  Serial.printf("[Node %d] [RSSI_CHECK] From:%d RSSI:%d Threshold:%d %s\n",
-                myInfo.id, senderId, rxRssi, rssiThresholdDbm,
-                (rxRssi < rssiThresholdDbm) ? "→ REJECT" : "→ ACCEPT");
+  Serial.printf("[Node %d] [FRAME] Geometry v%d pending: %d slots x %u ms, processing %u ms, in %d frames\n",
+                myInfo.id, g.seq, g.nslot, g.tslotMs, g.tprocessingMs, frameGeometryCountdown());
+  #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
+    char detail[80];
+    snprintf(detail, sizeof(detail), "Seq=%d,Nslot=%d,SlotMs=%u,ProcMs=%u,InFrames=%d",
+             g.seq, g.nslot, g.tslotMs, g.tprocessingMs, frameGeometryCountdown());
+    sendWifiEvent("FRAME_PENDING", detail);
+  #endif
+}
+
+// Gateway, SET_FRAME: nullptr if the new geometry was announced, else the reason
+const char* frameGeometryRequest(uint8_t nslot, uint16_t tslotMs, uint16_t tprocessingMs) {
+  if (geometryPending) return "a switch is already pending";
+  
+  FrameGeometry g;
+  g.seq = frameGeometry.seq + 1;
+  g.nslot = nslot;
+  g.tslotMs = tslotMs;
+  g.tprocessingMs = tprocessingMs;
+  const char* error = frameGeometryCheck(g);
+  if (error) return error;
+  
+  frameGeometrySchedule(g, tdmaFrame + FRAME_SWITCH_COUNTDOWN);
+  return nullptr;
+}
+
+// Geometry fields of a no-data beacon. Returns false when the sender runs on another
+// geometry: its slot timing says nothing about ours then.
+bool frameGeometryFromBeacon(uint8_t senderHop) {
+  FrameGeometry g;
+  g.seq = rxBuffer[36];
+  uint8_t countdown = rxBuffer[37];
+  g.nslot = rxBuffer[38];
+  g.tslotMs = (rxBuffer[39] << 8) | rxBuffer[40];
+  g.tprocessingMs = (rxBuffer[41] << 8) | rxBuffer[42];
+  
+  if (g.nslot == 0) return true;  // No geometry fields (older firmware)
+  
+  // While counting down the sender still runs on the version before the announced one
+  uint8_t senderSeq = countdown > 0 ? (uint8_t)(g.seq - 1) : g.seq;
+  
+  // Newer versions are only taken from the gateway's side of the tree, so a node
+  // further out with a stale or foreign geometry cannot pull the network over
+  if (!geometryPending && senderHop < myInfo.hoppingDistance && (int8_t)(g.seq - frameGeometry.seq) > 0) {
+    const char* error = frameGeometryCheck(g);
+    if (error) {
+      Serial.printf("[Node %d] [FRAME] Geometry v%d rejected: %s\n", myInfo.id, g.seq, error);
+    } else {
+      // Countdown 0: the switch already happened without us, follow on the next frame
+      frameGeometrySchedule(g, tdmaFrame + (countdown > 0 ? countdown : 1));
+    }
+  }
   
-  if (rxRssi < rssiThresholdDbm) {
-    #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
-      // Quick non-blocking event (pre-formatted to minimize processing)
-      char rssiEvent[96];
-      snprintf(rssiEvent, sizeof(rssiEvent), 
-              "From:N%d,RSSI:%ddBm,Threshold:%ddBm,Status:REJECTED",
-              senderId, rxRssi, rssiThresholdDbm);
-      sendWifiEvent("RSSI_LOW", rssiEvent);  // Non-blocking queue
-    #endif
-    
-    #ifdef VERBOSE
-      Serial.printf("[Node %d] [RX_REJECT] RSSI too low from Node %d: %d < %d dBm\n",
-                    myInfo.id, senderId, rxRssi, rssiThresholdDbm);
+  return senderSeq == frameGeometry.seq;
+}
+
+// Start of a frame: the pending geometry takes over. The grid is rebased so that this
+// frame still starts where the old geometry put it.
+void frameGeometrySwitch() {
+  int64_t startUs = frameStartUs();
+  frameGeometry = pendingGeometry;
+  geometryPending = false;
+  frameGeometryApply(frameGeometry);
+  frameGeometrySave(frameGeometry);
+  tdmaEpochUs = startUs - (int64_t)tdmaFrame * Tframe_us;
+  
+  // Slot numbers past the new end are gone, and the new last one is the contention slot
+  if (myInfo.slotIndex >= Nslot || myInfo.slotIndex == contentionSlot()) {
+    #if FIX_SLOT == 1
+      myInfo.slotIndex = SLOT_DEVICE % Nslot;
+    #else
+      slotMapBuild();
+      myInfo.slotIndex = slotPickFree(random(0, slotOwnableCount()));
+      contentionRequest(CONTENTION_CLAIM);
     #endif
-    
-    return 255;  // Return invalid slot, ignore this packet completely
+  }
+  extraSlotCount = 0;
+  resetNoiseStats();
+  
+  Serial.printf("[Node %d] [FRAME] Switched to geometry v%d: %d slots x %lu us, processing %lu us, frame %lu us, my slot %d\n",
+                myInfo.id, frameGeometry.seq, Nslot, Tslot_us, Tprocessing_us, Tframe_us, myInfo.slotIndex);
+  #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
+    char detail[80];
+    snprintf(detail, sizeof(detail), "Seq=%d,Nslot=%d,SlotMs=%u,ProcMs=%u,Slot=%d",
+             frameGeometry.seq, Nslot, frameGeometry.tslotMs, frameGeometry.tprocessingMs, myInfo.slotIndex);
+    sendWifiEvent("FRAME_SWITCH", detail);
+  #endif
+}
+
+// ============= SLOT SELECTION =============
+
+bool nbrOwnsSlot(const NeighbourInfo& nbr, uint8_t slot) {
+  return nbr.slotIndex == slot || ((nbr.extraSlots | nbr.extraSlotsPrev) >> slot) & 1;
+}
+
+bool isMySlot(int slot) {
+  if (slot == myInfo.slotIndex) return true;
+  for (uint8_t e = 0; e < extraSlotCount; e++) {
+    if (extraSlots[e] == slot) return true;
+  }
+  return false;
+}
+
+// Rebuild slotAvailability[] from the neighbour table: the neighbours' own slots, the
+// slots they list for their neighbours and the occupancy they advertise (which includes
+// my slots, they hear me)
+void slotMapBuild() {
+  for (uint8_t s = 0; s < NSLOT_MAX; s++) {
+    slotAvailability[s] = (s < Nslot) && (s != contentionSlot());
   }
   
-  // UPDATE/ADD SENDER TO NEIGHBOR LIST
-  bool foundSender = false;
   for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
-    if (neighbours[i].id == senderId) {
-      selectedNeighbourIdx = i;
-      foundSender = true;
-      break;
+    const NeighbourInfo& nbr = neighbours[i];
+    if (nbr.id == 0) continue;
+    for (uint8_t s = 0; s < Nslot; s++) {
+      if (nbrOwnsSlot(nbr, s) || ((nbr.occupiedSlots >> s) & 1)) slotAvailability[s] = false;
+    }
+    for (uint8_t k = 0; k < nbr.numberOfNeighbours; k++) {
+      if (nbr.neighboursId[k] == myInfo.id || nbr.neighboursSlot[k] >= Nslot) continue;
+      slotAvailability[nbr.neighboursSlot[k]] = false;
     }
   }
-  
-  bool isNewNeighbor = false;
-  if (!foundSender) {
-    for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
-      if (neighbours[i].id == 0) {
-        selectedNeighbourIdx = i;
-        foundSender = true;
-        neighbourCount++;
-        isNewNeighbor = true;
-        break;
-      }
+}
+
+// ID of another node seen on `slot` (one hop, or two hops as a neighbour's listed
+// neighbour), 0 if none
+uint16_t slotRival(uint8_t slot) {
+  for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
+    const NeighbourInfo& nbr = neighbours[i];
+    if (nbr.id == 0) continue;
+    if (nbrOwnsSlot(nbr, slot)) return nbr.id;
+    for (uint8_t k = 0; k < nbr.numberOfNeighbours; k++) {
+      if (nbr.neighboursId[k] != myInfo.id && nbr.neighboursSlot[k] == slot) return nbr.neighboursId[k];
     }
   }
-  
-  if (foundSender) {
-    neighbours[selectedNeighbourIdx].id = senderId;
-    neighbours[selectedNeighbourIdx].slotIndex = senderSlot;
-    neighbours[selectedNeighbourIdx].hoppingDistance = senderHop;
-    neighbours[selectedNeighbourIdx].isLocalized = senderLocalized;
-    
-    // Update cycle and track sequence
-    uint8_t prevCycle = neighbours[selectedNeighbourIdx].syncedCycle;
-    neighbours[selectedNeighbourIdx].syncedCycle = senderCycle;
-    
-    // Add to cycle history buffer (3 cycles for faster sync validation)
-    neighbours[selectedNeighbourIdx].cycleHistory[neighbours[selectedNeighbourIdx].cycleHistoryIdx] = senderCycle;
-    neighbours[selectedNeighbourIdx].cycleHistoryIdx = (neighbours[selectedNeighbourIdx].cycleHistoryIdx + 1) % 3;
-    
-    // Validate if cycles are sequential (allowing wrap-around)
-    bool sequential = true;
-    uint8_t validCount = 0;
-    for (uint8_t k = 0; k < 3; k++) {
-      if (neighbours[selectedNeighbourIdx].cycleHistory[k] != 255) validCount++;
+  return 0;
+}
+
+// The conflict's rival is in the neighbour table (or listed by a neighbour) on a slot other
+// than mine: it moved away
+bool slotRivalHeardElsewhere() {
+  for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
+    const NeighbourInfo& nbr = neighbours[i];
+    if (nbr.id == 0) continue;
+    // Its own entry only counts when fresh: a rival that moved into my slot keeps its old one
+    if (nbr.id == slotRivalId) {
+      if (nbr.activityCounter <= 1) return !nbrOwnsSlot(nbr, myInfo.slotIndex);
+      continue;
     }
-    
-    if (validCount >= 3) {  // Need all 3 cycles to validate sequence
-      // Check consecutive pattern
-      for (uint8_t k = 0; k < 2; k++) {
-        uint8_t curr = neighbours[selectedNeighbourIdx].cycleHistory[k];
-        uint8_t next = neighbours[selectedNeighbourIdx].cycleHistory[k + 1];
-        if (curr != 255 && next != 255) {
-          // Check if next is consecutive (with wrap-around at AUTO_SEND_INTERVAL_CYCLES)
-          uint8_t expected = (curr + 1) % AUTO_SEND_INTERVAL_CYCLES;
-          if (next != expected) {
-            sequential = false;
-            break;
-          }
-        }
-      }
-    } else {
-      sequential = false;  // Not enough data
+    for (uint8_t k = 0; k < nbr.numberOfNeighbours; k++) {
+      if (nbr.neighboursId[k] == slotRivalId) return nbr.neighboursSlot[k] != myInfo.slotIndex;
     }
-    
-    neighbours[selectedNeighbourIdx].cyclesSequential = sequential;
-    
-    // Track neighbor's stratum for sync decisions
-    neighbours[selectedNeighbourIdx].syncStratum = senderStratum;
-    
-    neighbours[selectedNeighbourIdx].rssi = rxRssi;
-    neighbours[selectedNeighbourIdx].snr = rxSnr;
-    neighbours[selectedNeighbourIdx].activityCounter = 0;
-    
-    
-    #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
-      if (isNewNeighbor) {
-        char eventDetails[96];
-        snprintf(eventDetails, sizeof(eventDetails), 
-                "NodeID:%d,RSSI:%ddBm,Slot:%d,Hop:%d",
-                senderId, rxRssi, senderSlot, senderHop);
-        sendWifiEvent("NEIGHBOR_ADDED", eventDetails);
-      }
-    #endif
-    
-    #if ENABLE_SYNC_LOG == 1
-      // Log neighbor discovery/update
-      char syncDetail[64];
-      snprintf(syncDetail, sizeof(syncDetail), "NBR_UPD:Slot=%d,Hop=%d,Cycle=%d,RSSI=%d", 
-               senderSlot, senderHop, senderCycle, rxRssi);
-      logSyncEvent("RX_NEIGHBOR", senderId, syncDetail);
-    #endif
-    
-    // PARSE SENDER'S NEIGHBORS
-    neighbours[selectedNeighbourIdx].numberOfNeighbours = numNeighborsInPacket;
+  }
+  return false;
+}
+
+// Frames a neighbour that moved may go unheard before it counts as silent (SLOT_MOVE_SILENT_CYCLES)
+uint8_t slotMoveSilentLimit() {
+  uint8_t limit = SLOT_MOVE_SILENT_CYCLES;
+  #if ADR_ENABLE == 1
+    limit = max(limit, (uint8_t)ADR_BASE_INTERVAL_CYCLES);
+  #endif
+  #if CH_HOP_ENABLE == 1
+    limit = max(limit, (uint8_t)CH_HOP_BASE_INTERVAL_CYCLES);
+  #endif
+  return limit;
+}
+
+// I took a new slot: remember who I heard up to now, watch them until a silence would show
+void slotMoveWatchStart() {
+  slotMoveHeard = 0;
+  for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
+    if (neighbours[i].id != 0 && neighbours[i].activityCounter <= 1) slotMoveHeard |= 1UL << i;
+  }
+  slotMoveWatch = slotMoveSilentLimit() + 2;
+}
+
+// A neighbour heard up to my move and silent since: it probably took the same slot in the
+// same frame, 0 if none
+uint16_t slotMoveRival() {
+  if (slotMoveWatch == 0) return 0;
+  slotMoveWatch--;
+  for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
+    if ((slotMoveHeard & (1UL << i)) && neighbours[i].id != 0 &&
+        neighbours[i].activityCounter > slotMoveSilentLimit()) {
+      slotMoveWatch = 0;
+      return neighbours[i].id;
+    }
+  }
+  return 0;
+}
+
+// My one-hop slot occupancy as advertised in the beacon: my slots and my neighbours'
+uint32_t slotOccupancy() {
+  uint32_t busy = 0;
+  if (slotSelected) {
+    busy |= 1UL << myInfo.slotIndex;
+    for (uint8_t e = 0; e < extraSlotCount; e++) busy |= 1UL << extraSlots[e];
+  }
+  for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
+    if (neighbours[i].id == 0) continue;
+    if (neighbours[i].slotIndex < Nslot) busy |= 1UL << neighbours[i].slotIndex;
+    busy |= neighbours[i].extraSlots | neighbours[i].extraSlotsPrev;
+  }
+  return busy;
+}
+
+// Slot of my next hop (SLOT_CONVERGECAST), 0xFF for the gateway or without a route
+uint8_t slotParentSlot() {
+  #if SLOT_CONVERGECAST == 1
+    if (myInfo.hoppingDistance == 0 || myInfo.hoppingDistance == 0x7F) return 0xFF;
+    uint16_t parent = selectBestNextHop(false);
+    if (parent == 0) return 0xFF;
+    for (uint8_t i = 0; i < neighbourCount; i++) {
+      const NeighbourInfo& nbr = neighbours[neighbourIndices[i]];
+      if (nbr.id == parent) return (nbr.slotIndex < Nslot) ? nbr.slotIndex : 0xFF;
+    }
+  #endif
+  return 0xFF;
+}
+
+// Free slot that is not mine already, `fallback` if none is. With a next hop to feed
+// (SLOT_CONVERGECAST) the one closest before its slot, otherwise a random one.
+uint8_t slotPickFree(uint8_t fallback) {
+  uint8_t parentSlot = slotParentSlot();
+  if (parentSlot != 0xFF) {
+    for (uint8_t d = 1; d < Nslot; d++) {
+      uint8_t s = modulo(parentSlot - d, Nslot);
+      if (slotAvailability[s] && !isMySlot(s)) return s;
+    }
+    return fallback;
+  }
+  
+  uint8_t freeCount = 0;
+  for (uint8_t s = 0; s < Nslot; s++) {
+    if (slotAvailability[s] && !isMySlot(s)) freeCount++;
+  }
+  if (freeCount == 0) return fallback;
+  
+  uint8_t pick = random(0, freeCount);
+  for (uint8_t s = 0; s < Nslot; s++) {
+    if (slotAvailability[s] && !isMySlot(s) && pick-- == 0) return s;
+  }
+  return fallback;
+}
+
+// Processing phase, after the neighbour table is refreshed (FIX_SLOT 0)
+void slotSelectUpdate() {
+  slotMapBuild();
+  
+  if (!slotSelected) {
+    if (++slotListenCycles < SLOT_SELECT_LISTEN_CYCLES) return;
+    myInfo.slotIndex = slotPickFree(random(0, slotOwnableCount()));
+    slotSelected = true;
+    Serial.printf("[Node %d] [SLOT] Picked slot %d after %d silent frames\n",
+                  myInfo.id, myInfo.slotIndex, slotListenCycles);
+    slotOrderHold = SLOT_SELECT_LISTEN_CYCLES;
+    slotMoveWatchStart();
+    contentionRequest(CONTENTION_CLAIM);
+    return;
+  }
+  
+  slotExtraUpdate();
+  
+  uint16_t rival = slotRival(myInfo.slotIndex);
+  if (rival == 0 && slotBackoff == 0) rival = slotMoveRival();
+  if (rival == 0 && slotBackoff > 0 && myInfo.id > slotRivalId && !slotRivalHeardElsewhere()) {
+    // The rival keeps the slot. Sending in it myself I cannot hear it there, so its entry
+    // ages out: that is not the rival leaving. Only seeing it on another slot clears this.
+    rival = slotRivalId;
+  }
+  if (rival == 0) {
+    if (slotBackoff == 0) {
+      slotReorder();
+      return;
+    }
+    // One lost beacon hides the rival for a frame: the conflict only clears once it stayed
+    // away SLOT_CONFLICT_CLEAR_CYCLES frames in a row, the back-off waits meanwhile
+    if (++slotRivalGone < SLOT_CONFLICT_CLEAR_CYCLES) return;
+    Serial.printf("[Node %d] [SLOT] Conflict on slot %d cleared\n", myInfo.id, myInfo.slotIndex);
+    slotBackoff = 0;
+    slotRivalGone = 0;
+    return;
+  }
+  slotRivalGone = 0;
+  
+  if (slotBackoff == 0) {
+    // Lower ID keeps the slot: it only moves once the higher one's longest back-off is over
+    // and the conflict is still there (the rival may not see it)
+    slotBackoff = random(SLOT_BACKOFF_MIN_CYCLES, SLOT_BACKOFF_MAX_CYCLES + 1);
+    slotRivalId = rival;
+    if (myInfo.id < rival) slotBackoff += SLOT_BACKOFF_MAX_CYCLES;
+    Serial.printf("[Node %d] [SLOT] Conflict on slot %d with node %d, backing off %d frames\n",
+                  myInfo.id, myInfo.slotIndex, rival, slotBackoff);
+    #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
+      char detail[64];
+      snprintf(detail, sizeof(detail), "Slot=%d,With=%d,Backoff=%d", myInfo.slotIndex, rival, slotBackoff);
+      sendWifiEvent("SLOT_CONFLICT", detail);
+    #endif
+    return;
+  }
+  
+  if (--slotBackoff > 0) return;
+  
+  uint8_t oldSlot = myInfo.slotIndex;
+  myInfo.slotIndex = slotPickFree(oldSlot);
+  if (myInfo.slotIndex == oldSlot) {
+    Serial.printf("[Node %d] [SLOT] No free slot, staying on %d\n", myInfo.id, oldSlot);
+    return;
+  }
+  slotMoves++;
+  slotOrderHold = SLOT_SELECT_LISTEN_CYCLES;
+  slotMoveWatchStart();
+  contentionRequest(CONTENTION_CLAIM);
+  Serial.printf("[Node %d] [SLOT] Moved %d -> %d (node %d kept %d)\n",
+                myInfo.id, oldSlot, myInfo.slotIndex, rival, oldSlot);
+  #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
+    char detail[64];
+    snprintf(detail, sizeof(detail), "From=%d,To=%d,Rival=%d", oldSlot, myInfo.slotIndex, rival);
+    sendWifiEvent("SLOT_CHANGE", detail);
+  #endif
+}
+
+// Conflict-free slot, convergecast ordering: move up to a free slot closer before my next
+// hop's slot if the route or its slot changed. Every move shortens the distance, so the
+// order settles from the gateway down. A flapping route or parent slot is not followed:
+// both must hold SLOT_REORDER_STABLE_CYCLES frames, and moves are SLOT_REORDER_HOLD_CYCLES
+// or more apart. The waits are random, so siblings that saw the same change do not all
+// jump into the same free slot in the same frame.
+void slotReorder() {
+  uint8_t parentSlot = slotParentSlot();
+  uint16_t parent = (parentSlot == 0xFF) ? 0 : selectBestNextHop(false);
+  if (parent != slotOrderParent || parentSlot != slotOrderParentSlot) {
+    slotOrderParent = parent;
+    slotOrderParentSlot = parentSlot;
+    slotOrderStable = 0;
+    slotOrderHold = max(slotOrderHold, (uint8_t)random(0, SLOT_REORDER_HOLD_CYCLES + 1));
+  } else if (slotOrderStable < SLOT_REORDER_STABLE_CYCLES) {
+    slotOrderStable++;
+  }
+  
+  if (slotOrderHold > 0) {
+    slotOrderHold--;
+    return;
+  }
+  if (parentSlot == 0xFF || slotOrderStable < SLOT_REORDER_STABLE_CYCLES) return;
+  
+  uint8_t oldSlot = myInfo.slotIndex;
+  uint8_t newSlot = slotPickFree(oldSlot);
+  if (newSlot == oldSlot || modulo(parentSlot - newSlot, Nslot) >= modulo(parentSlot - oldSlot, Nslot)) {
+    return;
+  }
+  
+  myInfo.slotIndex = newSlot;
+  slotMoves++;
+  slotOrderHold = random(SLOT_REORDER_HOLD_CYCLES, 2 * SLOT_REORDER_HOLD_CYCLES + 1);
+  slotMoveWatchStart();
+  contentionRequest(CONTENTION_CLAIM);
+  Serial.printf("[Node %d] [SLOT] Re-ordered %d -> %d (next hop on slot %d)\n",
+                myInfo.id, oldSlot, newSlot, parentSlot);
+  #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
+    char detail[64];
+    snprintf(detail, sizeof(detail), "From=%d,To=%d,Parent=%d", oldSlot, newSlot, parentSlot);
+    sendWifiEvent("SLOT_REORDER", detail);
+  #endif
+}
+
+// Extra slots needed for the forwarding backlog
+uint8_t slotExtraWanted() {
+  if (myInfo.hoppingDistance == 0 || myInfo.hoppingDistance == 0x7F) return 0;
+  return min((uint8_t)SLOT_EXTRA_MAX, (uint8_t)(forwardQueueCount / SLOT_EXTRA_QUEUE_STEP));
+}
+
+void slotExtraRelease(uint8_t e) {
+  extraSlots[e] = extraSlots[--extraSlotCount];
+}
+
+// Drop conflicting extra slots, give back the surplus, take one more if the backlog asks for it
+void slotExtraUpdate() {
+  for (uint8_t e = 0; e < extraSlotCount; ) {
+    uint16_t rival = slotRival(extraSlots[e]);
+    if (rival == 0) {
+      e++;
+      continue;
+    }
+    Serial.printf("[Node %d] [SLOT] Extra slot %d taken by node %d, dropped\n", myInfo.id, extraSlots[e], rival);
+    slotExtraRelease(e);
+    extraSlotBackoff = random(SLOT_BACKOFF_MIN_CYCLES, SLOT_BACKOFF_MAX_CYCLES + 1);
+  }
+  
+  if (extraSlotBackoff > 0) extraSlotBackoff--;
+  uint8_t wanted = slotExtraWanted();
+  
+  if (extraSlotCount > wanted) {
+    Serial.printf("[Node %d] [SLOT] Extra slot %d given back (queue %d)\n",
+                  myInfo.id, extraSlots[extraSlotCount - 1], forwardQueueCount);
+    extraSlotCount--;
+  } else if (extraSlotCount < wanted && extraSlotBackoff == 0) {
+    uint8_t slot = slotPickFree(0xFF);
+    if (slot == 0xFF) return;
+    extraSlots[extraSlotCount++] = slot;
+    Serial.printf("[Node %d] [SLOT] Extra slot %d taken (queue %d, %d extra)\n",
+                  myInfo.id, slot, forwardQueueCount, extraSlotCount);
+    #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
+      char detail[64];
+      snprintf(detail, sizeof(detail), "Slot=%d,Queue=%d,Extra=%d", slot, forwardQueueCount, extraSlotCount);
+      sendWifiEvent("SLOT_EXTRA", detail);
+    #endif
+  }
+}
+
+// My TX slots this frame in slot order, returns how many
+uint8_t mySlotsInOrder(uint8_t* slots) {
+  if (!slotSelected) return 0;
+  uint8_t count = 0;
+  slots[count++] = myInfo.slotIndex;
+  for (uint8_t e = 0; e < extraSlotCount; e++) {
+    if (extraSlots[e] < Nslot) slots[count++] = extraSlots[e];
+  }
+  for (uint8_t i = 1; i < count; i++) {
+    for (uint8_t j = i; j > 0 && slots[j - 1] > slots[j]; j--) {
+      uint8_t t = slots[j];
+      slots[j] = slots[j - 1];
+      slots[j - 1] = t;
+    }
+  }
+  return count;
+}
+
+// Neighbour table cleared (TDMA_OFF): listen again before the next pick
+void slotSelectRestart() {
+  #if FIX_SLOT == 0
+    slotSelected = false;
+    slotListenCycles = 0;
+    slotBackoff = 0;
+    slotRivalGone = 0;
+    slotMoveWatch = 0;
+    slotOrderHold = 0;
+    slotOrderStable = 0;
+  #endif
+  extraSlotCount = 0;
+  extraSlotBackoff = 0;
+}
+
+// STATUS: M = my slot, + = my extra slot, ! = mine but another node seen on it,
+// x = taken, . = free, c = contention slot
+void printSlotMap() {
+  char map[NSLOT_MAX + 1];
+  slotMapBuild();
+  for (uint8_t s = 0; s < Nslot; s++) {
+    if (isMySlot(s) && slotSelected) {
+      map[s] = slotRival(s) ? '!' : (s == myInfo.slotIndex ? 'M' : '+');
+    } else if (s == contentionSlot()) {
+      map[s] = 'c';
+    } else {
+      map[s] = slotAvailability[s] ? '.' : 'x';
+    }
+  }
+  map[Nslot] = '\0';
+  Serial.printf("{NODE%d} [STATUS] Slots (2-hop): %s%s moves:%lu\n", myInfo.id, map,
+                slotSelected ? "" : " (listening)", slotMoves);
+}
+
+// The driver latches BUSY timeouts, SPI errors and illegal mode transitions instead of hanging.
+// Re-initialise the radio right away so the node keeps its slot in the current frame.
+bool recoverRadioIfFaulted() {
+  int16_t error = radio.GetError();
+  if (error == ERR_NONE) return false;
+  
+  int16_t result = radio.Recover();
+  SX126xFaultStats faults;
+  radio.GetFaultStats(&faults);
+  Serial.printf("[Node %d] [RADIO] Fault %d, recovery %s in %lu us (recoveries:%lu failures:%lu)\n",
+                myInfo.id, error, (result == ERR_NONE) ? "OK" : "FAILED", faults.lastRecoveryUs,
+                faults.recoveries, faults.failures);
+  return true;
+}
+
+// ============= FAST JOIN (FAST_JOIN_ENABLE) =============
+
+// Boot, TDMA_ON: the join clock starts over
+void joinRestart() {
+  joinStartUs = esp_timer_get_time();
+  joinFrames = 0;
+}
+
+// Still joining: skip my TX slots so RX covers the whole frame. Without a validated cycle
+// my grid and slot are not the network's yet, a frame in an owned slot could land on its
+// owner; I announce myself in the contention slot instead (contentionAddSlot). Without a
+// contention slot the owned slot is the only way to be heard: joinBeaconFrame.
+bool joinListening() {
+  #if IS_REFERENCE == 0 && FAST_JOIN_ENABLE == 1
+    return !cycleValidated && !joinBeaconFrame;
+  #else
+    return false;
+  #endif
+}
+
+// Network cycle validated: record and export the join latency
+void joinComplete(bool fast) {
+  cycleValidated = true;
+  joinLatencyMs = (uint32_t)((esp_timer_get_time() - joinStartUs) / 1000);
+  joinLatencyFrames = joinFrames;
+  joinWasFast = fast;
+  Serial.printf("[Node %d] [JOIN] Joined in %lu ms (%u frames, %s)\n",
+                myInfo.id, joinLatencyMs, joinLatencyFrames, fast ? "fast" : "sequential");
+  // No slot to be heard in yet: announce myself in the contention slot
+  if (!slotSelected) {
+    contentionRequest(CONTENTION_JOIN);
+  }
+  #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
+    char detail[64];
+    snprintf(detail, sizeof(detail), "LatencyMs=%lu,Frames=%u,Mode=%s",
+             joinLatencyMs, joinLatencyFrames, fast ? "FAST" : "SEQ");
+    sendWifiEvent("JOIN", detail);
+  #endif
+}
+
+// Heard recently enough to route through; a silent parent is left before it times out
+bool nbrRoutable(const NeighbourInfo& nbr) {
+  #if FAST_JOIN_ENABLE == 1
+    return nbr.activityCounter < FAST_JOIN_PARENT_MISS_CYCLES;
+  #else
+    return true;
+  #endif
+}
+
+// ============= CONTENTION SLOT (CONTENTION_SLOT_ENABLE) =============
+
+// The shared last slot, 0xFF without one
+uint8_t contentionSlot() {
+  #if CONTENTION_SLOT_ENABLE == 1
+    if (Nslot >= 2) return Nslot - 1;
+  #endif
+  return 0xFF;
+}
+
+// Slots a node can own: 0 .. slotOwnableCount()-1
+uint8_t slotOwnableCount() {
+  return (contentionSlot() == 0xFF) ? Nslot : Nslot - 1;
+}
+
+// Queue something for the contention slot (the gateway has nothing to announce)
+void contentionRequest(uint8_t what) {
+  #if CONTENTION_SLOT_ENABLE == 1 && IS_REFERENCE == 0
+    contentionPending |= what;
+  #endif
+}
+
+// Something worth a contention frame: a join or claim, or an alarm with a route for it
+bool contentionReady() {
+  if (contentionPending & (CONTENTION_JOIN | CONTENTION_CLAIM)) return true;
+  return (contentionPending & CONTENTION_ALARM) &&
+         myInfo.hoppingDistance != 0x7F && myInfo.hoppingDistance != 0;
+}
+
+// Add the contention slot to this frame's TX slots (it is the last slot, so the order
+// holds) when something waits for it; needs the gateway's slot grid (validated cycle, or a
+// synced parent while joining) and no back-off
+uint8_t contentionAddSlot(uint8_t* slots, uint8_t count) {
+  uint8_t cs = contentionSlot();
+  if (cs == 0xFF || !contentionReady()) return count;
+  if (!cycleValidated && myInfo.syncStratum >= STRATUM_LOCAL) return count;
+  if (count > 0 && slots[count - 1] == cs) return count;  // FIX_SLOT set to it, see settings
+  if (contentionBackoff > 0) {
+    contentionBackoff--;
+    return count;
+  }
+  slots[count++] = cs;
+  return count;
+}
+
+// Contention slot: random minislot, CAD just before it, send only on a clear channel.
+// Returns after the frame (or the busy CAD), the next RX phase hears the rest of the slot.
+void contendInSlot(uint8_t slot) {
+  #if ADR_ENABLE == 1
+    adrApplyProfile(0);
+  #endif
+  #if CH_HOP_ENABLE == 1
+    chHopApplyChannel(0);
+  #endif
+  
+  if (!txFrameReady) {
+    prepareUnifiedPacket(slot);
+  }
+  
+  // Only minislots whose frame still ends before the slot does
+  uint32_t usable = slotOffset_us / CONTENTION_MINISLOT_US;
+  uint8_t minislots = (uint8_t)constrain(usable, 1UL, (uint32_t)CONTENTION_MINISLOTS);
+  uint8_t k = random(0, minislots);
+  waitUntil(slotStartUs(slot) + TtxDelay_us + (int64_t)k * CONTENTION_MINISLOT_US);
+  
+  if (radio.ScanChannel()) {
+    // An earlier contender is on air: back off, my next slot needs its own frame
+    txFrameReady = false;
+    contentionBusy++;
+    if (contentionExp < CONTENTION_BACKOFF_MAX_EXP) contentionExp++;
+    contentionBackoff = random(1, (1 << contentionExp) + 1);
+    Serial.printf("[Node %d] [CONTENTION] Busy at minislot %d, backing off %d frames\n",
+                  myInfo.id, k, contentionBackoff);
+    return;
+  }
+  
+  transmitUnifiedPacket();
+  long toSlotEnd = usUntil(slotStartUs(slot + 1));
+  radio.FinishTx(toSlotEnd > 0 ? toSlotEnd / 1000 : 0);
+  recoverRadioIfFaulted();
+  
+  contentionPending &= ~contentionSending;
+  contentionExp = 0;
+  contentionSent++;
+  Serial.printf("[Node %d] [CONTENTION] Sent at minislot %d:%s%s%s\n", myInfo.id, k,
+                (contentionSending & CONTENTION_JOIN) ? " join" : "",
+                (contentionSending & CONTENTION_CLAIM) ? " claim" : "",
+                (contentionSending & CONTENTION_ALARM) ? " alarm" : "");
+}
+
+// ============= PER-SLOT SCHEDULE (ADR_ENABLE, CH_HOP_ENABLE) =============
+
+// Processing phase: step the network cycle number. Between frames from synced
+// neighbours it runs on locally. A frame from upstream realigns it, but only here, at the
+// next frame start (processRxPacket): the per-slot schedule of a frame never changes halfway.
+void advanceNetCycle() {
+  #if IS_REFERENCE == 1
+    netCycle = myInfo.syncedCycle;
+  #else
+    if (netCycleHeard >= 0) {
+      netCycle = (uint8_t)netCycleHeard;
+      if (netEpochHeard >= 0) netEpoch = (uint8_t)netEpochHeard;
+      netCycleHeard = -1;
+      netEpochHeard = -1;
+    }
+    netCycle = (netCycle + 1) % AUTO_SEND_INTERVAL_CYCLES;
+  #endif
+  if (netCycle == 0) netEpoch++;
+}
+
+// Network frame counter, 0 .. REPORT_FRAME_WRAP-1
+uint16_t netFrame() {
+  return (uint16_t)netEpoch * AUTO_SEND_INTERVAL_CYCLES + netCycle;
+}
+
+// Make r the live reporting schedule; a hashed phase is the golden-ratio hash of the ID
+// scaled to the period, which keeps any set of IDs spread over the period
+void reportScheduleApply(const ReportSchedule& r) {
+  reportSchedule = r;
+  if (r.phase == REPORT_PHASE_HASHED) {
+    uint32_t hash = (uint32_t)myInfo.id * 2654435769UL;
+    reportPhase = (uint16_t)(((uint64_t)hash * r.periodFrames) >> 32);
+  } else {
+    reportPhase = r.phase;
+  }
+}
+
+// My reading is due this frame
+bool reportDue() {
+  return netFrame() % reportSchedule.periodFrames == reportPhase;
+}
+
+// Neighbour whose slot this is, -1 if none. Neighbours sharing a slot take turns
+// by cycle, so the profile and channel used for a slot always belong to one owner.
+int slotOwner(int slot) {
+  if (slot < 0) return -1;
+  uint8_t owners = 0;
+  for (uint8_t i = 0; i < neighbourCount; i++) {
+    uint8_t idx = neighbourIndices[i];
+    if (neighbours[idx].id != 0 && nbrOwnsSlot(neighbours[idx], slot)) owners++;
+  }
+  if (owners == 0) return -1;
+  uint8_t pick = netCycle % owners;
+  for (uint8_t i = 0; i < neighbourCount; i++) {
+    uint8_t idx = neighbourIndices[i];
+    if (neighbours[idx].id != 0 && nbrOwnsSlot(neighbours[idx], slot)) {
+      if (pick == 0) return idx;
+      pick--;
+    }
+  }
+  return -1;
+}
+
+// ============= ADAPTIVE DATA RATE (ADR_ENABLE) =============
+
+// Fastest profile whose demodulator floor the link clears with ADR_SNR_MARGIN_DB to spare,
+// or the most robust one when none does
+uint8_t adrProfileForSnr(int8_t snrDb) {
+  uint8_t best = 0xFF;
+  uint8_t robust = 0;
+  for (uint8_t p = 0; p < ADR_PROFILE_COUNT; p++) {
+    if (adrProfiles[p].snrReqDb < adrProfiles[robust].snrReqDb) robust = p;
+    if (snrDb < adrProfiles[p].snrReqDb + ADR_SNR_MARGIN_DB) continue;
+    if (best == 0xFF || adrProfileToaUs(p) < adrProfileToaUs(best)) best = p;
+  }
+  return (best == 0xFF) ? robust : best;
+}
+
+void adrApplyProfile(uint8_t profile) {
+  radio.SetModulation(adrProfiles[profile].spreadingFactor, adrProfiles[profile].bandwidth, LORA_CODINGRATE);
+  adrRadioProfile = profile;
+}
+
+// Profile to listen with in a slot: its owner's announced profile, profile 0 if unknown
+uint8_t adrSlotProfile(int slot) {
+  if (!adrFastCycle) return 0;
+  int owner = slotOwner(slot);
+  return (owner < 0) ? 0 : neighbours[owner].adrTxProfile;
+}
+
+// A frame from neighbour idx: refresh the link SNR and take its announced TX profile
+void adrUpdateLink(uint8_t idx, uint8_t announcedProfile) {
+  // Normalise to BW125 so frames received on any profile are comparable
+  int8_t snr = rxSnr + adrProfiles[adrRadioProfile].bwOffsetDb;
+  NeighbourInfo* n = &neighbours[idx];
+  if (n->adrSnrValid) {
+    n->adrSnrDb = (int8_t)((3 * (int)n->adrSnrDb + snr) / 4);
+  } else {
+    n->adrSnrDb = snr;
+    n->adrSnrValid = true;
+  }
+  n->adrRxProfile = adrProfileForSnr(n->adrSnrDb);
+  n->adrTxProfileNext = (announcedProfile < ADR_PROFILE_COUNT) ? announcedProfile : 0;
+}
+
+// Processing phase: move to this cycle's profiles and pick the one to announce.
+// A broadcast slot has to reach every neighbour, so the TX profile is the most robust
+// of what the neighbours report (profile 0 for those that don't list me yet).
+void adrStartCycle() {
+  adrFastCycle = (myInfo.syncStratum < STRATUM_LOCAL) && (netCycle % ADR_BASE_INTERVAL_CYCLES != 0);
+  
+  adrTxProfile = adrTxProfileNext;
+  uint8_t next = 0xFF;
+  for (uint8_t i = 0; i < neighbourCount; i++) {
+    NeighbourInfo* n = &neighbours[neighbourIndices[i]];
+    n->adrTxProfile = n->adrTxProfileNext;
+    uint8_t reported = n->amIListedAsNeighbour ? n->adrReportedProfile : 0;
+    if (next == 0xFF || adrProfiles[reported].snrReqDb < adrProfiles[next].snrReqDb) next = reported;
+  }
+  if (next == 0xFF) next = 0;
+  
+  if (next != adrTxProfileNext) {
+    Serial.printf("[Node %d] [ADR] TX profile %d -> %d (SF%d, %lu us air time)\n",
+                  myInfo.id, adrTxProfileNext, next, adrProfiles[next].spreadingFactor, adrProfileToaUs(next));
+  }
+  adrTxProfileNext = next;
+}
+
+// ============= CHANNEL HOPPING (CH_HOP_ENABLE) =============
+
+// TSCH hopping function: channel of a slot from its absolute slot number and the
+// owner's channel offset. The ASN repeats with the network cycle counter.
+uint8_t chHopChannel(int slot, uint16_t ownerId) {
+  uint16_t asn = (uint16_t)netCycle * Nslot + slot;
+  return (asn + ownerId % CH_HOP_CHANNEL_COUNT) % CH_HOP_CHANNEL_COUNT;
+}
+
+void chHopApplyChannel(uint8_t channel) {
+  radio.SetChannel(chHopChannels[channel]);
+  chHopRadioChannel = channel;
+}
+
+// Channel to listen on in a slot: its owner's, the home channel if unknown
+uint8_t chHopSlotChannel(int slot) {
+  if (!chHopActive) return 0;
+  int owner = slotOwner(slot);
+  return (owner < 0) ? 0 : chHopChannel(slot, neighbours[owner].id);
+}
+
+// Processing phase: hop this cycle or stay home. Unsynced nodes never hop, they only
+// know the grid from what they hear on the home channel.
+void chHopStartCycle() {
+  chHopActive = (myInfo.syncStratum < STRATUM_LOCAL) && (netCycle % CH_HOP_BASE_INTERVAL_CYCLES != 0);
+}
+
+// ============= CHANNEL SAMPLING (NOISE_SAMPLING_ENABLE) =============
+
+void resetNoiseStats() {
+  for (uint8_t s = 0; s < Nslot; s++) {
+    memset(slotNoise[s].rssi, NOISE_RSSI_NONE, sizeof(slotNoise[s].rssi));
+    slotNoise[s].head = 0;
+    slotNoise[s].cycle = noiseCycle;
+  }
+  noiseTakenSlot = -1;
+  noiseTakenPoint = -1;
+}
+
+// Time into the slot in progress (and which slot) for the RX phase being listened to,
+// -1 once the phase is over
+long noiseSlotPosition(int* slot) {
+  long untilEnd = (long)(noisePhaseEndUs - micros());
+  if (untilEnd <= 0) return -1;
+  long slotsLeft = (untilEnd + (long)Tslot_us - 1) / (long)Tslot_us;
+  *slot = (int)noiseEndSlot - (int)slotsLeft;
+  return (long)Tslot_us - (untilEnd - (slotsLeft - 1) * (long)Tslot_us);
+}
+
+// How long responder() may wait before the next sample point is due
+uint32_t noiseNextSampleUs() {
+  if (!noiseWindowOpen) return 0xFFFFFFFF;
+  int slot;
+  long pos = noiseSlotPosition(&slot);
+  if (pos < 0) return 0xFFFFFFFF;
+  for (uint8_t p = 0; p < NOISE_POINTS; p++) {
+    if (pos < (long)noisePointUs[p]) return noisePointUs[p] - pos;
+  }
+  return (uint32_t)((long)Tslot_us - pos) + noisePointUs[0];
+}
+
+// Take the latest sample point passed in the slot in progress, if not taken yet
+void noiseSample() {
+  if (!noiseWindowOpen) return;
+  int slot;
+  long pos = noiseSlotPosition(&slot);
+  if (pos < 0 || slot < 0 || slot >= Nslot || isMySlot(slot)) return;
+  
+  int8_t point = -1;
+  for (uint8_t p = 0; p < NOISE_POINTS; p++) {
+    if (pos >= (long)noisePointUs[p]) point = p;
+  }
+  if (point < 0) return;
+  SlotNoiseStats* s = &slotNoise[slot];
+  if (s->cycle == noiseCycle && noiseTakenSlot == slot && noiseTakenPoint >= point) return;
+  
+  int16_t rssi = radio.SampleRssi();
+  if (rssi == SX126x_RSSI_INVALID) return;
+  
+  if (s->cycle != noiseCycle) {
+    s->head = (s->head + 1) % NOISE_HISTORY_CYCLES;
+    memset(s->rssi[s->head], NOISE_RSSI_NONE, NOISE_POINTS);
+    s->cycle = noiseCycle;
+  }
+  s->rssi[s->head][point] = (int8_t)constrain(rssi, -128, NOISE_RSSI_NONE - 1);
+  noiseTakenSlot = slot;
+  noiseTakenPoint = point;
+}
+
+// Mean idle-point RSSI of a slot over the history, NOISE_RSSI_NONE without samples
+int16_t noiseFloorDbm(int slot) {
+  int32_t sum = 0;
+  uint8_t n = 0;
+  for (uint8_t c = 0; c < NOISE_HISTORY_CYCLES; c++) {
+    int8_t v = slotNoise[slot].rssi[c][0];
+    if (v == NOISE_RSSI_NONE) continue;
+    sum += v;
+    n++;
+  }
+  return (n > 0) ? (int16_t)(sum / n) : NOISE_RSSI_NONE;
+}
+
+// Floor of the quietest slot: the receiver's own noise, interference only raises a slot
+int16_t noiseReferenceFloor() {
+  int16_t ref = NOISE_RSSI_NONE;
+  for (uint8_t s = 0; s < Nslot; s++) {
+    int16_t f = noiseFloorDbm(s);
+    if (f < ref) ref = f;
+  }
+  return ref;
+}
+
+// Share of a point's samples more than NOISE_BUSY_MARGIN_DB above refFloor, -1 without samples
+int noiseBusyPercent(uint8_t slot, uint8_t point, int16_t refFloor) {
+  uint8_t n = 0;
+  uint8_t busy = 0;
+  for (uint8_t c = 0; c < NOISE_HISTORY_CYCLES; c++) {
+    int8_t v = slotNoise[slot].rssi[c][point];
+    if (v == NOISE_RSSI_NONE) continue;
+    n++;
+    if (v > refFloor + NOISE_BUSY_MARGIN_DB) busy++;
+  }
+  return (n > 0) ? (100 * busy / n) : -1;
+}
+
+void printNoiseStats() {
+  int16_t ref = noiseReferenceFloor();
+  if (ref == NOISE_RSSI_NONE) {
+    Serial.printf("{NODE%d} [NOISE] No samples yet\n", myInfo.id);
+    return;
+  }
+  Serial.printf("{NODE%d} [NOISE] Floor:%d dBm (quietest slot), busy > %d dBm, RSSI min now %d dBm\n",
+                myInfo.id, ref, ref + NOISE_BUSY_MARGIN_DB, rssiThresholdDbm);
+  for (uint8_t s = 0; s < Nslot; s++) {
+    int16_t floor = noiseFloorDbm(s);
+    if (floor == NOISE_RSSI_NONE) continue;
+    Serial.printf("{NODE%d} [NOISE] slot:%d floor:%d dBm busy idle:%d%% pre:%d%% tail:%d%%\n",
+                  myInfo.id, s, floor, noiseBusyPercent(s, 0, ref), noiseBusyPercent(s, 1, ref),
+                  noiseBusyPercent(s, 2, ref));
+  }
+}
+
+void sendNoiseStatsWifi() {
+  int16_t ref = noiseReferenceFloor();
+  if (ref == NOISE_RSSI_NONE) return;
+  for (uint8_t s = 0; s < Nslot; s++) {
+    int16_t floor = noiseFloorDbm(s);
+    if (floor == NOISE_RSSI_NONE) continue;
+    char detail[96];
+    snprintf(detail, sizeof(detail), "Slot:%d,Floor:%d,Ref:%d,BusyIdle:%d,BusyPre:%d,BusyTail:%d",
+             s, floor, ref, noiseBusyPercent(s, 0, ref), noiseBusyPercent(s, 1, ref),
+             noiseBusyPercent(s, 2, ref));
+    sendWifiEvent("NOISE", detail);
+  }
+}
+
+uint8_t processRxPacket() {
+  uint8_t selectedNeighbourIdx = 0;
+  bool senderOnOurGeometry = true;
+  
+  // PARSE HEADER (12 bytes)
+  uint16_t senderId = (rxBuffer[3] << 8) | rxBuffer[4];
+  uint8_t senderSlot = rxBuffer[5] & 0x3F;
+  bool senderExtraSlot = (rxBuffer[5] >> 7) & 0x01;
+  uint8_t senderHop = rxBuffer[6] & 0x7F;
+  bool senderLocalized = (rxBuffer[6] >> 7) & 0x01;
+  uint8_t senderCycle = (rxBuffer[7] >> 3) & 0x1F;
+  uint8_t numNeighborsInPacket = rxBuffer[7] & 0x07;
+  uint8_t dataMode = rxBuffer[8];
+  uint16_t hopDecisionTarget = (rxBuffer[9] << 8) | rxBuffer[10];
+  
+  // Parse byte 11: Stratum (bits 7-6) + alarm (bit 1) + TimeSyncFlag (bit 0)
+  uint8_t senderStratum = (rxBuffer[11] >> 6) & 0x03;
+  bool isAlarm = rxBuffer[11] & 0x02;
+  
+  if (numNeighborsInPacket > MAX_NEIGHBOURS_IN_PACKET) {
+    numNeighborsInPacket = MAX_NEIGHBOURS_IN_PACKET;
+  }
+  
+  #ifdef VERBOSE
+    Serial.printf("[Node %d] [RX_PKT] from ID:%d slot:%d hop:%d cycle:%d nbr:%d RSSI:%d SNR:%d\n",
+                  myInfo.id, senderId, senderSlot, senderHop, senderCycle, numNeighborsInPacket, rxRssi, rxSnr);
+  #endif
+  
+  // RSSI FILTER: Ignore packets with RSSI below threshold
+  // Debug: Always log RSSI check for troubleshooting
+  Serial.printf("[Node %d] [RSSI_CHECK] From:%d RSSI:%d Threshold:%d %s\n",
+                myInfo.id, senderId, rxRssi, rssiThresholdDbm,
+                (rxRssi < rssiThresholdDbm) ? "→ REJECT" : "→ ACCEPT");
+  
+  if (rxRssi < rssiThresholdDbm) {
+    #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
+      // Quick non-blocking event (pre-formatted to minimize processing)
+      char rssiEvent[96];
+      snprintf(rssiEvent, sizeof(rssiEvent), 
+              "From:N%d,RSSI:%ddBm,Threshold:%ddBm,Status:REJECTED",
+              senderId, rxRssi, rssiThresholdDbm);
+      sendWifiEvent("RSSI_LOW", rssiEvent);  // Non-blocking queue
+    #endif
+    
+    #ifdef VERBOSE
+      Serial.printf("[Node %d] [RX_REJECT] RSSI too low from Node %d: %d < %d dBm\n",
+                    myInfo.id, senderId, rxRssi, rssiThresholdDbm);
+    #endif
+    
+    return 255;  // Return invalid slot, ignore this packet completely
+  }
+  
+  // UPDATE/ADD SENDER TO NEIGHBOR LIST
+  bool foundSender = false;
+  for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
+    if (neighbours[i].id == senderId) {
+      selectedNeighbourIdx = i;
+      foundSender = true;
+      break;
+    }
+  }
+  
+  bool isNewNeighbor = false;
+  if (!foundSender) {
+    for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
+      if (neighbours[i].id == 0) {
+        selectedNeighbourIdx = i;
+        foundSender = true;
+        neighbourCount++;
+        isNewNeighbor = true;
+        break;
+      }
+    }
+  }
+  
+  if (foundSender) {
+    neighbours[selectedNeighbourIdx].id = senderId;
+    if (senderExtraSlot) {
+      neighbours[selectedNeighbourIdx].extraSlots |= 1UL << senderSlot;
+    } else {
+      neighbours[selectedNeighbourIdx].slotIndex = senderSlot;
+    }
+    neighbours[selectedNeighbourIdx].hoppingDistance = senderHop;
+    neighbours[selectedNeighbourIdx].isLocalized = senderLocalized;
+    
+    // Update cycle and track sequence
+    neighbours[selectedNeighbourIdx].syncedCycle = senderCycle;
+    
+    // Add to cycle history buffer (3 cycles for faster sync validation)
+    neighbours[selectedNeighbourIdx].cycleHistory[neighbours[selectedNeighbourIdx].cycleHistoryIdx] = senderCycle;
+    neighbours[selectedNeighbourIdx].cycleHistoryIdx = (neighbours[selectedNeighbourIdx].cycleHistoryIdx + 1) % 3;
+    
+    // Validate if cycles are sequential (allowing wrap-around)
+    bool sequential = true;
+    uint8_t validCount = 0;
+    for (uint8_t k = 0; k < 3; k++) {
+      if (neighbours[selectedNeighbourIdx].cycleHistory[k] != 255) validCount++;
+    }
+    
+    if (validCount >= 3) {  // Need all 3 cycles to validate sequence
+      // Check consecutive pattern
+      for (uint8_t k = 0; k < 2; k++) {
+        uint8_t curr = neighbours[selectedNeighbourIdx].cycleHistory[k];
+        uint8_t next = neighbours[selectedNeighbourIdx].cycleHistory[k + 1];
+        if (curr != 255 && next != 255) {
+          // Check if next is consecutive (with wrap-around at AUTO_SEND_INTERVAL_CYCLES)
+          uint8_t expected = (curr + 1) % AUTO_SEND_INTERVAL_CYCLES;
+          if (next != expected) {
+            sequential = false;
+            break;
+          }
+        }
+      }
+    } else {
+      sequential = false;  // Not enough data
+    }
+    
+    neighbours[selectedNeighbourIdx].cyclesSequential = sequential;
+    
+    // Track neighbor's stratum for sync decisions
+    neighbours[selectedNeighbourIdx].syncStratum = senderStratum;
+    
+    neighbours[selectedNeighbourIdx].rssi = rxRssi;
+    neighbours[selectedNeighbourIdx].snr = rxSnr;
+    neighbours[selectedNeighbourIdx].activityCounter = 0;
+    
+    #if ADR_ENABLE == 1
+      adrUpdateLink(selectedNeighbourIdx, (rxBuffer[11] >> 4) & 0x03);
+    #endif
+    
+    
+    #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
+      if (isNewNeighbor) {
+        char eventDetails[96];
+        snprintf(eventDetails, sizeof(eventDetails), 
+                "NodeID:%d,RSSI:%ddBm,Slot:%d,Hop:%d",
+                senderId, rxRssi, senderSlot, senderHop);
+        sendWifiEvent("NEIGHBOR_ADDED", eventDetails);
+      }
+    #endif
+    
+    #if ENABLE_SYNC_LOG == 1
+      // Log neighbor discovery/update
+      char syncDetail[64];
+      snprintf(syncDetail, sizeof(syncDetail), "NBR_UPD:Slot=%d,Hop=%d,Cycle=%d,RSSI=%d", 
+               senderSlot, senderHop, senderCycle, rxRssi);
+      logSyncEvent("RX_NEIGHBOR", senderId, syncDetail);
+    #endif
+    
+    // PARSE SENDER'S NEIGHBORS
+    neighbours[selectedNeighbourIdx].numberOfNeighbours = numNeighborsInPacket;
     neighbours[selectedNeighbourIdx].amIListedAsNeighbour = false;
     
     uint8_t byteIdx = 12;
     for (uint8_t i = 0; i < numNeighborsInPacket; i++) {
       uint16_t neighborId = (rxBuffer[byteIdx] << 8) | rxBuffer[byteIdx + 1];
-      uint8_t neighborSlot = rxBuffer[byteIdx + 2];
+      uint8_t neighborSlot = rxBuffer[byteIdx + 2] & 0x3F;
       uint8_t neighborHopInfo = rxBuffer[byteIdx + 3];
       uint8_t neighborHop = neighborHopInfo & 0x7F;
       bool neighborLocalized = (neighborHopInfo >> 7) & 0x01;
@@ -2083,6 +3501,7 @@ uint8_t processRxPacket() {
       if (neighborId == myInfo.id) {
         neighbours[selectedNeighbourIdx].amIListedAsNeighbour = true;
         neighbours[selectedNeighbourIdx].isBidirectional = true;
+        neighbours[selectedNeighbourIdx].adrReportedProfile = (rxBuffer[byteIdx + 2] >> 6) & 0x03;
         
         #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
           char bidirDetail[96];
@@ -2170,8 +3589,23 @@ uint8_t processRxPacket() {
           neighbours[selectedNeighbourIdx].rssi >= rssiThresholdDbm) {
         // Cycle validation logic: check for sequential consistency
         if (!cycleValidated) {
+          // Fast join: a no-data beacon from a gateway-synced node carries the whole
+          // frame counter (cycle + epoch byte), one is enough
+          bool fastJoin = false;
+          #if FAST_JOIN_ENABLE == 1
+            fastJoin = (dataMode == DATA_MODE_NONE && senderStratum < STRATUM_LOCAL);
+          #endif
+          
+          if (fastJoin) {
+            lastReceivedCycle = senderCycle;
+            cycleValidationCount = CYCLE_VALIDATION_THRESHOLD;
+            Serial.printf("[Node %d] [CYCLE_VAL] ✓ Locked on node %d (stratum %d), frame %u\n",
+                          myInfo.id, senderId, senderStratum,
+                          (unsigned)(rxBuffer[47] * AUTO_SEND_INTERVAL_CYCLES + senderCycle));
+            joinComplete(true);
+          }
           // Check if cycle is sequential (0->1->2->3->4)
-          if (lastReceivedCycle == -1) {
+          else if (lastReceivedCycle == -1) {
             // First cycle received
             lastReceivedCycle = senderCycle;
             cycleValidationCount = 1;
@@ -2205,7 +3639,7 @@ uint8_t processRxPacket() {
               #endif
               
               if (cycleValidationCount >= CYCLE_VALIDATION_THRESHOLD) {
-                cycleValidated = true;
+                joinComplete(false);
                 Serial.printf("[Node %d] [CYCLE_VAL] ✓ Validation complete! Ready for sequential TX\n", myInfo.id);
                 
                 #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
@@ -2232,7 +3666,10 @@ uint8_t processRxPacket() {
           }
         }
         
-        // Always update current cycle
+        // Always update current cycle, from the next frame on (advanceNetCycle)
+        netCycleHeard = senderCycle;
+        // The rest of the frame counter only rides in no-data beacons
+        if (dataMode == DATA_MODE_NONE) netEpochHeard = rxBuffer[47];
         if (myInfo.syncedCycle != senderCycle) {
           myInfo.syncedCycle = senderCycle;
           Serial.printf("[Node %d] [CYCLE_SYNC] Aligned to cycle %d from node %d (hop %d)\n", 
@@ -2248,6 +3685,17 @@ uint8_t processRxPacket() {
       }
     #endif
     
+    // PARSE GEOMETRY (no-data beacons), a sender on another geometry is no sync source
+    if (dataMode == DATA_MODE_NONE && !frameGeometryFromBeacon(senderHop)) {
+      senderOnOurGeometry = false;
+    }
+    
+    // PARSE SLOT OCCUPANCY (no-data beacons, 43-46)
+    if (dataMode == DATA_MODE_NONE) {
+      neighbours[selectedNeighbourIdx].occupiedSlots = ((uint32_t)rxBuffer[43] << 24) | ((uint32_t)rxBuffer[44] << 16) |
+                                                       ((uint32_t)rxBuffer[45] << 8) | (uint32_t)rxBuffer[46];
+    }
+    
     // PARSE DATA SECTION (if present)
     if (dataMode == DATA_MODE_OWN || dataMode == DATA_MODE_FORWARD) {
       uint16_t origSender = (rxBuffer[28] << 8) | rxBuffer[29];
@@ -2269,9 +3717,9 @@ uint8_t processRxPacket() {
       }
       sensorDataReceived[dataLen] = '\0';
       
-      Serial.printf("[Node %d] [RX_DATA] %s MsgID:%d orig:%d hops:%d target:%d data:%s\n",
+      Serial.printf("[Node %d] [RX_DATA] %s%s MsgID:%d orig:%d hops:%d target:%d data:%s\n",
                     myInfo.id, 
-                    (dataMode == DATA_MODE_OWN) ? "OWN" : "FWD",
+                    (dataMode == DATA_MODE_OWN) ? "OWN" : "FWD", isAlarm ? " ALARM" : "",
                     msgId, origSender, hopCount, hopDecisionTarget, sensorDataReceived);
       
       // GATEWAY BEHAVIOR (hop = 0)
@@ -2282,6 +3730,16 @@ uint8_t processRxPacket() {
           return 0; // Exit early
         }
         
+        if (isAlarm) {
+          Serial.printf("[Node %d] [ALARM] From node %d MsgID:%d after %d hops\n",
+                        myInfo.id, origSender, msgId, hopCount);
+          #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
+            char alarmDetail[64];
+            snprintf(alarmDetail, sizeof(alarmDetail), "Msg:%d,From:%d,Hops:%d", msgId, origSender, hopCount);
+            sendWifiEvent("ALARM", alarmDetail);
+          #endif
+        }
+        
         // Variables for logging
         int64_t rxTimestampUs = 0;
         int64_t txTimestampUs = 0;
@@ -2341,7 +3799,8 @@ uint8_t processRxPacket() {
         #if ENABLE_WIFI == 1 && ENABLE_LATENCY_CALC == 1
           // Calculate end-to-end latency if time synced
           if (timeSynced) {
-            rxTimestampUs = getCurrentTimeUs();
+            // Arrival is RX_DONE, not the time this code gets to run
+            rxTimestampUs = getCurrentTimeUs() - (esp_timer_get_time() - lastRxDoneUs);
             
             // Extract embedded TX timestamp from packet (bytes 40-47)
             txTimestampUs = ((int64_t)rxBuffer[40] << 56) |
@@ -2354,8 +3813,7 @@ uint8_t processRxPacket() {
                            ((int64_t)rxBuffer[47]);
             
             // Validate timestamp (should be reasonable - within last hour)
-            int64_t currentTime = getCurrentTimeUs();
-            int64_t timeDiff = currentTime - txTimestampUs;
+            int64_t timeDiff = rxTimestampUs - txTimestampUs;
             
             // Debug: Log when latency calculation fails
             #if DEBUG_MODE == DEBUG_MODE_GATEWAY_ONLY
@@ -2432,8 +3890,8 @@ uint8_t processRxPacket() {
           if (wifiBatchCount < WIFI_BATCH_SIZE) {
             wifiBatchBuffer[wifiBatchCount].origSender = origSender;
             wifiBatchBuffer[wifiBatchCount].messageId = msgId;
-            strncpy(wifiBatchBuffer[wifiBatchCount].data, sensorDataReceived, SENSOR_DATA_LENGTH);
-            wifiBatchBuffer[wifiBatchCount].data[SENSOR_DATA_LENGTH] = '\0';
+            snprintf(wifiBatchBuffer[wifiBatchCount].data, sizeof(wifiBatchBuffer[wifiBatchCount].data), "%s",
+                     sensorDataReceived);
             wifiBatchBuffer[wifiBatchCount].trackingLen = (hopCount < MAX_TRACKING_HOPS) ? hopCount : MAX_TRACKING_HOPS;
             for (uint8_t i = 0; i < wifiBatchBuffer[wifiBatchCount].trackingLen; i++) {
               wifiBatchBuffer[wifiBatchCount].tracking[i] = tracking[i];
@@ -2464,6 +3922,7 @@ uint8_t processRxPacket() {
           fwdMsg.messageId = msgId;
           fwdMsg.hopCount = hopCount + 1;
           fwdMsg.dataLen = dataLen;
+          fwdMsg.alarm = isAlarm;
           memcpy(fwdMsg.data, sensorDataReceived, dataLen);
           
           // Update tracking: add my ID to the path
@@ -2485,7 +3944,11 @@ uint8_t processRxPacket() {
                                   ((int64_t)rxBuffer[47]);
           #endif
           
-          enqueueForward(&fwdMsg);
+          if (isAlarm) {
+            enqueueForwardFront(&fwdMsg);
+          } else {
+            enqueueForward(&fwdMsg);
+          }
           
           // WiFi event: Forwarding packet
           #if ENABLE_WIFI == 1 && DEBUG_MODE == DEBUG_MODE_WIFI_MONITOR
@@ -2501,9 +3964,27 @@ uint8_t processRxPacket() {
     Serial.println("[RX_WARN] Neighbor list full, cannot add sender!");
   }
   
+  if (!senderOnOurGeometry || senderSlot >= Nslot || !syncSourceOk(senderId, senderStratum, senderHop)) {
+    return 255;  // Neighbour kept, but no resync on it
+  }
   return senderSlot;
 }
 
+// Slot edges are taken only from a gateway-synced sender closer to the gateway than me: a
+// better stratum (after this frame's sync update), my sync parent, or, since the stratum stops
+// at INDIRECT, a same-stratum sender with fewer hops. Unsynced nodes, and nodes that synced
+// through me, would drag my grid off the network's; two of them following each other run away
+// together. The gateway is the reference, it never resyncs.
+bool syncSourceOk(uint16_t senderId, uint8_t senderStratum, uint8_t senderHop) {
+  #if IS_REFERENCE == 1
+    return false;
+  #else
+    if (senderStratum >= STRATUM_LOCAL || senderStratum > myInfo.syncStratum) return false;
+    return senderStratum < myInfo.syncStratum || senderId == myInfo.syncSource ||
+           senderHop < myInfo.hoppingDistance;
+  #endif
+}
+
 void recalculateHopCount() {
   #if IS_REFERENCE == 0  // Only non-gateway nodes
     uint8_t oldHop = myInfo.hoppingDistance;
@@ -2513,7 +3994,8 @@ void recalculateHopCount() {
     for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
       if (neighbours[i].id != 0 && 
           neighbours[i].hoppingDistance != 0x7F &&
-          neighbours[i].rssi >= rssiThresholdDbm) {  // Filter by RSSI
+          neighbours[i].rssi >= rssiThresholdDbm &&  // Filter by RSSI
+          nbrRoutable(neighbours[i])) {
         
         uint8_t candidateHop = neighbours[i].hoppingDistance + 1;
         if (candidateHop < minHop) {
@@ -2541,6 +4023,8 @@ void updateNeighbourStatus() {
   for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
     if (neighbours[i].id != 0) {
       neighbours[i].activityCounter++;
+      neighbours[i].extraSlotsPrev = neighbours[i].extraSlots;
+      neighbours[i].extraSlots = 0;
       
       // Remove if inactive OR RSSI too low
       if (neighbours[i].activityCounter >= MAX_INACTIVE_CYCLES) {
@@ -2555,7 +4039,7 @@ void updateNeighbourStatus() {
           sendWifiEvent("NEIGHBOR_REMOVED", eventDetails);
         #endif
         
-        memset(&neighbours[i], 0, sizeof(NeighbourInfo));
+        memset((void*)&neighbours[i], 0, sizeof(NeighbourInfo));  // all zero: id 0 = free entry
         neighbourCount = max(0, (int)neighbourCount - 1);
       } else if (neighbours[i].rssi < rssiThresholdDbm) {
         Serial.printf("[Node %d] [RSSI_LOW] Removing neighbor %d (RSSI:%d < %d)\n", 
@@ -2569,7 +4053,7 @@ void updateNeighbourStatus() {
           sendWifiEvent("NEIGHBOR_REMOVED", eventDetails);
         #endif
         
-        memset(&neighbours[i], 0, sizeof(NeighbourInfo));
+        memset((void*)&neighbours[i], 0, sizeof(NeighbourInfo));  // all zero: id 0 = free entry
         neighbourCount = max(0, (int)neighbourCount - 1);
       }
     }
@@ -2600,58 +4084,39 @@ void updateNeighbourStatus() {
   }
 }
 
-ResponderOutput responder(uint32_t timeoutMs) {
+ResponderOutput responder(uint32_t timeoutUs) {
   ResponderOutput output;
   output.senderSlot = 255;
   output.adjustTiming = false;
   
-  uint32_t rxStart = millis();
   uint32_t rxStartUs = micros();
+  uint32_t rxElapsed = 0;
   lastRxDuration_us = 0;
   
-  // Ra01S: radio.Receive() polls for data (non-blocking)
-  // It checks IRQ status and returns received bytes if available
-  while (millis() - rxStart < timeoutMs) {
-    // Poll for received data
-    uint8_t rxLen = radio.Receive(rxBuffer, FIXED_PACKET_LENGTH);
+  // Ra01S: blocks until RX_DONE or the window ends
+  // (DIO1 interrupt when enabled, otherwise it polls IRQ status internally)
+  while ((rxElapsed = micros() - rxStartUs) < timeoutUs) {
+    uint32_t waitUs = timeoutUs - rxElapsed;
+    #if NOISE_SAMPLING_ENABLE == 1
+      // Come back at the next sample point, the receiver keeps running meanwhile
+      waitUs = min(waitUs, noiseNextSampleUs());
+    #endif
+    #if LORA_USE_HW_RX_TIMEOUT == 1
+      // Radio arms SetRx(timeout) and closes the window itself
+      uint8_t rxLen = radio.ReceiveWindow(rxBuffer, FIXED_PACKET_LENGTH, timeoutUs - rxElapsed, waitUs);
+    #else
+      radio.ReceiveMode();  // Radio may have slept since the last window
+      uint8_t rxLen = radio.WaitRx(rxBuffer, FIXED_PACKET_LENGTH, (waitUs + 999) / 1000);
+    #endif
+    #if NOISE_SAMPLING_ENABLE == 1
+      noiseSample();
+    #endif
     
-    if (rxLen > 0) {
-      lastRxDuration_us = micros() - rxStartUs;
-      rxPacketLength = rxLen;
-      
-      // Get RSSI and SNR
-      radio.GetPacketStatus(&rxRssi, &rxSnr);
-      lastRssi = rxRssi;
-      lastSnr = rxSnr;
-      rxPacketCount++;
-      
-      // Parse packet
-      uint16_t addr = (rxBuffer[0] << 8) | rxBuffer[1];
-      uint8_t cmd = rxBuffer[2];
-      
-      #ifdef VERBOSE
-        Serial.printf("[Node %d] [RX] Addr=%d Cmd=%d RSSI=%d SNR=%d\n", 
-                      myInfo.id, addr, cmd, rxRssi, rxSnr);
-      #endif
-      
-      if (addr == ADR_BROADCAST || addr == myInfo.id) {
-        if (cmd == CMD_ID_AND_POS) {
-          uint8_t senderSlot = processRxPacket();
-          
-          if (senderSlot != 255) {
-            output.senderSlot = senderSlot;
-            output.adjustTiming = true;
-            
-          }
-          
-          strcpy(nodeStatus, "RX_PKT");
-          return output;
-        }
-      }
+    if (rxLen > 0 && handleRxFrame(rxLen, rxStartUs, &output)) {
+      return output;
     }
     
-    // Small delay to prevent busy-waiting, yield for watchdog
-    delay(1);
+    // Yield for watchdog
     yield();
   }
   
@@ -2660,6 +4125,299 @@ ResponderOutput responder(uint32_t timeoutMs) {
   return output;
 }
 
+// Returns true when the frame was a mesh packet and the caller's window is done
+bool handleRxFrame(uint8_t rxLen, uint32_t rxStartUs, ResponderOutput* output) {
+  lastRxDuration_us = micros() - rxStartUs;
+  rxPacketLength = rxLen;
+  lastRxDoneUs = radio.GetRxTimestamp();
+  output->rxDoneUs = lastRxDoneUs;
+  output->rxProfile = adrRadioProfile;
+  
+  // Get RSSI and SNR
+  radio.GetPacketStatus(&rxRssi, &rxSnr);
+  lastRssi = rxRssi;
+  lastSnr = rxSnr;
+  rxPacketCount++;
+  
+  // Parse packet
+  uint16_t addr = (rxBuffer[0] << 8) | rxBuffer[1];
+  uint8_t cmd = rxBuffer[2];
+  
+  #ifdef VERBOSE
+    Serial.printf("[Node %d] [RX] Addr=%d Cmd=%d RSSI=%d SNR=%d\n", 
+                  myInfo.id, addr, cmd, rxRssi, rxSnr);
+  #endif
+  
+  if (addr == ADR_BROADCAST || addr == myInfo.id) {
+    if (cmd == CMD_ID_AND_POS) {
+      uint8_t senderSlot = processRxPacket();
+      
+      if (senderSlot != 255) {
+        output->senderSlot = senderSlot;
+        output->senderId = (rxBuffer[3] << 8) | rxBuffer[4];
+        output->adjustTiming = true;
+        
+      }
+      
+      strcpy(nodeStatus, "RX_PKT");
+      return true;
+    } else if (cmd == CMD_CONTENTION) {
+      // Sent at a random offset into the contention slot: table and data only, no resync
+      processRxPacket();
+      strcpy(nodeStatus, "RX_PKT");
+      return true;
+    }
+  }
+  return false;
+}
+
+bool cadSlotOwned(int slot) {
+  for (uint8_t i = 0; i < MAX_NEIGHBOURS; i++) {
+    if (neighbours[i].id != 0 && nbrOwnsSlot(neighbours[i], slot)) return true;
+  }
+  return false;
+}
+
+// Slots worth a CAD probe: the ones a known neighbour sends in, the ones the two-hop slot
+// map has taken (a node my neighbours hear may be in my range too, near the RSSI limit,
+// and a node that does not hear it must not pick its slot) and the contention slot (joins
+// and slot claims of nodes I don't know yet). All slots every CAD_SCAN_ALL_FRAMES frames
+// and in the frame after a known neighbour's slot stayed silent, so a neighbour that moved
+// to another slot is found again.
+bool cadSlotWatched(int slot) {
+  if (slot < 0 || slot >= Nslot || isMySlot(slot)) return false;
+  if (slot == contentionSlot() || tdmaFrame == cadScanAllFrame ||
+      tdmaFrame % CAD_SCAN_ALL_FRAMES == 0) return true;
+  return cadSlotOwned(slot) || !slotAvailability[slot];
+}
+
+// CAD listening for the slot in progress (or the next watched one): the radio stays in
+// standby and only probes for a preamble around the slot owner's expected TX start.
+// Slot boundaries sit at whole Tslot steps before the end of the RX window (the start of
+// endSlot), and a slot owner starts TX about TtxDelay_us after its boundary.
+ResponderOutput cadResponder(long remaining_us, long window_us, uint8_t endSlot) {
+  ResponderOutput output;
+  output.senderSlot = 255;
+  output.adjustTiming = false;
+  
+  uint32_t startUs = micros();
+  long sinceBoundary = ((long)Tslot_us - remaining_us % (long)Tslot_us) % (long)Tslot_us;
+  long txStart = (long)TtxDelay_us - sinceBoundary;
+  int slot = (int)endSlot - (int)((remaining_us + (long)Tslot_us - 1) / (long)Tslot_us);
+  
+  // Probe window of this slot already over: move on to the next slot
+  if (txStart + (long)CAD_WINDOW_HALF_US <= 0) {
+    txStart += Tslot_us;
+    slot++;
+  }
+  // Nobody I know sends in it: skip to the next watched slot (or past the window)
+  while (slot < (int)endSlot && !cadSlotWatched(slot)) {
+    txStart += Tslot_us;
+    slot++;
+  }
+  long windowStart = max(txStart - (long)CAD_WINDOW_HALF_US, 0L);
+  long windowEnd = min(txStart + (long)CAD_WINDOW_HALF_US, window_us);
+  
+  if (slot >= (int)endSlot || windowStart >= windowEnd) {
+    // No further watched slot starts before the window closes
+    radioIdleFor(window_us);
+    strcpy(nodeStatus, "RX_TOUT");
+    return output;
+  }
+  
+  radioIdleFor(windowStart);
+  
+  bool detected = false;
+  while ((long)(micros() - startUs) < windowEnd) {
+    uint32_t probeUs = micros();
+    uint8_t rxLen = radio.CadReceive(rxBuffer, FIXED_PACKET_LENGTH, Tpacket_us, &detected);
+    
+    if (rxLen > 0 && handleRxFrame(rxLen, probeUs, &output)) {
+      return output;
+    }
+    if (detected) break;  // Slot was used (foreign or corrupted frame)
+    
+    uint32_t probeElapsed = micros() - probeUs;
+    if (probeElapsed < CAD_SAMPLE_PERIOD_US) {
+      waitMicros(CAD_SAMPLE_PERIOD_US - probeElapsed);
+    }
+  }
+  // A known neighbour's slot stayed silent over the whole probe window: it may have moved
+  if (!detected && windowEnd == txStart + (long)CAD_WINDOW_HALF_US && cadSlotOwned(slot)) {
+    cadScanAllFrame = tdmaFrame + 1;
+  }
+  
+  strcpy(nodeStatus, "RX_CAD");
+  return output;
+}
+
+// One step of an RX phase: full RX until synced, CAD probing afterwards (if enabled)
+// endSlot: slot index at which the window ends (my slot in RX phase 1, Nslot in phase 2)
+// stopEarly_us: return this much before remaining_us runs out (TX preload lead)
+ResponderOutput listenWindow(long remaining_us, uint8_t endSlot, long stopEarly_us) {
+  long window_us = remaining_us - stopEarly_us;
+  #if ADR_ENABLE == 1 || CH_HOP_ENABLE == 1
+    // Per-slot modulation / channel: listen to the slot in progress with its owner's
+    // settings, and only up to its end so the next slot gets its own
+    long slotsLeft = (remaining_us + (long)Tslot_us - 1) / (long)Tslot_us;
+    int slot = (int)endSlot - (int)slotsLeft;
+    bool perSlot = false;
+    #if ADR_ENABLE == 1
+      adrApplyProfile(adrSlotProfile(slot));
+      perSlot |= adrFastCycle;
+    #endif
+    #if CH_HOP_ENABLE == 1
+      chHopApplyChannel(chHopSlotChannel(slot));
+      perSlot |= chHopActive;
+    #endif
+    if (perSlot && slot >= 0) {
+      window_us = min(window_us, remaining_us - (slotsLeft - 1) * (long)Tslot_us);
+    }
+  #endif
+  #if TDMA_CAD_LISTEN == 1
+    if (resyncedLastCycle) {
+      return cadResponder(remaining_us, window_us, endSlot);
+    }
+  #endif
+  #if NOISE_SAMPLING_ENABLE == 1
+    noisePhaseEndUs = micros() + remaining_us;
+    noiseEndSlot = endSlot;
+    noiseWindowOpen = true;
+    ResponderOutput output = responder(calcTimeoutUs(window_us));
+    noiseWindowOpen = false;
+    return output;
+  #else
+    return responder(calcTimeoutUs(window_us));
+  #endif
+}
+
+// RX phase: listen until the start of endSlot (my next TX slot, or Nslot for the rest of the
+// frame) and resync on the frames heard. Ahead of a TX slot the frame is built and preloaded.
+void listenUntilSlot(uint8_t endSlot) {
+  ResponderOutput rxOutput;
+  bool txSlotAhead = endSlot < Nslot && !joinListening();
+  long Tremaining_us = usUntil(slotStartUs(endSlot));
+  
+  while (Tremaining_us > 0) {
+    uint32_t timeout_us = calcTimeoutUs(Tremaining_us);
+    if (timeout_us == 0) break;
+    
+    yield();
+    
+    // Build the frame and load it into the radio while the slot before mine ends
+    if (txSlotAhead && !txFrameReady && Tremaining_us <= (long)TX_PRELOAD_LEAD_US) {
+      prepareUnifiedPacket(endSlot);
+      Tremaining_us = usUntil(slotStartUs(endSlot));
+      continue;
+    }
+    
+    rxOutput = listenWindow(Tremaining_us, endSlot, (txSlotAhead && !txFrameReady) ? TX_PRELOAD_LEAD_US : 0);
+    recoverRadioIfFaulted();
+    
+    // TIMING SYNCHRONIZATION (LoRaQuake algorithm): the sender started its frame TtxDelay_us
+    // into its slot, so the slot began TtxDelay_us + air time before RX_DONE. The air time is
+    // the one of the profile the frame came in on, not Tpacket_us (ADR slots run shorter or
+    // longer). Anchored at the DIO1 timestamp, so whatever passed since (IRQ latency, FIFO
+    // read, packet processing) drops out. Only the phase moves, see tdmaResync(): a sender
+    // in my pending slot or after it no longer pushes that slot into the next frame.
+    if (rxOutput.adjustTiming && rxOutput.senderSlot != 255) {
+      resyncedThisCycle = true;
+      lastRxStampAge_us = (uint32_t)(esp_timer_get_time() - rxOutput.rxDoneUs);
+      tdmaResync(rxOutput.senderSlot,
+                 rxOutput.rxDoneUs - TtxDelay_us - adrFrameToaUs(rxOutput.rxProfile), rxOutput.senderId);
+    }
+    Tremaining_us = usUntil(slotStartUs(endSlot));
+  }
+}
+
+// TX phase: send the frame for one of my slots and idle to the end of it
+void transmitInSlot(uint8_t slot) {
+  int64_t txSlotStartUs = slotStartUs(slot);
+  int64_t txSlotEndUs = slotStartUs(slot + 1);
+  
+  #if ADR_ENABLE == 1
+    adrApplyProfile(adrFastCycle ? adrTxProfile : 0);
+  #endif
+  #if CH_HOP_ENABLE == 1
+    chHopApplyChannel(chHopActive ? chHopChannel(slot, myInfo.id) : 0);
+  #endif
+  
+  // Normally done in RX phase 1 already; slot 0 (or a short phase 1) builds it here
+  if (!txFrameReady) {
+    prepareUnifiedPacket(slot);
+  }
+  
+  // A resync heard right before my slot can leave its edge behind me: a late frame would
+  // hand its receivers a wrong slot edge, so it waits for the next frame instead
+  long lateUs = -usUntil(txSlotStartUs + TtxDelay_us);
+  if (lateUs > (long)TDMA_TX_LATE_MAX_US) {
+    txFrameReady = false;
+    Serial.printf("[Node %d] [TX] Slot %d missed, its edge moved %ld us behind me\n", myInfo.id, slot, lateUs);
+    radioIdleUntil(txSlotEndUs);
+    return;
+  }
+  waitUntil(txSlotStartUs + TtxDelay_us);
+  
+  transmitUnifiedPacket();
+  
+  // Packet is on air: block on DIO1 until TX done (radio returns to RX by itself)
+  // (a TX still running at the slot end is aborted rather than spilling into the next slot)
+  long toSlotEnd = usUntil(txSlotEndUs);
+  radio.FinishTx(toSlotEnd > 0 ? toSlotEnd / 1000 : 0);
+  recoverRadioIfFaulted();
+  
+  // The rest of the slot is quiet: do this frame's deferred housekeeping in it
+  if (!housekeepingDone) {
+    housekeepingRun(txSlotEndUs);
+  }
+  
+  // Radio idle until the next RX phase
+  radioIdleUntil(txSlotEndUs);
+}
+
+// Deferred housekeeping, once per frame: nothing here touches the radio or the slot grid.
+// Runs in the idle rest of my TX slot; without a usable one, in the next processing phase.
+// Only starts with HOUSEKEEPING_MIN_US left before deadlineUs, so it never runs into a slot;
+// false = no room, it waits for a later frame.
+bool housekeepingRun(int64_t deadlineUs) {
+  if (usUntil(deadlineUs) < (long)HOUSEKEEPING_MIN_US) {
+    return false;
+  }
+  housekeepingDone = true;
+  uint32_t startUs = micros();
+  
+  updateSensorReadings();
+  
+  if (loopCounter % 10 == 0) {
+    printStatusLine();
+  }
+  
+  #if ENABLE_WIFI == 1
+    updateDriftCompensation();
+  #endif
+  
+  #if NOISE_SAMPLING_ENABLE == 1
+    if (noiseCycle % NOISE_HISTORY_CYCLES == 0) {
+      sendNoiseStatsWifi();
+    }
+  #endif
+  
+  // Send WiFi batch if gateway and has buffered messages
+  #if ENABLE_WIFI == 1
+    if (myInfo.hoppingDistance == 0 && wifiBatchCount > 0) {
+      sendWifiBatch();
+    }
+  #endif
+  
+  housekeepingLastUs = micros() - startUs;
+  if (usUntil(deadlineUs) < 0) {
+    housekeepingOverruns++;
+    Serial.printf("[Node %d] [HOUSEKEEPING] Overran its deadline by %ld us (took %lu us)\n",
+                  myInfo.id, -usUntil(deadlineUs), housekeepingLastUs);
+  }
+  return true;
+}
+
 void setup() {
   Serial.begin(115200);
   delay(1000);
@@ -2668,9 +4426,9 @@ void setup() {
   configInit();
   runtimeConfig = configLoad();
   if (runtimeConfig.valid) {
-    strncpy(activeSSID, runtimeConfig.ssid, MAX_SSID_LEN);
-    strncpy(activePassword, runtimeConfig.password, MAX_PASS_LEN);
-    strncpy(activeServerIP, runtimeConfig.serverIP, MAX_IP_LEN);
+    snprintf(activeSSID, sizeof(activeSSID), "%s", runtimeConfig.ssid);
+    snprintf(activePassword, sizeof(activePassword), "%s", runtimeConfig.password);
+    snprintf(activeServerIP, sizeof(activeServerIP), "%s", runtimeConfig.serverIP);
     activeDebugMode = runtimeConfig.debugMode;
     
     // Load RSSI thresholds from EEPROM
@@ -2707,6 +4465,11 @@ void setup() {
   Serial.printf("[CONFIG] Mode: %d\n", activeDebugMode);
   Serial.printf("[CONFIG] RSSI Min: %d dBm, Good: %d dBm\n", rssiThresholdDbm, rssiGoodQualityDbm);
   Serial.printf("[CONFIG] TX Power: %d dBm\n", currentTxPower);
+  
+  frameGeometry = frameGeometryLoad();
+  frameGeometryApply(frameGeometry);
+  Serial.printf("[CONFIG] Frame: v%d, %d slots x %u ms, processing %u ms\n",
+                frameGeometry.seq, frameGeometry.nslot, frameGeometry.tslotMs, frameGeometry.tprocessingMs);
   Serial.println("[CONFIG] Type 'HELP' for serial commands");
 
   Wire.begin(I2C_SDA, I2C_SCL);
@@ -2716,8 +4479,20 @@ void setup() {
   initDisplay();
   initSensors();
   initLoRa();
+  resetNoiseStats();
   initMyInfo();
   
+  // Hashed reporting phase needs the node ID
+  reportScheduleApply(reportScheduleLoad());
+  Serial.printf("[CONFIG] Report: every %u frames, phase %u\n", reportSchedule.periodFrames, reportPhase);
+  
+  #if FIX_SLOT == 1
+    if (myInfo.slotIndex == contentionSlot()) {
+      Serial.printf("[Node %d] [SLOT] WARNING: slot %d is the contention slot, pick another SLOT_DEVICE\n",
+                    myInfo.id, myInfo.slotIndex);
+    }
+  #endif
+  
   // Initialize WiFi and NTP time sync with microsecond precision
   #if ENABLE_WIFI == 1
     Serial.printf("[Node %d] [WIFI] Connecting to %s...\n", myInfo.id, activeSSID);
@@ -2926,6 +4701,7 @@ void setup() {
   Serial.println("Starting mesh network...\n");
   
   strcpy(nodeStatus, "READY");
+  joinRestart();
 }
 
 void resetTDMAState() {
@@ -2941,6 +4717,9 @@ void resetTDMAState() {
     neighbours[i].activityCounter = 0;
     neighbours[i].amIListedAsNeighbour = false;
     neighbours[i].isBidirectional = false;
+    neighbours[i].extraSlots = 0;
+    neighbours[i].extraSlotsPrev = 0;
+    neighbours[i].occupiedSlots = 0;
     
     // Clear cycle history (3 cycles for sync validation)
     for (uint8_t j = 0; j < 3; j++) {
@@ -2964,6 +4743,16 @@ void resetTDMAState() {
   cycleValidationCount = 0;
   lastReceivedCycle = -1;
   autoSendCounter = 0;
+  netEpoch = 0;
+  joinRestart();
+  contentionPending = 0;
+  contentionBackoff = 0;
+  contentionExp = 0;
+  resyncedThisCycle = false;
+  resyncedLastCycle = false;
+  tdmaScheduleValid = false;
+  resetNoiseStats();
+  slotSelectRestart();
   
   Serial.printf("{NODE%d} [RESET] All TDMA state cleared (neighbors=%d, hop=%d)\n", 
                 myInfo.id, neighbourCount, myInfo.hoppingDistance);
@@ -3039,10 +4828,79 @@ void checkSerialCommands() {
                         myInfo.syncedCycle, neighbourCount, tdmaEnabled ? "ON" : "OFF");
           Serial.printf("{NODE%d} [STATUS] TX:%lu RX:%lu FwdQ:%d\n",
                         myInfo.id, txPacketCount, rxPacketCount, forwardQueueCount);
+          #if CLOCK_DISCIPLINE_ENABLE == 1
+            Serial.printf("{NODE%d} [STATUS] Clock: %+.1f ppm, phase error last %ld us avg %lu us max %lu us, %lu frames since resync\n",
+                          myInfo.id, clockFreqPpb / 1000.0f, tdmaLastShiftUs, clockErrAvgUs, clockErrMaxUs,
+                          tdmaFrame - clockSyncFrame);
+          #endif
+          printSlotMap();
+          if (cycleValidated) {
+            Serial.printf("{NODE%d} [STATUS] Joined in %lu ms (%u frames, %s)\n", myInfo.id,
+                          joinLatencyMs, joinLatencyFrames, joinWasFast ? "fast" : "sequential");
+          } else {
+            Serial.printf("{NODE%d} [STATUS] Joining for %u frames%s\n", myInfo.id, joinFrames,
+                          joinListening() ? " (listening)" : "");
+          }
+          Serial.printf("{NODE%d} [STATUS] Housekeeping: last %lu us, skipped:%lu overruns:%lu\n",
+                        myInfo.id, housekeepingLastUs, housekeepingSkipped, housekeepingOverruns);
+          #if CONTENTION_SLOT_ENABLE == 1
+            Serial.printf("{NODE%d} [STATUS] Contention slot %d: sent:%lu busy:%lu pending:0x%02X backoff:%d\n",
+                          myInfo.id, contentionSlot(), contentionSent, contentionBusy,
+                          contentionPending, contentionBackoff);
+          #endif
+          #if NOISE_SAMPLING_ENABLE == 1
+            printNoiseStats();
+          #endif
         }
         else if (cmd == "PING") {
           Serial.printf("{NODE%d} [PONG]\n", myInfo.id);
         }
+        else if (cmd == "RADIO_STATS") {
+          SX126xSpiStats spi;
+          radio.GetSpiStats(&spi);
+          Serial.printf("{NODE%d} [RADIO] SPI @%lu Hz: %lu transactions, %lu bytes, %lu us busy\n",
+                        myInfo.id, radio.GetSpiFrequency(), spi.transactions, spi.bytes, spi.busyUs);
+          Serial.printf("{NODE%d} [RADIO] Last TX prepare: %lu us (budget %lu us), last RX read: %lu us\n",
+                        myInfo.id, spi.lastTxPrepareUs, (uint32_t)TX_PREPARE_TIME_US, spi.lastRxReadUs);
+          Serial.printf("{NODE%d} [RADIO] Last RX setup: %lu us (budget %lu us), RX_DONE to resync: %lu us, grid shift: %ld us\n",
+                        myInfo.id, spi.lastRxSetupUs, (uint32_t)RX_SETUP_TIME_US, lastRxStampAge_us, tdmaLastShiftUs);
+          Serial.printf("{NODE%d} [RADIO] SPI commands TX prepare:%u RX setup:%u RX read:%u, skipped by shadow state:%lu\n",
+                        myInfo.id, spi.lastTxPrepareCmds, spi.lastRxSetupCmds, spi.lastRxReadCmds, spi.skipped);
+          SX126xPowerStats pwr;
+          radio.GetPowerStats(&pwr);
+          uint64_t totalUs = 0;
+          for (uint8_t i = 0; i < SX126x_STATE_COUNT; i++) totalUs += pwr.stateUs[i];
+          if (totalUs == 0) totalUs = 1;
+          Serial.printf("{NODE%d} [RADIO] Time SLEEP:%.1f%% STBY:%.1f%% RX:%.1f%% TX:%.1f%% (%llu ms total)\n",
+                        myInfo.id,
+                        100.0 * pwr.stateUs[SX126x_STATE_SLEEP] / totalUs,
+                        100.0 * pwr.stateUs[SX126x_STATE_STBY] / totalUs,
+                        100.0 * pwr.stateUs[SX126x_STATE_RX] / totalUs,
+                        100.0 * pwr.stateUs[SX126x_STATE_TX] / totalUs,
+                        totalUs / 1000);
+          Serial.printf("{NODE%d} [RADIO] Wakeups:%lu last:%lu us max:%lu us (budget %lu us)\n",
+                        myInfo.id, pwr.wakeups, pwr.lastWakeUs, pwr.maxWakeUs, (uint32_t)RADIO_WAKEUP_BUDGET_US);
+          #if ADR_ENABLE == 1
+            Serial.printf("{NODE%d} [RADIO] ADR cycle:%s TX profile:%d next:%d listening on:%d\n",
+                          myInfo.id, adrFastCycle ? "per-slot" : "base", adrTxProfile, adrTxProfileNext, adrRadioProfile);
+          #endif
+          #if CH_HOP_ENABLE == 1
+            Serial.printf("{NODE%d} [RADIO] Channel hopping cycle:%s my offset:%d tuned to:%d (%.1f MHz)\n",
+                          myInfo.id, chHopActive ? "hopping" : "base", myInfo.id % CH_HOP_CHANNEL_COUNT,
+                          chHopRadioChannel, chHopChannels[chHopRadioChannel] / 1000000.0);
+          #endif
+          SX126xFaultStats faults;
+          radio.GetFaultStats(&faults);
+          Serial.printf("{NODE%d} [RADIO] Faults:%lu recoveries:%lu failed:%lu last error:%d, recovery last:%lu us max:%lu us\n",
+                        myInfo.id, faults.faults, faults.recoveries, faults.failures, faults.lastError,
+                        faults.lastRecoveryUs, faults.maxRecoveryUs);
+          if (param.equalsIgnoreCase("RESET")) {
+            radio.ResetSpiStats();
+            radio.ResetPowerStats();
+            radio.ResetFaultStats();
+            Serial.printf("{NODE%d} [RADIO] Counters reset\n", myInfo.id);
+          }
+        }
         
         // ============= CONFIGURATION COMMANDS (EEPROM, MAY REBOOT) =============
         else if (cmd == "SET_SSID") {
@@ -3095,6 +4953,78 @@ void checkSerialCommands() {
                         runtimeConfig.debugMode != activeDebugMode ? " *" : "");
           Serial.printf("{NODE%d} [CONFIG] (* = changed, use SAVE to apply)\n\n", myInfo.id);
         }
+        else if (cmd == "SET_FRAME") {
+          #if IS_REFERENCE == 1
+            unsigned int nslot, tslotMs, tprocessingMs;
+            if (sscanf(param.c_str(), "%u %u %u", &nslot, &tslotMs, &tprocessingMs) == 3 &&
+                nslot <= 255 && tslotMs <= 65535 && tprocessingMs <= 65535) {
+              const char* error = frameGeometryRequest(nslot, tslotMs, tprocessingMs);
+              if (error) {
+                Serial.printf("{NODE%d} [ERROR] Frame geometry rejected: %s\n", myInfo.id, error);
+              } else {
+                Serial.printf("{NODE%d} [FRAME] ✓ Announced, the network switches in %d frames\n",
+                              myInfo.id, FRAME_SWITCH_COUNTDOWN);
+              }
+            } else {
+              Serial.printf("{NODE%d} [ERROR] Usage: SET_FRAME <slots> <slot_ms> <processing_ms>\n", myInfo.id);
+            }
+          #else
+            Serial.printf("{NODE%d} [ERROR] Only the gateway sets the frame geometry\n", myInfo.id);
+          #endif
+        }
+        else if (cmd == "SHOW_FRAME") {
+          Serial.printf("\n{NODE%d} === Frame Geometry ===\n", myInfo.id);
+          Serial.printf("{NODE%d} [FRAME] Active: v%d, %d slots x %lu us, processing %lu us\n",
+                        myInfo.id, frameGeometry.seq, Nslot, Tslot_us, Tprocessing_us);
+          Serial.printf("{NODE%d} [FRAME] Frame: %lu us, slot offset: %lu us\n", myInfo.id, Tframe_us, slotOffset_us);
+          if (geometryPending) {
+            Serial.printf("{NODE%d} [FRAME] Pending: v%d, %d slots x %u ms, processing %u ms, in %d frames\n",
+                          myInfo.id, pendingGeometry.seq, pendingGeometry.nslot, pendingGeometry.tslotMs,
+                          pendingGeometry.tprocessingMs, frameGeometryCountdown());
+          }
+          Serial.printf("{NODE%d} [FRAME] Limits: 2-%d slots, slot >= %lu us, processing >= %lu us\n\n",
+                        myInfo.id, NSLOT_MAX, tslotFloorUs(), (uint32_t)TPROCESSING_MIN_US);
+        }
+        else if (cmd == "SET_REPORT") {
+          unsigned int period, phase;
+          int fields = sscanf(param.c_str(), "%u %u", &period, &phase);
+          if (fields >= 1 && period <= 65535 && (fields == 1 || phase <= 65535)) {
+            ReportSchedule r;
+            r.periodFrames = period;
+            r.phase = (fields == 2) ? phase : REPORT_PHASE_HASHED;
+            const char* error = reportScheduleCheck(r);
+            if (error) {
+              Serial.printf("{NODE%d} [ERROR] Reporting schedule rejected: %s\n", myInfo.id, error);
+            } else {
+              reportScheduleApply(r);
+              reportScheduleSave(r);
+              Serial.printf("{NODE%d} [REPORT] ✓ Every %u frames at phase %u%s (saved)\n", myInfo.id,
+                            reportSchedule.periodFrames, reportPhase, (r.phase == REPORT_PHASE_HASHED) ? " (hashed)" : "");
+            }
+          } else {
+            Serial.printf("{NODE%d} [ERROR] Usage: SET_REPORT <frames> [phase]\n", myInfo.id);
+          }
+        }
+        else if (cmd == "SHOW_REPORT") {
+          Serial.printf("\n{NODE%d} === Reporting Schedule ===\n", myInfo.id);
+          Serial.printf("{NODE%d} [REPORT] Every %u frames (%lu ms) at phase %u%s\n", myInfo.id,
+                        reportSchedule.periodFrames, (uint32_t)reportSchedule.periodFrames * (Tframe_us / 1000),
+                        reportPhase, (reportSchedule.phase == REPORT_PHASE_HASHED) ? " (hashed from ID)" : "");
+          Serial.printf("{NODE%d} [REPORT] Network frame: %u of %u, next reading in %u frames\n\n", myInfo.id,
+                        netFrame(), (unsigned)REPORT_FRAME_WRAP,
+                        (reportPhase + reportSchedule.periodFrames - netFrame() % reportSchedule.periodFrames) % reportSchedule.periodFrames);
+        }
+        else if (cmd == "ALARM") {
+          #if CONTENTION_SLOT_ENABLE == 1 && IS_REFERENCE == 0
+            messageIdCounter++;
+            alarmMessageId = (myInfo.id << 8) | (messageIdCounter & 0xFF);
+            contentionRequest(CONTENTION_ALARM);
+            Serial.printf("{NODE%d} [ALARM] MsgID:%u waiting for the contention slot%s\n", myInfo.id,
+                          alarmMessageId, contentionReady() ? "" : " (no route yet)");
+          #else
+            Serial.printf("{NODE%d} [ERROR] ALARM needs CONTENTION_SLOT_ENABLE on a sensor node\n", myInfo.id);
+          #endif
+        }
         else if (cmd == "RESET_CONFIG") {
           Serial.printf("{NODE%d} [CONFIG] Clearing EEPROM...\n", myInfo.id);
           configClear();
@@ -3108,6 +5038,7 @@ void checkSerialCommands() {
           Serial.printf("  TDMA_ON / START [delay_ms]  - Enable TDMA\n");
           Serial.printf("  TDMA_OFF / STOP             - Disable TDMA & reset data\n");
           Serial.printf("  STATUS                      - Show current status\n");
+          Serial.printf("  RADIO_STATS [RESET]         - SPI traffic, TX/RX prepare times, radio state times, faults\n");
           Serial.printf("\nRSSI Configuration (runtime, use SAVE_RSSI to persist):\n");
           Serial.printf("  SET_RSSI_MIN <dBm>          - Min RSSI threshold (default -115)\n");
           Serial.printf("  SET_RSSI_GOOD <dBm>         - Good quality threshold (default -100)\n");
@@ -3117,6 +5048,13 @@ void checkSerialCommands() {
           Serial.printf("  SET_TXPOWER <dBm>           - Set TX power (-9 to +22 dBm)\n");
           Serial.printf("  SAVE_TXPOWER                - Save TX power to EEPROM\n");
           Serial.printf("  SHOW_TXPOWER                - Show TX power settings\n");
+          Serial.printf("\nFrame Geometry (network-wide, no reboot):\n");
+          Serial.printf("  SET_FRAME <n> <slot_ms> <proc_ms> - Gateway: switch all nodes in %d frames\n", FRAME_SWITCH_COUNTDOWN);
+          Serial.printf("  SHOW_FRAME                  - Show active and pending geometry\n");
+          Serial.printf("\nReporting Schedule (this node, saved):\n");
+          Serial.printf("  SET_REPORT <frames> [phase] - Own reading every <frames> (divides %d), phase hashed if omitted\n", REPORT_FRAME_WRAP);
+          Serial.printf("  SHOW_REPORT                 - Show period, phase and network frame\n");
+          Serial.printf("  ALARM                       - Send an alarm via the contention slot\n");
           Serial.printf("\nWiFi/Server (requires SAVE & reboot):\n");
           Serial.printf("  SET_SSID <ssid>             - Set WiFi SSID\n");
           Serial.printf("  SET_PASS <password>         - Set WiFi password\n");
@@ -3285,11 +5223,8 @@ void checkSerialCommands() {
 }
 
 void loop() {
-  updateSensorReadings();
   checkSerialCommands();
   
-  ResponderOutput rxOutput;
-  
   noInterrupts();
   bool btnPressed = buttonPressed;
   buttonPressed = false;
@@ -3332,18 +5267,15 @@ void loop() {
   #endif
   // ============= END STRATUM TIMEOUT CHECK =============
   
-  // AUTO-SEND SENSOR DATA (sequential transmission based on cycle)
+  // AUTO-SEND SENSOR DATA (reporting schedule on the network frame counter)
   bool canAutoSend = (myInfo.hoppingDistance != 0 && 
                       myInfo.hoppingDistance != 0x7F && 
                       !hasSensorDataToSend &&
                       cycleValidated);  // Only send after cycle validation
   
   if (canAutoSend) {
-    // Sequential transmission: Node sends when (cycle == nodeId - 1)
-    // Cycle 0 -> Node 1, Cycle 1 -> Node 2, Cycle 2 -> Node 3, etc.
-    uint8_t myTurnCycle = (myInfo.id - 1) % AUTO_SEND_INTERVAL_CYCLES;
-    
-    if (myInfo.syncedCycle == myTurnCycle) {
+    // Once per period, at my phase (SET_REPORT, REPORT_PERIOD_DEFAULT)
+    if (reportDue()) {
       bool hasNextHop = false;
       for (uint8_t i = 0; i < neighbourCount; i++) {
         uint8_t idx = neighbourIndices[i];
@@ -3364,8 +5296,8 @@ void loop() {
         
         hasSensorDataToSend = true;
         
-        Serial.printf("[Node %d] [AUTO_SEND_SEQ] My turn! Cycle:%d (ID:%d) MsgID:%u T:%.1f H:%.1f B:%d%% data:%s\n", 
-                      myInfo.id, myInfo.syncedCycle, myInfo.id, ownMessageId, currentTemperature, currentHumidity, currentBattery, sensorDataToSend);
+        Serial.printf("[Node %d] [AUTO_SEND_SEQ] My turn! Frame:%u (every %u, phase %u) MsgID:%u T:%.1f H:%.1f B:%d%% data:%s\n", 
+                      myInfo.id, netFrame(), reportSchedule.periodFrames, reportPhase, ownMessageId, currentTemperature, currentHumidity, currentBattery, sensorDataToSend);
       }
     }
   } else if (!cycleValidated && myInfo.hoppingDistance != 0 && myInfo.hoppingDistance != 0x7F) {
@@ -3399,25 +5331,39 @@ void loop() {
   if (!tdmaEnabled) {
     // TDMA stopped - simulate node failure
     // Node won't transmit, neighbors will timeout and remove from routing table
+    radio.Sleep();  // Nothing scheduled, first command after restart wakes it
+    tdmaScheduleValid = false;  // Restart the grid from scratch when TDMA comes back
+    updateSensorReadings();
     delay(100);  // Prevent busy loop
     return;  // Skip entire TDMA cycle
   }
   
   loopCounter++;
-  unsigned long cycleStart = micros();
-  
-  if (loopCounter % 10 == 0) {
-    printStatusLine();
-  }
+  #ifdef VERBOSE
+    unsigned long cycleStart = micros();
+  #endif
+  tdmaStartFrame();
   
   // ========== PROCESSING PHASE ==========
-  unsigned long procStart = micros();
+  // Only the per-frame state the slots depend on; the rest waits for my TX slot (housekeepingRun)
   
+  // A fault from the idle gap (or a failed recovery last frame) is retried here
+  recoverRadioIfFaulted();
   
-  // Update drift compensation periodically
-  #if ENABLE_WIFI == 1
-    updateDriftCompensation();
+  advanceNetCycle();
+  #if NOISE_SAMPLING_ENABLE == 1
+    noiseCycle++;
+  #endif
+  #if ADR_ENABLE == 1
+    adrStartCycle();
   #endif
+  #if CH_HOP_ENABLE == 1
+    chHopStartCycle();
+  #endif
+  
+  // CAD listening relies on last cycle's slot grid
+  resyncedLastCycle = resyncedThisCycle;
+  resyncedThisCycle = false;
   
   // Re-calculate hop count every cycle (Bellman-Ford with RSSI filter)
   recalculateHopCount();
@@ -3425,25 +5371,41 @@ void loop() {
   // Update neighbor timeout and rebuild indices
   updateNeighbourStatus();
   
+  #if FIX_SLOT == 0
+    slotSelectUpdate();
+  #endif
+  
+  if (!cycleValidated && joinFrames < 0xFFFF) {
+    joinFrames++;
+    // Nothing to validate on yet: let the neighbours know I am here
+    #if FAST_JOIN_ENABLE == 1
+      if (joinFrames == FAST_JOIN_LISTEN_FRAMES) {
+        contentionRequest(CONTENTION_JOIN);
+      }
+    #endif
+  }
+  // Without a contention slot, still joining: my owned slot on one frame in
+  // FAST_JOIN_LISTEN_FRAMES, picked at random. A TX every frame, or on a fixed period, could
+  // stay in step with a synced neighbour's slot or with the home-channel cycles of channel
+  // hopping, and hide that neighbour for good.
+  #if FAST_JOIN_ENABLE == 1 && CONTENTION_SLOT_ENABLE == 0
+    joinBeaconFrame = !cycleValidated && joinFrames >= FAST_JOIN_LISTEN_FRAMES &&
+                      random(FAST_JOIN_LISTEN_FRAMES) == 0;
+  #endif
+  
   // Display update now handled by separate task on Core 0
   // Just set the flag when data changes
   displayNeedsUpdate = true;
   
-  // Send WiFi batch if gateway and has buffered messages
-  #if ENABLE_WIFI == 1
-    if (myInfo.hoppingDistance == 0 && wifiBatchCount > 0) {
-      sendWifiBatch();
-    }
-  #endif
+  // Sensor read, status line, WiFi batch etc. wait for the quiet end of my TX slot
+  housekeepingDone = false;
   
-  uint32_t yieldCounter = 0;
-  while ((micros() - procStart) < Tprocessing_us) {
-    delayMicroseconds(100);
-    yieldCounter++;
-    if (yieldCounter >= 10) {
-      yield();
-      yieldCounter = 0;
-    }
+  // No radio activity for the rest of the processing phase. Still joining, my grid is not the
+  // network's yet: a synced neighbour may be sending right now, the radio keeps listening
+  if (joinListening()) {
+    listenUntilSlot(0);
+  } else {
+    radioIdleUntil(slotStartUs(0));
   }
   
   #ifdef VERBOSE
@@ -3451,94 +5413,37 @@ void loop() {
   #endif
   
   
-  // ========== RX PHASE 1: Listen BEFORE my TX slot ==========
-  unsigned long rxPhase1Start = micros();
-  long Tduration_us = (long)myInfo.slotIndex * Tslot_us;
-  long Tremaining_us = Tduration_us;
-  
-  
-  while (Tremaining_us > 0) {
-    uint32_t timeout_ms = calcTimeoutMs(Tremaining_us);
-    if (timeout_ms == 0) break;
+  // ========== RX PHASE 1 + TX PHASE, once per slot I own (extra slots, SLOT_EXTRA_MAX) ==========
+  // None while slot selection is listening or the node is still joining: RX phase 2 then covers the whole frame
+  // The contention slot joins them when something waits for it (CONTENTION_SLOT_ENABLE)
+  uint8_t txSlots[2 + SLOT_EXTRA_MAX];
+  uint8_t txSlotCount = joinListening() ? 0 : mySlotsInOrder(txSlots);
+  txSlotCount = contentionAddSlot(txSlots, txSlotCount);
+  for (uint8_t t = 0; t < txSlotCount; t++) {
+    // ========== RX PHASE 1: Listen BEFORE my TX slot ==========
+    listenUntilSlot(txSlots[t]);
     
-    
-    yield();
-    
-    rxOutput = responder(timeout_ms);
-    
-    // TIMING SYNCHRONIZATION (LoRaQuake algorithm)
-    if (rxOutput.adjustTiming && rxOutput.senderSlot != 255) {
-      uint32_t syncStart = micros();
-      int slotsRemaining;
-      const char* syncCase;
-      
-      if (myInfo.slotIndex > rxOutput.senderSlot) {
-        // Case 1: mySlot > senderSlot
-        slotsRemaining = modulo(myInfo.slotIndex - rxOutput.senderSlot - 1, Nslot);
-        Tremaining_us = (long)slotsRemaining * Tslot_us + slotOffset_us;
-        syncCase = "CASE1_NORMAL";
-      } else {
-        // Case 2: mySlot <= senderSlot (wrap-around)
-        slotsRemaining = modulo(myInfo.slotIndex - rxOutput.senderSlot - 1, Nslot);
-        Tremaining_us = (long)slotsRemaining * Tslot_us + slotOffset_us + Tprocessing_us;
-        syncCase = "CASE2_WRAPAROUND";
-      }
-      
-      uint32_t syncDuration = micros() - syncStart;
-      
+    // ========== TX PHASE ==========
+    if (txSlots[t] == contentionSlot() && !isMySlot(txSlots[t])) {
+      contendInSlot(txSlots[t]);
     } else {
-      Tremaining_us = Tduration_us - (long)(micros() - rxPhase1Start);
+      transmitInSlot(txSlots[t]);
     }
   }
   
-  uint32_t rxPhase1Duration = micros() - rxPhase1Start;
-  
-  
-  // ========== TX PHASE ==========
-  unsigned long txPhaseStart = micros();
-  
-  
-  delayMicroseconds(TtxDelay_us);
-  
-  transmitUnifiedPacket();
-  
-  // Wait remaining slot time
-  unsigned long txElapsed = micros() - txPhaseStart;
-  if (txElapsed < Tslot_us) {
-    delayMicroseconds(Tslot_us - txElapsed);
-  }
-  
-  uint32_t txPhaseDuration = micros() - txPhaseStart;
-  
   
-  // ========== RX PHASE 2: Listen AFTER my TX slot ==========
-  unsigned long rxPhase2Start = micros();
-  Tduration_us = (long)(Nslot - myInfo.slotIndex - 1) * Tslot_us;
-  Tremaining_us = Tduration_us;
+  // ========== RX PHASE 2: Listen AFTER my last TX slot ==========
+  listenUntilSlot(Nslot);
   
-  
-  while (Tremaining_us > 0) {
-    uint32_t timeout_ms = calcTimeoutMs(Tremaining_us);
-    if (timeout_ms == 0) break;
-    
-    
-    yield();
-    
-    rxOutput = responder(timeout_ms);
-    
-    // TIMING SYNCHRONIZATION (Phase 2)
-    if (rxOutput.adjustTiming && rxOutput.senderSlot != 255) {
-      int slotsRemaining = Nslot - rxOutput.senderSlot - 1;
-      Tremaining_us = (long)slotsRemaining * Tslot_us + slotOffset_us;
-      
-    } else {
-      Tremaining_us = Tduration_us - (long)(micros() - rxPhase2Start);
-    }
+  // No TX slot with room to spare this frame: housekeeping takes the next processing phase,
+  // up to what the phase itself needs before slot 0. A joining node listens through it instead
+  // (nothing to report yet).
+  if (!housekeepingDone && !joinListening() &&
+      !housekeepingRun(slotStartUs(Nslot) + Tprocessing_us - TPROCESSING_MIN_US)) {
+    housekeepingSkipped++;
   }
   
-  
-  // Ra01S: Put radio to sleep for power saving (optional)
-  // No explicit sleep function in Ra01S, radio stays in RX mode
+  // Ra01S: radio sleeps through the processing phase (radioIdleFor), see RADIO_SLEEP_ENABLE
   
   #ifdef VERBOSE
     unsigned long totalCycleTime = micros() - cycleStart;
@@ -24,7 +24,7 @@
 // ============= NODE CONFIGURATION =============
 #define DEVICE_ID 1              // ⚠️ CHANGE THIS: Unique ID for each node (1-255)
 #define IS_REFERENCE 0           // 1 for reference node, 0 for regular node
-#define FIX_SLOT 1               // 1 to use fixed slot, 0 for auto-assign
+#define FIX_SLOT 1               // 1 to use fixed slot, 0 for distributed selection (SLOT_SELECT_*)
 #define SLOT_DEVICE 1            // Slot number if FIX_SLOT = 1
 
 // ============= HARDWARE PIN DEFINITIONS =============
@@ -42,6 +42,23 @@
 #define LORA_TXEN 26
 #define LORA_RXEN 27
 
+// 1 = RX/TX completion via DIO1 interrupt (task blocks, no SPI polling)
+// 0 = legacy GetIrqStatus() polling with 1 ms sleeps
+#define LORA_USE_DIO1_IRQ 1
+
+// 1 = RX windows closed by the radio's own timer (SetRx timeout, 15.625 us steps)
+// 0 = continuous RX, window measured by the MCU in whole milliseconds
+#define LORA_USE_HW_RX_TIMEOUT 1
+
+// Radio power manager: warm-start sleep (config retained) whenever the
+// schedule has no RX/TX for this node, e.g. processing phase, rest of own slot
+#define RADIO_SLEEP_ENABLE 1
+#define RADIO_SLEEP_MIN_US 5000          // shorter gaps stay in standby
+#define RADIO_WAKEUP_BUDGET_US 1000      // woken this early before the next RX/TX (warm start ~0.35 ms, see RADIO_STATS)
+
+// SX1262 SPI clock in Hz (chip maximum 16 MHz, driver clamps above that)
+#define LORA_SPI_FREQ_HZ 8000000
+
 // Encoder pins
 #define ENCODER_SW 25
 #define ENCODER_A 33
@@ -64,28 +81,47 @@
 // Preamble Length
 #define LORA_PREAMBLE_LENGTH 8
 
+// Frame format as sent on air: Send() always uses an explicit header, CRC is on
+#define LORA_IMPLICIT_HEADER false
+#define LORA_CRC_ON true
+
 // Legacy timeout values (ms)
 #define RX_TIMEOUT_VALUE 3000
 #define TX_TIMEOUT_VALUE 5000
 
-// TDMA slots
-const uint8_t Nslot = 8;
+// TDMA slots: default slot count. The live frame geometry (Nslot, Tslot_us, Tprocessing_us)
+// is runtime: loaded from EEPROM and switched network-wide by the gateway, see SET_FRAME
+#define NSLOT_DEFAULT 8
+#define NSLOT_MAX     32      // per-slot array size; the beacon carries slot numbers in 6 bits
+
+static_assert(NSLOT_DEFAULT >= 2 && NSLOT_DEFAULT <= NSLOT_MAX, "NSLOT_DEFAULT out of range");
+static_assert(NSLOT_MAX <= 64, "slot numbers are 6 bits in the beacon");
 
 // Measured timing components (microseconds)
-#define TX_PREPARE_TIME_US      850     // writeBuffer + setTx (measured)
-#define TX_ONAIR_TIME_US        98000   // LoRa air time (theoretical)
+#define TX_PREPARE_TIME_US      850     // writeBuffer + setTx (measured at 2 MHz SPI, see RADIO_STATS)
+#define TX_ONAIR_TIME_US        SX126xTimeOnAirUs(LORA_SPREADING_FACTOR, LORA_BANDWIDTH, LORA_CODINGRATE, \
+                                                  LORA_PREAMBLE_LENGTH, FIXED_PACKET_LENGTH, \
+                                                  LORA_IMPLICIT_HEADER, LORA_CRC_ON)  // LoRa air time (Semtech formula)
 #define TX_CALLBACK_TIME_US     100     // Callback processing
 #define TX_GUARD_TIME_US        5000    // Channel clear safety
 #define TX_MODE_SWITCH_US       500     // Mode change overhead
 
-#define RX_SETUP_TIME_US        350     // setRx() duration
+#define RX_SETUP_TIME_US        350     // setRx() duration (see RADIO_STATS)
 #define RX_CALLBACK_TIME_US     200     // RX done callback
 #define RX_PROCESS_MAX_US       2000    // processRxPacket() worst case
 #define RX_MODE_SWITCH_US       350     // Mode change
 
 #define PROC_NEIGHBOR_US        1500    // updateNeighbourStatus()
-#define PROC_DISPLAY_US         30000   // updateDisplay() worst case
+#define PROC_DISPLAY_US         30000   // updateDisplay() worst case (display task, core 0)
 #define PROC_MISC_US            500     // Misc calculations
+#define PROC_GUARD_US           5000    // Serial command check + radio wake ahead of slot 0
+
+// Deferred housekeeping (sensor read, status line, WiFi batch, drift check) runs in the
+// idle rest of my TX slot once the packet is out, if at least this much of the slot is left.
+// Otherwise (no slot yet, short TSLOT_AUTO slots) it falls back to the processing phase, with
+// the same budget; a frame with room in neither skips it (STATUS counts skips and overruns).
+// SET_FRAME refuses a geometry with room in neither (frameGeometryCheck).
+#define HOUSEKEEPING_MIN_US     150000  // AHT read ~80 ms + status line over serial
 
 // Total measured ToA
 #define MEASURED_TOA_US         (TX_PREPARE_TIME_US + TX_ONAIR_TIME_US + \
@@ -97,7 +133,7 @@ const uint8_t Nslot = 8;
 #define EFFECTIVE_TOA_US        ((uint32_t)(MEASURED_TOA_US * TOA_SAFETY_FACTOR))
 
 // For legacy compatibility
-#define CALCULATED_TOA_MS       98
+#define CALCULATED_TOA_MS       ((TX_ONAIR_TIME_US + 999) / 1000)
 #define EFFECTIVE_TOA_MS        ((EFFECTIVE_TOA_US + 500) / 1000)
 
 // ============= PACKET STRUCTURE =============
@@ -113,34 +149,350 @@ const uint8_t Nslot = 8;
 #define MIN_RSSI_THRESHOLD -100  // Prefer nodes with RSSI > -100
 
 // ============= TDMA TIMING PARAMETERS (MICROSECONDS) =============
-const uint32_t Tslot_us = 500000UL;              // 500ms per slot
-const uint32_t Tprocessing_us = 500000UL;        // 500ms processing phase (extended for WiFi batch sending)
+const uint32_t TPROCESSING_DEFAULT_US = 200000UL;  // 200ms processing phase (room for housekeeping without a TX slot)
 const uint32_t Tpacket_us = EFFECTIVE_TOA_US;    // Effective packet time
 const uint32_t TtxDelay_us = 5000UL;             // 5ms pre-TX delay
 const uint32_t TrxDelay_us = 2000UL;             // 2ms pre-RX delay
 
-const uint32_t Tperiod_us = (uint32_t)Nslot * Tslot_us;
+// Shortest slot that still holds pre-TX delay + packet + pre-RX delay (slotOffset_us >= 0)
+const uint32_t TSLOT_MIN_US = TtxDelay_us + Tpacket_us + TrxDelay_us;
 
-// ╔═══════════════════════════════════════════════════════════════════════════╗
-// ║  CRITICAL: DO NOT MODIFY THIS FORMULA                                    ║
-// ║  slotOffset verified identical to LoRaQuake implementation                ║
-// ╚═══════════════════════════════════════════════════════════════════════════╝
-const uint32_t slotOffset_us = Tslot_us - Tpacket_us - TtxDelay_us - TrxDelay_us;
+// Shortest processing phase: neighbour update + misc + guard (measured, see PROC_*_US).
+// The display is drawn by its own task on core 0 and no longer counts here.
+#define TPROCESSING_MIN_US      (PROC_NEIGHBOR_US + PROC_MISC_US + PROC_GUARD_US)
+
+// Default slot length (a node without a stored geometry starts with it):
+// 1 = use TSLOT_MIN_US rounded up to 10 ms, 0 = fixed 500 ms slot
+#define TSLOT_AUTO 0
+
+#if TSLOT_AUTO == 1
+const uint32_t TSLOT_DEFAULT_US = ((TSLOT_MIN_US + 9999UL) / 10000UL) * 10000UL;
+#else
+const uint32_t TSLOT_DEFAULT_US = 500000UL;      // 500ms per slot
+#endif
+
+// The geometry travels in ms (beacon, EEPROM)
+static_assert(TSLOT_DEFAULT_US % 1000 == 0 && TPROCESSING_DEFAULT_US % 1000 == 0,
+              "default frame geometry must be whole milliseconds");
+static_assert(TSLOT_DEFAULT_US >= TSLOT_MIN_US, "TSLOT_DEFAULT_US too short for the LoRa parameters, see TSLOT_MIN_US");
+static_assert(TPROCESSING_DEFAULT_US >= TPROCESSING_MIN_US + HOUSEKEEPING_MIN_US,
+              "TPROCESSING_DEFAULT_US too short to hold housekeeping when the TX slot has no room");
+static_assert(TX_ONAIR_TIME_US > 0, "unsupported LORA_BANDWIDTH");
+
+// The radio wakes RADIO_WAKEUP_BUDGET_US before the next slot edge (radioIdleUntil); even in
+// the shortest slot that falls in the pre-RX delay after the packet, not on the air
+static_assert(RADIO_WAKEUP_BUDGET_US < TrxDelay_us, "radio wake-up must fit in TrxDelay_us");
+
+// Gateway's SET_FRAME takes effect this many frames later on every node; the countdown
+// rides in the beacon and must outlast the network depth (one hop per frame at worst)
+#define FRAME_SWITCH_COUNTDOWN  16
+
+// Distributed slot selection (FIX_SLOT 0): a node stays silent for SLOT_SELECT_LISTEN_CYCLES
+// frames, then picks a random slot that is free in its two-hop slot map (its neighbours'
+// slots and the slots they list in their beacons). A slot found taken later starts a random
+// back-off, a node whose conflict outlasts it moves. The lower ID keeps the slot: its back-off
+// only starts after SLOT_BACKOFF_MAX_CYCLES, so it moves only if the rival never does. The
+// lower bound gives the neighbours' beacons time to show the move before the other side gives
+// up too. A conflict clears once the rival is gone SLOT_CONFLICT_CLEAR_CYCLES frames in a row.
+#define SLOT_SELECT_LISTEN_CYCLES   2
+#define SLOT_BACKOFF_MIN_CYCLES     2
+#define SLOT_BACKOFF_MAX_CYCLES     8
+#define SLOT_CONFLICT_CLEAR_CYCLES  3
+
+// Two neighbours that move into the same free slot in the same frame never hear each other
+// there, and no table lists the other on it. A neighbour heard every frame up to my move that
+// then misses SLOT_MOVE_SILENT_CYCLES frames in a row is taken for such a rival: a conflict on
+// my new slot, settled as above. With ADR_ENABLE or CH_HOP_ENABLE a neighbour on a slot not
+// known as its own is only heard on base cycles, so the limit is at least their interval.
+#define SLOT_MOVE_SILENT_CYCLES     2
+
+static_assert(SLOT_BACKOFF_MIN_CYCLES >= 2 && SLOT_BACKOFF_MIN_CYCLES <= SLOT_BACKOFF_MAX_CYCLES,
+              "slot back-off needs at least two frames for the tables to catch up");
+
+// Convergecast ordering (FIX_SLOT 0): instead of a random free slot a node takes the free
+// slot closest before its next hop's slot (wrapping around the frame), so deeper hops send
+// first and a reading climbs one hop per slot, gateway within one frame. When the route or
+// the parent's slot changes the node moves up to a closer free slot, once both held for
+// SLOT_REORDER_STABLE_CYCLES frames (a flapping route is not followed) plus a random wait of
+// up to SLOT_REORDER_HOLD_CYCLES, and at most once every SLOT_REORDER_HOLD_CYCLES..2x that
+// frames so the maps catch up. 0 = any free slot.
+#define SLOT_CONVERGECAST           1
+#define SLOT_REORDER_STABLE_CYCLES  3
+#define SLOT_REORDER_HOLD_CYCLES    8
+
+// Extra slots (FIX_SLOT 0): a node with a forwarding backlog takes one extra slot per
+// SLOT_EXTRA_QUEUE_STEP queued messages, up to SLOT_EXTRA_MAX, and sends one more frame in
+// each. Extra slots are picked from the two-hop map like the primary one (one per frame),
+// given back as the queue drains, and dropped at once on a conflict (then the random
+// back-off runs before the next pick). Beacons flag frames sent in an extra slot (byte 5
+// bit 7) and advertise the sender's one-hop slot occupancy.
+#define SLOT_EXTRA_MAX          3       // 0 = one slot per node
+#define SLOT_EXTRA_QUEUE_STEP   2
+
+static_assert(NSLOT_MAX <= 32, "slot occupancy is a 32-bit map in the beacon");
+
+// Network cycle: beacon byte 7 carries it in 5 bits, ADR and channel hopping key off it
+#define AUTO_SEND_INTERVAL_CYCLES 6
+
+// Reporting schedule: a node originates a reading every REPORT_PERIOD_DEFAULT frames, at a
+// phase hashed from its ID (golden-ratio hash, spreads any set of IDs evenly over the
+// period). SET_REPORT overrides both per node and keeps them in EEPROM. The schedule runs
+// on the network frame counter: the network cycle plus an epoch byte carried in no-data
+// beacons (byte 47), so it wraps every REPORT_FRAME_WRAP frames and a period must divide it.
+#define REPORT_PERIOD_DEFAULT   6       // frames (~27 s with the default geometry)
+#define REPORT_FRAME_WRAP       (AUTO_SEND_INTERVAL_CYCLES * 256)
+#define REPORT_PHASE_HASHED     0xFFFF  // stored phase: hash the node ID
+
+static_assert(AUTO_SEND_INTERVAL_CYCLES <= 32, "network cycle is 5 bits in the beacon");
+
+// Joining: a node that has not validated the network cycle yet listens through the whole
+// frame, no TX in its owned slot. After FAST_JOIN_LISTEN_FRAMES it announces itself in the
+// contention slot (CONTENTION_SLOT_ENABLE, once synced to the gateway); without a contention
+// slot it sends a beacon in its owned slot on one frame in FAST_JOIN_LISTEN_FRAMES (picked at
+// random), so a node that cannot validate still shows up. Fast join: the first no-data beacon
+// from an upstream neighbour synced to the gateway (stratum < STRATUM_LOCAL) carries the full
+// frame counter (cycle + epoch) and validates it at once, no sequential cycles needed. A
+// neighbour missing for FAST_JOIN_PARENT_MISS_CYCLES frames no longer counts for hop and
+// next-hop choice, long before MAX_INACTIVE_CYCLES drops it. 0 = CYCLE_VALIDATION_THRESHOLD
+// sequential cycles, beacons in the owned slot from boot, routing until the neighbour times out.
+#define FAST_JOIN_ENABLE                1
+#define FAST_JOIN_LISTEN_FRAMES         3
+#define FAST_JOIN_PARENT_MISS_CYCLES    3
+
+static_assert(FAST_JOIN_PARENT_MISS_CYCLES >= 2, "one lost beacon must not drop the parent");
+static_assert(REPORT_FRAME_WRAP % REPORT_PERIOD_DEFAULT == 0, "REPORT_PERIOD_DEFAULT must divide REPORT_FRAME_WRAP");
+
+// Live frame geometry, recomputed by frameGeometryDerive() whenever it changes
+uint8_t Nslot = NSLOT_DEFAULT;
+uint32_t Tslot_us = TSLOT_DEFAULT_US;
+uint32_t Tprocessing_us = TPROCESSING_DEFAULT_US;
+uint32_t Tperiod_us;
+uint32_t Tframe_us;                                // processing phase + all slots
+
+// CAD listening (needs LORA_USE_DIO1_IRQ for low MCU load), EXPERIMENTAL:
+// 1 = once synced, keep the radio in standby and only probe with CAD around the expected
+//     TX start of the slots taken in the two-hop slot map and of the contention slot; full
+//     RX opens on a detected preamble. All slots are probed every CAD_SCAN_ALL_FRAMES frames
+//     and in the frame after a known neighbour's slot stayed silent. Needs a longer preamble
+//     than the default (see the check below).
+// 0 = full RX through every foreign slot
+#define TDMA_CAD_LISTEN         0
+#define CAD_WINDOW_HALF_US      40000   // +/- around expected TX start (covers one hop of resync skew)
+#define CAD_SAMPLE_PERIOD_US    4000    // < preamble duration (8 symbols = 8.2 ms at SF7/BW125)
+#define CAD_SCAN_ALL_FRAMES     8       // all slots now and then, finds nodes that moved unnoticed
+
+static_assert(CAD_SAMPLE_PERIOD_US < LORA_PREAMBLE_LENGTH * SX126xSymbolTimeUs(LORA_SPREADING_FACTOR, LORA_BANDWIDTH),
+              "CAD sampling would step over a whole preamble");
+#if TDMA_CAD_LISTEN == 1
+// A preamble that starts just after a probe must still be caught by the next one: a sample
+// period, the CAD itself (2 symbols up to SF8, 4 above, see Ra01S) and the symbols the
+// receiver needs to lock on after CAD_GOTO_RX. At SF7 that is LORA_PREAMBLE_LENGTH >= 10.
+#define CAD_RX_LOCK_SYMBOLS     4
+static_assert(CAD_SAMPLE_PERIOD_US + (((LORA_SPREADING_FACTOR <= 8) ? 2 : 4) + CAD_RX_LOCK_SYMBOLS) *
+              SX126xSymbolTimeUs(LORA_SPREADING_FACTOR, LORA_BANDWIDTH) <=
+              LORA_PREAMBLE_LENGTH * SX126xSymbolTimeUs(LORA_SPREADING_FACTOR, LORA_BANDWIDTH),
+              "TDMA_CAD_LISTEN: preamble too short to be received after a CAD hit, raise LORA_PREAMBLE_LENGTH");
+#endif
+
+// Contention slot: the last slot of the frame is owned by nobody (slot selection skips it).
+// A node with something to announce contends for it slotted-ALOHA style: it picks one of
+// CONTENTION_MINISLOTS start offsets CONTENTION_MINISLOT_US apart, runs CAD just before and
+// sends its beacon (cmd CMD_CONTENTION) only on a clear channel. A busy channel means an
+// earlier contender won: back off 1..2^n frames, n growing up to CONTENTION_BACKOFF_MAX_EXP.
+// It carries join announcements (still joining, or validated without a slot), slot claims (picked or moved,
+// FIX_SLOT 0) and alarms (ALARM command), which are forwarded ahead of the queue. Frames sent
+// in it never resync the receivers' slot grid. With FIX_SLOT 1 no node may be set to the last
+// slot. 0 = every slot can be owned.
+#define CONTENTION_SLOT_ENABLE      0
+#define CONTENTION_MINISLOT_US      4000    // > CAD + TX ramp-up, < preamble
+#define CONTENTION_MINISLOTS        8
+#define CONTENTION_BACKOFF_MAX_EXP  3
+
+// What is waiting for the contention slot (bits of contentionPending)
+#define CONTENTION_JOIN             0x01
+#define CONTENTION_CLAIM            0x02
+#define CONTENTION_ALARM            0x04
+
+static_assert(CONTENTION_MINISLOT_US < LORA_PREAMBLE_LENGTH * SX126xSymbolTimeUs(LORA_SPREADING_FACTOR, LORA_BANDWIDTH),
+              "a later contender's CAD must still see the earlier one's preamble");
+static_assert((CONTENTION_MINISLOTS - 1) * CONTENTION_MINISLOT_US <= CAD_WINDOW_HALF_US,
+              "contention offsets must stay inside the CAD listening window");
+
+// Adaptive data rate, per link:
+// 1 = each node measures the SNR of every neighbour and reports back (in its beacon) the
+//     fastest profile it can hear that neighbour at with ADR_SNR_MARGIN_DB to spare. A node
+//     transmits with the fastest profile all its neighbours can hear, announced one cycle
+//     ahead; receivers switch modulation per slot. Every ADR_BASE_INTERVAL_CYCLES-th cycle
+//     all slots fall back to profile 0 so unsynced and joining nodes still hear everyone.
+// 0 = all slots on profile 0 (LORA_SPREADING_FACTOR / LORA_BANDWIDTH)
+#define ADR_ENABLE              0
+#define ADR_SNR_MARGIN_DB       10      // above the demodulator floor
+#define ADR_BASE_INTERVAL_CYCLES 3      // must divide AUTO_SEND_INTERVAL_CYCLES
+#define ADR_PROFILE_COUNT       4       // 2 bits in the beacon
+
+struct AdrProfile {
+  uint8_t spreadingFactor;
+  uint8_t bandwidth;
+  int8_t snrReqDb;      // SX1262 demodulator floor, in SNR measured at BW125
+  int8_t bwOffsetDb;    // SNR reported at this bandwidth + bwOffsetDb = SNR at BW125
+};
+
+constexpr AdrProfile adrProfiles[ADR_PROFILE_COUNT] = {
+  {7, SX126X_LORA_BW_125_0,  -7, 0},    // 0: base profile, every node listens to it
+  {7, SX126X_LORA_BW_250_0,  -4, 3},    // 1: half the air time
+  {7, SX126X_LORA_BW_500_0,  -1, 6},    // 2: quarter of the air time, strong links only
+  {8, SX126X_LORA_BW_125_0, -10, 0},    // 3: marginal links, ~1.8x the air time
+};
+
+constexpr uint32_t adrProfileToaUs(uint8_t profile) {
+  return SX126xTimeOnAirUs(adrProfiles[profile].spreadingFactor, adrProfiles[profile].bandwidth,
+                           LORA_CODINGRATE, LORA_PREAMBLE_LENGTH, FIXED_PACKET_LENGTH,
+                           LORA_IMPLICIT_HEADER, LORA_CRC_ON);
+}
+
+// Air time of a frame received on `profile` (the base modulation without ADR)
+constexpr uint32_t adrFrameToaUs(uint8_t profile) {
+  return ADR_ENABLE == 1 ? adrProfileToaUs(profile) : TX_ONAIR_TIME_US;
+}
+
+constexpr uint32_t adrMaxToaUs() {
+  uint32_t toa = 0;
+  for (uint8_t p = 0; p < ADR_PROFILE_COUNT; p++) {
+    if (adrProfileToaUs(p) > toa) toa = adrProfileToaUs(p);
+  }
+  return toa;
+}
+
+#if ADR_ENABLE == 1
+static_assert(LORA_SPREADING_FACTOR == 7 && LORA_BANDWIDTH == SX126X_LORA_BW_125_0,
+              "adrProfiles[0] must match the base LoRa parameters");
+static_assert(TtxDelay_us + adrMaxToaUs() + TrxDelay_us <= TSLOT_DEFAULT_US,
+              "slowest ADR profile does not fit in a slot");
+// Frame guard for the RX window backstop: the slowest profile's air time
+#define RX_FRAME_GUARD_MS       ((adrMaxToaUs() + 999) / 1000)
+#else
+#define RX_FRAME_GUARD_MS       CALCULATED_TOA_MS
+#endif
+
+// Channel hopping, TSCH-style (all nodes of a network must use the same list):
+// 1 = slot frequency is chHopChannels[(ASN + channel offset) % CH_HOP_CHANNEL_COUNT], with
+//     ASN the absolute slot number (network cycle * Nslot + slot) and the channel offset the
+//     slot owner's ID % CH_HOP_CHANNEL_COUNT. Nodes sharing a slot on different offsets no
+//     longer collide. Every CH_HOP_BASE_INTERVAL_CYCLES-th cycle all slots stay on
+//     chHopChannels[0] so unsynced and joining nodes (which never hop) still hear everyone.
+// 0 = all slots on RF_FREQUENCY
+#define CH_HOP_ENABLE           0
+#define CH_HOP_CHANNEL_COUNT    4
+#define CH_HOP_BASE_INTERVAL_CYCLES 3   // must divide AUTO_SEND_INTERVAL_CYCLES
+#define CH_HOP_SWITCH_US        300     // standby + SET_RF_FREQUENCY, no image calibration (see RADIO_STATS)
+
+constexpr uint32_t chHopChannels[CH_HOP_CHANNEL_COUNT] = {
+  RF_FREQUENCY,                 // home channel, base cycles and unsynced nodes
+  RF_FREQUENCY + 2000000UL,
+  RF_FREQUENCY + 4000000UL,
+  RF_FREQUENCY + 6000000UL,
+};
+
+constexpr bool chHopSingleCalBand() {
+  for (uint8_t c = 1; c < CH_HOP_CHANNEL_COUNT; c++) {
+    if (SX126xImageCalBand(chHopChannels[c]) != SX126xImageCalBand(chHopChannels[0])) return false;
+  }
+  return true;
+}
+
+#if CH_HOP_ENABLE == 1
+static_assert(chHopChannels[0] == RF_FREQUENCY, "chHopChannels[0] must be RF_FREQUENCY");
+static_assert(chHopSingleCalBand(), "hop channels must share one image calibration band");
+// Receivers retune at the slot boundary, before the owner's preamble at TtxDelay_us
+static_assert(CH_HOP_SWITCH_US + RX_SETUP_TIME_US < TtxDelay_us,
+              "channel switch does not fit in the pre-TX delay");
+#endif
+
+uint32_t slotOffset_us;
 
 // Legacy millisecond values for compatibility
-const uint32_t Tslot_ms = (Tslot_us + 500) / 1000;
-const uint32_t Tperiod_ms = (Tperiod_us + 500) / 1000;
-const uint32_t CYCLE_DURATION_MS = Tperiod_ms;  // For neighbor timeout calculation
-const uint32_t Tprocessing_ms = (Tprocessing_us + 500) / 1000;
+uint32_t Tslot_ms;
+uint32_t Tperiod_ms;
+uint32_t CYCLE_DURATION_MS;  // For neighbor timeout calculation
+uint32_t Tprocessing_ms;
 const uint32_t Tpacket_ms = (Tpacket_us + 500) / 1000;
 const uint32_t TtxDelay_ms = (TtxDelay_us + 500) / 1000;
 const uint32_t TrxDelay_ms = (TrxDelay_us + 500) / 1000;
-const uint32_t slotOffset_ms = (slotOffset_us + 500) / 1000;
+uint32_t slotOffset_ms;
+
+inline void frameGeometryDerive() {
+  Tperiod_us = (uint32_t)Nslot * Tslot_us;
+  Tframe_us = Tprocessing_us + Tperiod_us;
+  
+  // Slack of a slot: what is left after pre-TX delay, packet and pre-RX delay, i.e. how late
+  // a frame may start and still end inside the slot. Spreads the contention minislots
+  // (contendInSlot); SHOW_FRAME prints it. The slot grid itself only uses Tslot_us.
+  slotOffset_us = Tslot_us - Tpacket_us - TtxDelay_us - TrxDelay_us;
+  
+  Tslot_ms = (Tslot_us + 500) / 1000;
+  Tperiod_ms = (Tperiod_us + 500) / 1000;
+  CYCLE_DURATION_MS = Tperiod_ms;
+  Tprocessing_ms = (Tprocessing_us + 500) / 1000;
+  slotOffset_ms = (slotOffset_us + 500) / 1000;
+}
+
+// TX frame is built and written to the radio this long before my slot (RX phase 1),
+// so the slot start only issues SetTx. Must fall in the quiet tail of the previous
+// slot, after its packet has ended.
+#define TX_PRELOAD_LEAD_US      2000
+static_assert(TX_PRELOAD_LEAD_US + Tpacket_us + TtxDelay_us <= TSLOT_DEFAULT_US,
+              "TX preload would cut into the previous slot's packet");
+
+// Channel sampling: instantaneous RSSI at three points of every slot listened to in full RX
+// (not while CAD listening): idle (before any TX may start), expected preamble, and tail
+// (after the longest packet). Idle samples give the noise floor, a sample more than
+// NOISE_BUSY_MARGIN_DB above it counts as busy. Busy idle/tail points mean interference,
+// a busy preamble point with no frame received means a collision. See STATUS, WiFi NOISE.
+#define NOISE_SAMPLING_ENABLE   1
+#define NOISE_HISTORY_CYCLES    8       // ring buffer depth per slot
+#define NOISE_BUSY_MARGIN_DB    6
+#define NOISE_POINTS            3       // idle, preamble, tail
+#define NOISE_RSSI_NONE         127     // point not sampled that cycle
+
+constexpr uint32_t noisePointUs[NOISE_POINTS] = {
+  TtxDelay_us / 2,
+  TtxDelay_us + LORA_PREAMBLE_LENGTH * SX126xSymbolTimeUs(LORA_SPREADING_FACTOR, LORA_BANDWIDTH) / 2,
+  TtxDelay_us + ((Tpacket_us > RX_FRAME_GUARD_MS * 1000UL) ? Tpacket_us : RX_FRAME_GUARD_MS * 1000UL),
+};
+
+#if NOISE_SAMPLING_ENABLE == 1
+// RX phase 1 stops TX_PRELOAD_LEAD_US before my slot, the tail of the slot before must come first
+static_assert(noisePointUs[NOISE_POINTS - 1] + TX_PRELOAD_LEAD_US <= TSLOT_DEFAULT_US,
+              "tail sample point falls outside the slot");
+#endif
+
+// Shortest slot accepted at runtime (SET_FRAME, gateway announcement): every
+// constraint asserted on TSLOT_DEFAULT_US above
+constexpr uint32_t tslotFloorUs() {
+  uint32_t floorUs = TSLOT_MIN_US;
+  if (TX_PRELOAD_LEAD_US + Tpacket_us + TtxDelay_us > floorUs) floorUs = TX_PRELOAD_LEAD_US + Tpacket_us + TtxDelay_us;
+  #if ADR_ENABLE == 1
+    if (TtxDelay_us + adrMaxToaUs() + TrxDelay_us > floorUs) floorUs = TtxDelay_us + adrMaxToaUs() + TrxDelay_us;
+  #endif
+  #if NOISE_SAMPLING_ENABLE == 1
+    if (noisePointUs[NOISE_POINTS - 1] + TX_PRELOAD_LEAD_US > floorUs) floorUs = noisePointUs[NOISE_POINTS - 1] + TX_PRELOAD_LEAD_US;
+  #endif
+  return floorUs;
+}
+
+struct SlotNoiseStats {
+  int8_t rssi[NOISE_HISTORY_CYCLES][NOISE_POINTS];   // dBm, NOISE_RSSI_NONE if not sampled
+  uint8_t head;                                       // entry of the cycle being sampled
+  uint16_t cycle;                                     // noiseCycle that entry belongs to
+};
 
 // ============= TIMING SYNCHRONIZATION =============
 struct ResponderOutput {
   uint8_t senderSlot = 255;
+  uint16_t senderId = 0;     // Node the sync frame came from
   bool adjustTiming = false;
+  int64_t rxDoneUs = 0;      // esp_timer_get_time() at RX_DONE of the sync frame
+  uint8_t rxProfile = 0;     // ADR profile the sync frame was demodulated on
 };
 
 // ╔═══════════════════════════════════════════════════════════════════════════╗
@@ -150,11 +502,9 @@ inline int modulo(int x, int y) {
   return x < 0 ? ((x + 1) % y) + y - 1 : x % y;
 }
 
-inline uint32_t calcTimeoutMs(int32_t remaining_us) {
+inline uint32_t calcTimeoutUs(int32_t remaining_us) {
   if (remaining_us <= 0) return 0;
-  int32_t capped_us = (remaining_us > (int32_t)Tslot_us) ? (int32_t)Tslot_us : remaining_us;
-  uint32_t timeout_ms = (capped_us + 500) / 1000;
-  return (timeout_ms > 0) ? timeout_ms : 1;
+  return (remaining_us > (int32_t)Tslot_us) ? Tslot_us : (uint32_t)remaining_us;
 }
 
 // ============= NETWORK PARAMETERS =============
@@ -171,7 +521,11 @@ inline uint32_t calcTimeoutMs(int32_t remaining_us) {
 #define TIMESTAMP_SIZE_BYTES 8           // 64-bit timestamp (microseconds since epoch)
 
 #define MAX_NEIGHBOURS 10
+static_assert(MAX_NEIGHBOURS <= 32, "slotMoveHeard has one bit per neighbour table entry");
 #define MAX_INACTIVE_CYCLES 5
+static_assert(SLOT_MOVE_SILENT_CYCLES < MAX_INACTIVE_CYCLES && ADR_BASE_INTERVAL_CYCLES < MAX_INACTIVE_CYCLES &&
+              CH_HOP_BASE_INTERVAL_CYCLES < MAX_INACTIVE_CYCLES,
+              "a neighbour that moved with me must show as silent before it times out");
 #define PROBABILITY_INITIATOR 100
 
 // ============= WIFI =============
@@ -204,6 +558,29 @@ inline uint32_t calcTimeoutMs(int32_t remaining_us) {
 // ESP32 Timer error is typically ±1μs
 #define TIMER_ERROR_MARGIN_US 1          // Timer interrupt accuracy
 
+// TDMA scheduler: the hardware timer wakes the loop task this long before a slot edge,
+// the rest is spun on esp_timer_get_time() (covers ISR latency + task switch)
+#define TDMA_WAKE_SPIN_US 100
+
+// A TX that would start more than this after its slot edge (a resync moved the edge behind
+// me) is dropped for the frame rather than sent late
+#define TDMA_TX_LATE_MAX_US 2000
+
+// Slot clock discipline: each resync still puts the grid on the heard edge (LoRaQuake
+// resync), and the step it takes is my phase error against the slot edges I hear. Steps
+// summed between two edges of my sync parent give the residual rate error of my slot
+// clock: my crystal against the parent's. A PI loop (integral gain 1/2^CLOCK_FREQ_GAIN_SHIFT)
+// tracks it and stretches every predicted slot edge by it, so frames without a resync keep
+// up with the network instead of falling behind by the whole rate error. Other upstream
+// senders move the phase but never the rate. A step above CLOCK_STEP_MAX_US (first lock,
+// frame wrap, far off grid) or a new parent restarts the estimate. STATUS shows the rate and
+// the phase errors; size TX_GUARD_TIME_US and TOA_SAFETY_FACTOR from the worst one.
+// 0 = the grid only jumps on each resync.
+#define CLOCK_DISCIPLINE_ENABLE 1
+#define CLOCK_FREQ_GAIN_SHIFT   2         // integral gain 1/4
+#define CLOCK_STEP_MAX_US       10000     // resync steps are the drift since the last one, larger ones are jumps
+#define CLOCK_FREQ_MAX_PPB      500000    // +/-500 ppm, crystal pairs are within +/-100
+
 // Time drift compensation
 #define ENABLE_DRIFT_COMPENSATION 0      // Disabled (WiFi reconnect interferes with TDMA)
 #define DRIFT_CHECK_INTERVAL_MS 3600000  // Re-sync NTP every 1 hour (reset drift)
@@ -270,6 +647,21 @@ struct NeighbourInfo {
   
   int16_t rssi = 0;
   int8_t snr = 0;
+  
+  // Adaptive data rate (ADR_ENABLE), profile indices into adrProfiles[]
+  bool adrSnrValid = false;
+  int8_t adrSnrDb = 0;               // Smoothed SNR of this neighbour's frames (BW125 terms)
+  uint8_t adrRxProfile = 0;          // Fastest profile I hear this neighbour at (sent back in my beacon)
+  uint8_t adrReportedProfile = 0;    // Fastest profile this neighbour hears me at (from its beacon)
+  uint8_t adrTxProfile = 0;          // Profile this neighbour transmits with this cycle
+  uint8_t adrTxProfileNext = 0;      // Announced for the next cycle
+  
+  // Slot allocation: extra slots heard this and last frame, and the one-hop slot
+  // occupancy it advertises (bit per slot)
+  uint32_t extraSlots = 0;
+  uint32_t extraSlotsPrev = 0;
+  uint32_t occupiedSlots = 0;
+  
   bool isDistanceMeasured = false;
   uint8_t activityCounter = 0;
   bool isBidirectional = false;  // Bidirectional link confirmed
@@ -303,6 +695,7 @@ const uint8_t CMD_ID_AND_POS = 0x00;
 const uint8_t CMD_MESSAGE = 0x01;
 const uint8_t CMD_SYNC_REQUEST = 0x02;
 const uint8_t CMD_SYNC_RESPONSE = 0x03;
+const uint8_t CMD_CONTENTION = 0x04;     // Beacon sent in the contention slot (CONTENTION_SLOT_ENABLE)
 
 inline int mod(int x, int y) {
   return x < 0 ? ((x + 1) % y) + y - 1 : x % y;
@@ -0,0 +1,14 @@
+// Temperature/humidity sensor: a slow random walk per node
+#pragma once
+#include "Arduino.h"
+
+typedef struct {
+  float temperature;
+  float relative_humidity;
+} sensors_event_t;
+
+class Adafruit_AHTX0 {
+  public:
+    bool begin(TwoWire *wire = nullptr, int32_t sensorId = 0, uint8_t i2cAddr = 0x38) { return true; }
+    bool getEvent(sensors_event_t *humidity, sensors_event_t *temp);
+};
@@ -0,0 +1,3 @@
+// Nothing is drawn in the simulator, the display only swallows text
+#pragma once
+#include "Arduino.h"
@@ -0,0 +1,16 @@
+// Battery monitor: a slowly discharging 2S pack
+#pragma once
+#include "Arduino.h"
+
+class Adafruit_INA219 {
+  public:
+    Adafruit_INA219(uint8_t addr = 0x40) {}
+    bool begin(TwoWire *wire = nullptr) { return true; }
+    void setCalibration_32V_2A() {}
+    void setCalibration_32V_1A() {}
+    void setCalibration_16V_400mA() {}
+    float getBusVoltage_V();
+    float getShuntVoltage_mV() { return 0.0f; }
+    float getCurrent_mA() { return 0.0f; }
+    float getPower_mW() { return 0.0f; }
+};
@@ -0,0 +1,289 @@
+// Arduino-ESP32 core API as seen by the firmware inside the simulator.
+// Only declarations live here: the simulator binary implements them for whichever
+// virtual node is running (src/arduino.cpp, src/freertos.cpp, src/wifi.cpp).
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <string>
+
+// ---------------------------------------------------------------------------
+// ESP32 is ILP32: long is 32 bits and "%lu" is how the firmware prints a uint32_t.
+// On an LP64 host such an argument may sit in a half-written 8-byte stack slot, so the
+// printf family used by the firmware drops the 'l' length modifier before libc sees it.
+// ---------------------------------------------------------------------------
+int sim_vsnprintf(char *buf, size_t size, const char *fmt, va_list args);
+int sim_snprintf(char *buf, size_t size, const char *fmt, ...);
+int sim_sprintf(char *buf, const char *fmt, ...);
+int sim_gettimeofday(struct timeval *tv, void *tz);
+#define vsnprintf sim_vsnprintf
+#define snprintf sim_snprintf
+#define sprintf sim_sprintf
+#define gettimeofday(tv, tz) sim_gettimeofday(tv, tz)
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define PROGMEM
+#define F(s) (s)
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define PULLUP 0x04
+#define INPUT_PULLUP 0x05
+#define PULLDOWN 0x08
+#define INPUT_PULLDOWN 0x09
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef bool boolean;
+typedef uint8_t byte;
+using std::min;
+using std::max;
+
+// ---------------------------------------------------------------------------
+// Core
+// ---------------------------------------------------------------------------
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+#define digitalPinToInterrupt(p) ((int)(p))
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void attachInterruptArg(uint8_t pin, void (*isr)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+void noInterrupts();
+void interrupts();
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+uint32_t esp_random(void);
+
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char *server1,
+                const char *server2 = nullptr, const char *server3 = nullptr);
+
+class EspClass {
+  public:
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getCpuFreqMHz() { return 240; }
+};
+extern EspClass ESP;
+
+// ---------------------------------------------------------------------------
+// String (the subset the firmware uses, on top of std::string)
+// ---------------------------------------------------------------------------
+class String {
+  public:
+    String() {}
+    String(const char *s) : s_(s ? s : "") {}
+    String(const std::string &s) : s_(s) {}
+    explicit String(char c) : s_(1, c) {}
+    String(int v, unsigned char base = DEC) : s_(fmt((long long)v, base)) {}
+    String(unsigned int v, unsigned char base = DEC) : s_(fmt((unsigned long long)v, base)) {}
+    String(long v, unsigned char base = DEC) : s_(fmt((long long)v, base)) {}
+    String(unsigned long v, unsigned char base = DEC) : s_(fmt((unsigned long long)v, base)) {}
+    String(float v, unsigned int decimals = 2) : s_(fmt((double)v, decimals)) {}
+    String(double v, unsigned int decimals = 2) : s_(fmt(v, decimals)) {}
+
+    const char *c_str() const { return s_.c_str(); }
+    unsigned int length() const { return (unsigned int)s_.size(); }
+    char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+
+    int indexOf(char c, unsigned int from = 0) const { return pos(s_.find(c, from)); }
+    int indexOf(const char *t, unsigned int from = 0) const { return pos(s_.find(t, from)); }
+    int indexOf(const String &t, unsigned int from = 0) const { return pos(s_.find(t.s_, from)); }
+    int lastIndexOf(char c) const { return pos(s_.rfind(c)); }
+    String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+      if (to > s_.size()) to = (unsigned int)s_.size();
+      return from < to ? String(s_.substr(from, to - from)) : String();
+    }
+    bool startsWith(const String &p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+    bool endsWith(const String &p) const {
+      return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+    }
+    bool equals(const String &o) const { return s_ == o.s_; }
+    bool equalsIgnoreCase(const String &o) const {
+      return s_.size() == o.s_.size() &&
+             std::equal(s_.begin(), s_.end(), o.s_.begin(), [](char a, char b) { return tolower(a) == tolower(b); });
+    }
+    void trim() {
+      size_t b = s_.find_first_not_of(" \t\r\n");
+      size_t e = s_.find_last_not_of(" \t\r\n");
+      s_ = (b == std::string::npos) ? std::string() : s_.substr(b, e - b + 1);
+    }
+    void toUpperCase() { for (auto &c : s_) c = (char)toupper((unsigned char)c); }
+    void toLowerCase() { for (auto &c : s_) c = (char)tolower((unsigned char)c); }
+    long toInt() const { return atol(s_.c_str()); }
+    float toFloat() const { return (float)atof(s_.c_str()); }
+
+    bool operator==(const String &o) const { return s_ == o.s_; }
+    bool operator==(const char *o) const { return s_ == (o ? o : ""); }
+    bool operator!=(const String &o) const { return s_ != o.s_; }
+    bool operator!=(const char *o) const { return !(*this == o); }
+    String &operator+=(const String &o) { s_ += o.s_; return *this; }
+    String &operator+=(const char *o) { s_ += (o ? o : ""); return *this; }
+    String &operator+=(char c) { s_ += c; return *this; }
+    friend String operator+(const String &a, const String &b) { return String(a.s_ + b.s_); }
+    friend String operator+(const String &a, const char *b) { return String(a.s_ + (b ? b : "")); }
+    friend String operator+(const char *a, const String &b) { return String((a ? a : "") + b.s_); }
+
+  private:
+    static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+    static std::string fmt(long long v, unsigned char base) {
+      if (base == DEC) return std::to_string(v);
+      return fmt((unsigned long long)v, base);
+    }
+    static std::string fmt(unsigned long long v, unsigned char base) {
+      if (base < 2) base = 10;
+      std::string out;
+      do { out.insert(out.begin(), "0123456789ABCDEF"[v % base]); v /= base; } while (v);
+      return out;
+    }
+    static std::string fmt(double v, unsigned int decimals) {
+      char buf[64];
+      ::snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+      return buf;
+    }
+    std::string s_;
+};
+
+// ---------------------------------------------------------------------------
+// Print / Serial
+// ---------------------------------------------------------------------------
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(const uint8_t *buf, size_t size) = 0;
+    // True when nothing reads this output, so formatting can be skipped
+    virtual bool discards() { return false; }
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+
+    size_t printf(const char *fmt, ...);
+
+    size_t print(const char *s);
+    size_t print(const String &s);
+    size_t print(char c);
+    size_t print(unsigned char v, int base = DEC);
+    size_t print(int v, int base = DEC);
+    size_t print(unsigned int v, int base = DEC);
+    size_t print(long v, int base = DEC);
+    size_t print(unsigned long v, int base = DEC);
+    size_t print(long long v, int base = DEC);
+    size_t print(unsigned long long v, int base = DEC);
+    size_t print(double v, int digits = 2);
+
+    size_t println();
+    template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+    template <typename T> size_t println(T v, int f) { size_t n = print(v, f); return n + println(); }
+};
+
+class HardwareSerial : public Print {
+  public:
+    void begin(unsigned long baud);
+    void end() {}
+    int available();
+    int read();
+    int peek();
+    void flush() {}
+    size_t write(const uint8_t *buf, size_t size) override;
+    bool discards() override;
+    using Print::write;
+    operator bool() const { return true; }
+};
+extern HardwareSerial Serial;
+
+// ---------------------------------------------------------------------------
+// FreeRTOS (1 kHz tick as on the ESP32 Arduino core)
+// ---------------------------------------------------------------------------
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef void *QueueHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define configTICK_RATE_HZ 1000
+#define tskIDLE_PRIORITY 0
+#define portYIELD_FROM_ISR(...) ((void)0)
+
+typedef struct { int owner; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+inline void portENTER_CRITICAL(portMUX_TYPE *) {}
+inline void portEXIT_CRITICAL(portMUX_TYPE *) {}
+inline void portENTER_CRITICAL_ISR(portMUX_TYPE *) {}
+inline void portEXIT_CRITICAL_ISR(portMUX_TYPE *) {}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t increment);
+TickType_t xTaskGetTickCount();
+void vTaskDelete(TaskHandle_t task);
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks);
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken);
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+BaseType_t xQueueReset(QueueHandle_t q);
+#define xQueueSendToBack xQueueSend
+
+// ---------------------------------------------------------------------------
+// Hardware timer (Arduino-ESP32 3.x API)
+// ---------------------------------------------------------------------------
+typedef struct hw_timer_s hw_timer_t;
+hw_timer_t *timerBegin(uint32_t frequency);
+void timerEnd(hw_timer_t *timer);
+void timerAttachInterrupt(hw_timer_t *timer, void (*isr)(void));
+void timerDetachInterrupt(hw_timer_t *timer);
+void timerAlarm(hw_timer_t *timer, uint64_t alarmValue, bool autoreload, uint64_t reloadCount);
+void timerWrite(hw_timer_t *timer, uint64_t value);
+uint64_t timerRead(hw_timer_t *timer);
+void timerStart(hw_timer_t *timer);
+void timerStop(hw_timer_t *timer);
+
+#include "esp_timer.h"
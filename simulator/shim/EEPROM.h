@@ -0,0 +1,13 @@
+// Emulated flash EEPROM, kept per node across reboots
+#pragma once
+#include "Arduino.h"
+
+class EEPROMClass {
+  public:
+    bool begin(size_t size);
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    bool commit();
+    size_t length();
+};
+extern EEPROMClass EEPROM;
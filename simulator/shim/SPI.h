@@ -0,0 +1,34 @@
+// SPI master wired to the simulated SX1262 of the running node
+#pragma once
+#include "Arduino.h"
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+#define SPI_MODE0 0
+#define SPI_MODE1 1
+#define SPI_MODE2 2
+#define SPI_MODE3 3
+
+class SPISettings {
+  public:
+    SPISettings() : clock(1000000), bitOrder(MSBFIRST), dataMode(SPI_MODE0) {}
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode)
+      : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+    uint32_t clock;
+    uint8_t bitOrder;
+    uint8_t dataMode;
+};
+
+class SPIClass {
+  public:
+    void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1);
+    void end() {}
+    void setFrequency(uint32_t freq);
+    void beginTransaction(SPISettings settings);
+    void endTransaction();
+    uint8_t transfer(uint8_t data);
+    void transfer(void *data, uint32_t size) { transferBytes((const uint8_t *)data, (uint8_t *)data, size); }
+    void writeBytes(const uint8_t *data, uint32_t size);
+    void transferBytes(const uint8_t *data, uint8_t *out, uint32_t size);
+};
+extern SPIClass SPI;
@@ -0,0 +1,49 @@
+// WiFi station: associates with the simulated access point a moment after begin()
+#pragma once
+#include "Arduino.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3
+} wifi_mode_t;
+
+class IPAddress {
+  public:
+    IPAddress() : addr_(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+      : addr_((uint32_t)a << 24 | (uint32_t)b << 16 | (uint32_t)c << 8 | d) {}
+    String toString() const {
+      char buf[16];
+      ::snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (unsigned)(addr_ >> 24), (unsigned)(addr_ >> 16 & 0xFF),
+                 (unsigned)(addr_ >> 8 & 0xFF), (unsigned)(addr_ & 0xFF));
+      return String(buf);
+    }
+    uint8_t operator[](int i) const { return (uint8_t)(addr_ >> (24 - 8 * i)); }
+
+  private:
+    uint32_t addr_;
+};
+
+class WiFiClass {
+  public:
+    bool mode(wifi_mode_t mode);
+    wl_status_t begin(const char *ssid, const char *passphrase = nullptr);
+    bool disconnect(bool wifiOff = false);
+    wl_status_t status();
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    int8_t RSSI();
+};
+extern WiFiClass WiFi;
@@ -0,0 +1,25 @@
+// UDP over the simulated WiFi: datagrams to the monitor port end up in the event CSV,
+// datagrams to the command port come from the scenario file
+#pragma once
+#include "WiFi.h"
+
+class WiFiUDP : public Print {
+  public:
+    WiFiUDP();
+    ~WiFiUDP();
+    uint8_t begin(uint16_t port);
+    void stop();
+    int beginPacket(const char *host, uint16_t port);
+    int beginPacket(IPAddress ip, uint16_t port);
+    int endPacket();
+    size_t write(const uint8_t *buf, size_t size) override;
+    using Print::write;
+    int parsePacket();
+    int available();
+    int read();
+    int read(unsigned char *buf, size_t len);
+    int read(char *buf, size_t len) { return read((unsigned char *)buf, len); }
+
+  private:
+    int handle_;
+};
@@ -0,0 +1,10 @@
+// I2C bus: the display and sensors behind it are simulated at the device level
+#pragma once
+#include "Arduino.h"
+
+class TwoWire {
+  public:
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { return true; }
+    void setClock(uint32_t) {}
+};
+extern TwoWire Wire;
@@ -0,0 +1,5 @@
+// esp_timer: microseconds since boot on the node's own crystal
+#pragma once
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,47 @@
+// ============================================================================
+// SIMULATOR OVERLAY
+// Spliced into settings.h by tools/gen_firmware.py, right before its #endif.
+// One firmware image serves every virtual node, so the per-board values come
+// from variables the simulator sets before setup() runs.
+// ============================================================================
+
+extern "C" uint16_t sim_device_id;   // node ID from the topology file
+extern "C" uint8_t sim_slot_device;  // fixed slot (FIX_SLOT 1)
+
+// Non-zero for the preprocessor, so initMyInfo() takes the fixed-ID branch
+#undef DEVICE_ID
+#define DEVICE_ID (sim_device_id ? sim_device_id : 1)
+
+#undef SLOT_DEVICE
+#define SLOT_DEVICE sim_slot_device
+
+// Present in the boards' settings.h, missing from the template
+#ifndef ENABLE_SERIAL_DEBUG
+#define ENABLE_SERIAL_DEBUG 0
+#endif
+#ifndef ENABLE_SYNC_LOG
+#define ENABLE_SYNC_LOG 0
+#endif
+#ifndef WIFI_DISCONNECT_AFTER_NTP
+#define WIFI_DISCONNECT_AFTER_NTP 1
+#endif
+#ifndef DISPLAY_PAGE_SENSOR
+#define DISPLAY_PAGE_SENSOR 3
+#define DISPLAY_PAGE_ROUTING 4
+#define DISPLAY_PAGE_ROUTING2 255
+#define DISPLAY_PAGE_TIME 5
+#endif
+#ifndef MAX_ROUTE_STATS
+#define MAX_ROUTE_STATS 12
+#define ROUTE_TYPE_PRIMARY 0
+#define ROUTE_TYPE_ALTERNATIVE 1
+
+struct RouteStats {
+  uint16_t fromNode;
+  uint16_t toNode;
+  uint8_t routeType;
+  uint32_t packetCount;
+  uint32_t lastUpdateTime;
+  bool active;
+};
+#endif
@@ -0,0 +1,421 @@
+// Arduino-ESP32 core for the virtual nodes: GPIO, time, Serial, SPI, EEPROM, sensors.
+//
+// Every call acts on the node whose code runs right now (curNode). Calls that can
+// observe something an event changes (a pin driven by the radio, the clock in a
+// spin loop) sync() first; the CPU time the real call takes is charged with spend().
+#include "Arduino.h"
+#include "SPI.h"
+#include "Wire.h"
+#include "EEPROM.h"
+#include "Adafruit_AHTX0.h"
+#include "Adafruit_INA219.h"
+#include "sim.h"
+
+#include <limits.h>
+
+// Host code below wants the real libc functions, not the firmware's ILP32 wrappers
+#undef vsnprintf
+#undef snprintf
+#undef sprintf
+
+using namespace sim;
+
+namespace {
+
+const Time GPIO_NS = 100;
+const Time TIME_READ_NS = 300;      // esp_timer_get_time(), micros(), millis()
+const Time YIELD_NS = 2 * US;
+const Time SPI_SETUP_NS = 2 * US;   // per transferBytes() call: driver and DMA setup
+const Time UART_CHAR_NS = 86806;    // 10 bits at 115200 Bd
+const size_t UART_FIFO = 128;
+const Time EEPROM_COMMIT_NS = 20 * MS;
+
+}  // namespace
+
+HardwareSerial Serial;
+SPIClass SPI;
+TwoWire Wire;
+EEPROMClass EEPROM;
+EspClass ESP;
+
+// ---------------------------------------------------------------------------
+// ILP32 printf
+// ---------------------------------------------------------------------------
+
+// Drop a single 'l' length modifier in front of an integer conversion ("%lu" -> "%u")
+static void stripLong(const char *fmt, std::string &out) {
+  out.clear();
+  for (const char *p = fmt; *p; p++) {
+    out += *p;
+    if (*p != '%') continue;
+    p++;
+    if (*p == '%') {
+      out += *p;
+      continue;
+    }
+    while (*p && strchr("-+ #0123456789.*", *p)) out += *p++;
+    if (p[0] == 'l' && p[1] != 'l' && p[1] && strchr("diouxX", p[1])) p++;
+    if (!*p) break;
+    out += *p;
+  }
+}
+
+int sim_vsnprintf(char *buf, size_t size, const char *fmt, va_list args) {
+  if (!strchr(fmt, 'l')) return vsnprintf(buf, size, fmt, args);
+  std::string fixed;
+  stripLong(fmt, fixed);
+  return vsnprintf(buf, size, fixed.c_str(), args);
+}
+
+int sim_snprintf(char *buf, size_t size, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = sim_vsnprintf(buf, size, fmt, args);
+  va_end(args);
+  return n;
+}
+
+int sim_sprintf(char *buf, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = sim_vsnprintf(buf, INT_MAX, fmt, args);
+  va_end(args);
+  return n;
+}
+
+// ---------------------------------------------------------------------------
+// GPIO
+// ---------------------------------------------------------------------------
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  Node *n = curNode;
+  if (!n || pin >= 64) return;
+  // Unconnected inputs (encoder, buttons) idle at their pull level
+  if ((mode & PULLUP) && (mode & INPUT)) n->pinLevel[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  Node *n = curNode;
+  if (!n || pin >= 64) return;
+  spend(GPIO_NS);
+  n->pinLevel[pin] = val ? HIGH : LOW;
+  if (!n->chip || !n->info) return;
+  if (pin == n->info->pinNss || pin == n->info->pinReset) {
+    sync();
+    chipPinWrite(n->chip.get(), pin, val ? HIGH : LOW, now());
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  Node *n = curNode;
+  if (!n || pin >= 64) return LOW;
+  spend(GPIO_NS);
+  if (n->chip && n->info) {
+    if (pin == n->info->pinBusy) {
+      sync();
+      return chipBusy(n->chip.get(), now()) ? HIGH : LOW;
+    }
+    if (pin == n->info->pinDio1) {
+      sync();
+      return chipDio1(n->chip.get()) ? HIGH : LOW;
+    }
+  }
+  return n->pinLevel[pin];
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+  Node *n = curNode;
+  if (!n || pin >= 64) return;
+  n->isr[pin] = Isr();
+  n->isr[pin].fn = isr;
+  n->isr[pin].mode = mode;
+}
+
+void attachInterruptArg(uint8_t pin, void (*isr)(void *), void *arg, int mode) {
+  Node *n = curNode;
+  if (!n || pin >= 64) return;
+  n->isr[pin] = Isr();
+  n->isr[pin].fnArg = isr;
+  n->isr[pin].arg = arg;
+  n->isr[pin].mode = mode;
+}
+
+void detachInterrupt(uint8_t pin) {
+  Node *n = curNode;
+  if (n && pin < 64) n->isr[pin] = Isr();
+}
+
+void noInterrupts() {}
+void interrupts() {}
+
+// ---------------------------------------------------------------------------
+// Time
+// ---------------------------------------------------------------------------
+
+// Spin loops on the clock must let interrupts in, so every read syncs
+static int64_t readClockUs() {
+  Node *n = curNode;
+  if (!n) return 0;
+  spend(TIME_READ_NS);
+  sync();
+  return n->localUs(now());
+}
+
+int64_t esp_timer_get_time(void) { return readClockUs(); }
+
+uint32_t micros() { return (uint32_t)readClockUs(); }
+
+uint32_t millis() { return (uint32_t)(readClockUs() / 1000); }
+
+void delay(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+
+void delayMicroseconds(uint32_t us) { spend((Time)us * US); }
+
+// Tasks do not share a CPU here, and no firmware loop spins on yield() alone
+// (they read the clock or block too), so there is nothing to line up with
+void yield() { spend(YIELD_NS); }
+
+// ---------------------------------------------------------------------------
+// Random numbers, ESP
+// ---------------------------------------------------------------------------
+
+uint32_t esp_random(void) {
+  Node *n = curNode;
+  return n ? (uint32_t)n->rng() : 0;
+}
+
+long random(long howbig) {
+  if (howbig <= 0) return 0;
+  return (long)(esp_random() % (uint32_t)howbig);
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return howsmall + random(howbig - howsmall);
+}
+
+// The hardware RNG is used either way; a fixed seed must not make nodes agree
+void randomSeed(unsigned long) {}
+
+void EspClass::restart() {
+  Node *n = curNode;
+  if (!n) return;
+  sync();
+  uint32_t gen = n->gen;
+  at(now(), [n, gen] {
+    if (n->gen == gen) reboot(n);
+  });
+  if (current()) park();
+}
+
+uint32_t EspClass::getFreeHeap() { return 200000; }
+
+// ---------------------------------------------------------------------------
+// Print / Serial
+// ---------------------------------------------------------------------------
+
+size_t Print::printf(const char *fmt, ...) {
+  if (discards()) return 0;
+  char small[256];
+  va_list args;
+  va_start(args, fmt);
+  int len = sim_vsnprintf(small, sizeof(small), fmt, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if ((size_t)len < sizeof(small)) return write((const uint8_t *)small, (size_t)len);
+  std::vector<char> big((size_t)len + 1);
+  va_start(args, fmt);
+  sim_vsnprintf(big.data(), big.size(), fmt, args);
+  va_end(args);
+  return write((const uint8_t *)big.data(), (size_t)len);
+}
+
+size_t Print::print(const char *s) { return s ? write(s) : 0; }
+size_t Print::print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+
+// Non-decimal bases print the 32-bit two's complement, as on the ESP32
+static size_t printNumber(Print *p, long long v, int base) {
+  if (p->discards()) return 0;
+  String s = (base == DEC) ? String((long)v) : String((unsigned long)(uint32_t)v, (unsigned char)base);
+  return p->print(s);
+}
+
+size_t Print::print(unsigned char v, int base) { return printNumber(this, v, base); }
+size_t Print::print(int v, int base) { return printNumber(this, v, base); }
+size_t Print::print(unsigned int v, int base) { return printNumber(this, v, base); }
+size_t Print::print(long v, int base) { return printNumber(this, v, base); }
+size_t Print::print(unsigned long v, int base) { return printNumber(this, (long long)v, base); }
+
+size_t Print::print(long long v, int base) {
+  if (discards()) return 0;
+  char buf[32];
+  if (base == DEC) {
+    snprintf(buf, sizeof(buf), "%lld", v);
+    return write(buf);
+  }
+  return print(String((unsigned long)v, (unsigned char)base));
+}
+
+size_t Print::print(unsigned long long v, int base) {
+  if (discards()) return 0;
+  return print(String((unsigned long)v, (unsigned char)base));
+}
+
+size_t Print::print(double v, int digits) {
+  if (discards()) return 0;
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", digits, v);
+  return write(buf);
+}
+
+size_t Print::println() { return write("\r\n"); }
+
+void HardwareSerial::begin(unsigned long) {}
+
+bool HardwareSerial::discards() {
+  Node *n = curNode;
+  return !n || (!n->log && !cfg.uartTiming);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t size) {
+  Node *n = curNode;
+  if (!n) return size;
+
+  if (n->log) {
+    for (size_t i = 0; i < size; i++) {
+      if (n->logLineStart) {
+        fprintf(n->log, "[%12.6f] ", (double)now() / SEC);
+        n->logLineStart = false;
+      }
+      if (buf[i] == '\r') continue;
+      fputc(buf[i], n->log);
+      if (buf[i] == '\n') n->logLineStart = true;
+    }
+  }
+
+  // Serial.write() returns once the bytes fit into the 128-byte TX FIFO
+  if (cfg.uartTiming && current()) {
+    Time t = now();
+    if (n->uartFreeAt < t) n->uartFreeAt = t;
+    n->uartFreeAt += (Time)size * UART_CHAR_NS;
+    Time backlog = n->uartFreeAt - t;
+    Time fifo = (Time)UART_FIFO * UART_CHAR_NS;
+    if (backlog > fifo) spend(backlog - fifo);
+  }
+  return size;
+}
+
+int HardwareSerial::available() {
+  Node *n = curNode;
+  if (!n) return 0;
+  sync();
+  return (int)n->serialIn.size();
+}
+
+int HardwareSerial::read() {
+  Node *n = curNode;
+  if (!n || n->serialIn.empty()) return -1;
+  char c = n->serialIn.front();
+  n->serialIn.pop_front();
+  return (uint8_t)c;
+}
+
+int HardwareSerial::peek() {
+  Node *n = curNode;
+  if (!n || n->serialIn.empty()) return -1;
+  return (uint8_t)n->serialIn.front();
+}
+
+// ---------------------------------------------------------------------------
+// SPI
+// ---------------------------------------------------------------------------
+
+void SPIClass::begin(int8_t, int8_t, int8_t, int8_t) {}
+
+void SPIClass::setFrequency(uint32_t freq) {
+  if (curNode && freq) curNode->spiClock = freq;
+}
+
+void SPIClass::beginTransaction(SPISettings settings) { setFrequency(settings.clock); }
+
+void SPIClass::endTransaction() {}
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  uint8_t in = 0xFF;
+  transferBytes(&data, &in, 1);
+  return in;
+}
+
+void SPIClass::writeBytes(const uint8_t *data, uint32_t size) { transferBytes(data, nullptr, size); }
+
+void SPIClass::transferBytes(const uint8_t *data, uint8_t *out, uint32_t size) {
+  Node *n = curNode;
+  if (!n) return;
+  spend(SPI_SETUP_NS + (Time)size * 8 * SEC / n->spiClock);
+  if (n->chip && n->info && n->pinLevel[n->info->pinNss] == LOW) {
+    chipTransfer(n->chip.get(), data, out, size, now());
+  } else if (out) {
+    memset(out, 0xFF, size);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// EEPROM (node flash survives reboots, so it lives in the Node)
+// ---------------------------------------------------------------------------
+
+bool EEPROMClass::begin(size_t size) {
+  Node *n = curNode;
+  if (!n || size > n->eeprom.size()) return false;
+  n->eepromSize = size;
+  return true;
+}
+
+uint8_t EEPROMClass::read(int address) {
+  Node *n = curNode;
+  if (!n || address < 0 || (size_t)address >= n->eepromSize) return 0xFF;
+  return n->eeprom[(size_t)address];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  Node *n = curNode;
+  if (!n || address < 0 || (size_t)address >= n->eepromSize) return;
+  n->eeprom[(size_t)address] = value;
+}
+
+bool EEPROMClass::commit() {
+  spend(EEPROM_COMMIT_NS);
+  return curNode != nullptr;
+}
+
+size_t EEPROMClass::length() { return curNode ? curNode->eepromSize : 0; }
+
+// ---------------------------------------------------------------------------
+// Sensors: slow random walks around plausible values
+// ---------------------------------------------------------------------------
+
+static float walk(Node *n, float &v, float start, float step, float lo, float hi) {
+  if (v == 0) v = start + (float)((int64_t)(n->rng() % 2001) - 1000) / 1000.0f * step * 10;
+  v += (float)((int64_t)(n->rng() % 2001) - 1000) / 1000.0f * step;
+  v = constrain(v, lo, hi);
+  return v;
+}
+
+bool Adafruit_AHTX0::getEvent(sensors_event_t *humidity, sensors_event_t *temp) {
+  Node *n = curNode;
+  if (!n) return false;
+  spend(80 * MS);  // AHT20 measurement time
+  if (temp) temp->temperature = walk(n, n->temperature, 28.0f, 0.05f, -10.0f, 60.0f);
+  if (humidity) humidity->relative_humidity = walk(n, n->humidity, 70.0f, 0.2f, 5.0f, 100.0f);
+  return true;
+}
+
+float Adafruit_INA219::getBusVoltage_V() {
+  Node *n = curNode;
+  if (!n) return 0.0f;
+  spend(600 * US);
+  // 2S Li-ion, discharging a little over the run
+  if (n->voltage == 0) n->voltage = 7.8f + (float)(n->rng() % 400) / 1000.0f;
+  n->voltage -= (float)(n->rng() % 100) / 1e6f;
+  return constrain(n->voltage, 6.0f, 8.4f);
+}
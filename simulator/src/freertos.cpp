@@ -0,0 +1,356 @@
+// FreeRTOS and the ESP32 hardware timers on top of the simulator's tasks.
+//
+// Tasks of one node do not compete for a CPU: each runs on its own time line and
+// only meets the others at semaphores, queues and the tick. Blocking calls wake on
+// the node's own 1 ms tick, so timeouts drift with its crystal like on the board.
+#include "Arduino.h"
+#include "sim.h"
+
+using namespace sim;
+
+namespace {
+
+const Time RTOS_CALL_NS = 1 * US;
+const Time WAKE_LATENCY = 5 * US;   // give/send until the blocked task runs
+const Time TIMER_ISR_LATENCY = 2 * US;
+
+RtosObject *newObject(RtosObject::Kind kind) {
+  Node *n = curNode;
+  if (!n) return nullptr;
+  n->rtos.emplace_back(new RtosObject);
+  RtosObject *o = n->rtos.back().get();
+  o->kind = kind;
+  return o;
+}
+
+// Enter a blocking FreeRTOS call: line up with the event loop, pay for the call
+void enter() {
+  spend(RTOS_CALL_NS);
+  sync();
+}
+
+// Absolute deadline of a wait of `ticks`, -1 for portMAX_DELAY
+Time deadlineFor(TickType_t ticks) {
+  if (ticks == portMAX_DELAY) return -1;
+  Node *n = curNode;
+  return n->tickTime((uint64_t)n->tick(now()) + ticks);
+}
+
+// take/push/pop: a wait blocks through the event loop anyway, so only a call that
+// goes ahead (or cannot block) first lines up with it. Polling loops like
+// xQueueReceive(q, &x, 1) then cost one event per wait instead of three.
+bool take(RtosObject *o, TickType_t ticks) {
+  bool canBlock = current() && ticks != 0;
+  Time deadline = canBlock ? deadlineFor(ticks) : 0;
+  for (;;) {
+    if (o->count > 0 || !canBlock) sync();
+    if (o->count > 0) {
+      o->count--;
+      return true;
+    }
+    if (!canBlock || !wait(o->takers, deadline)) return false;
+  }
+}
+
+bool give(RtosObject *o) {
+  if (o->count >= o->maxCount) return false;
+  o->count++;
+  wake(o->takers, WAKE_LATENCY);
+  return true;
+}
+
+bool push(RtosObject *o, const void *item, TickType_t ticks) {
+  bool canBlock = current() && ticks != 0;
+  Time deadline = canBlock ? deadlineFor(ticks) : 0;
+  for (;;) {
+    if (o->items.size() < o->length || !canBlock) sync();
+    if (o->items.size() < o->length) {
+      const uint8_t *p = (const uint8_t *)item;
+      o->items.emplace_back(p, p + o->itemSize);
+      wake(o->takers, WAKE_LATENCY);
+      return true;
+    }
+    if (!canBlock || !wait(o->senders, deadline)) return false;
+  }
+}
+
+bool pop(RtosObject *o, void *item, TickType_t ticks) {
+  bool canBlock = current() && ticks != 0;
+  Time deadline = canBlock ? deadlineFor(ticks) : 0;
+  for (;;) {
+    if (!o->items.empty() || !canBlock) sync();
+    if (!o->items.empty()) {
+      memcpy(item, o->items.front().data(), o->itemSize);
+      o->items.pop_front();
+      wake(o->senders, WAKE_LATENCY);
+      return true;
+    }
+    if (!canBlock || !wait(o->takers, deadline)) return false;
+  }
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// Tasks
+// ---------------------------------------------------------------------------
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t, void *param,
+                                   UBaseType_t, TaskHandle_t *handle, BaseType_t) {
+  Node *n = curNode;
+  if (!n) return pdFAIL;
+  spend(50 * US);
+  Task *t = spawn(n, name, fn, param, now());
+  n->tasks.push_back(t);
+  if (handle) *handle = t;
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  Task *self = current();
+  Task *t = task ? (Task *)task : self;
+  if (!t) return;
+  if (t == self) {
+    // The stack goes away with the node's other tasks at power-off
+    t->dead = true;
+    park();
+  }
+  kill(t);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  Node *n = curNode;
+  if (!n || !current()) return;
+  enter();
+  if (ticks == 0) return;
+  sleepUntil(n->tickTime((uint64_t)n->tick(now()) + ticks));
+}
+
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t increment) {
+  Node *n = curNode;
+  if (!n || !current()) return;
+  enter();
+  TickType_t target = *previousWake + increment;
+  *previousWake = target;
+  TickType_t cur = n->tick(now());
+  if ((int32_t)(target - cur) > 0) sleepUntil(n->tickTime((uint64_t)cur + (target - cur)));
+}
+
+TickType_t xTaskGetTickCount() {
+  Node *n = curNode;
+  if (!n) return 0;
+  sync();
+  return n->tick(now());
+}
+
+// ---------------------------------------------------------------------------
+// Semaphores
+// ---------------------------------------------------------------------------
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  RtosObject *o = newObject(RtosObject::SEMAPHORE);
+  if (o) o->maxCount = 1;
+  return o;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  RtosObject *o = newObject(RtosObject::MUTEX);
+  if (o) o->count = o->maxCount = 1;
+  return o;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+  RtosObject *o = newObject(RtosObject::SEMAPHORE);
+  if (o) {
+    o->maxCount = maxCount;
+    o->count = initialCount;
+  }
+  return o;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  if (!sem) return pdFALSE;
+  spend(RTOS_CALL_NS);
+  return take((RtosObject *)sem, ticks) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  if (!sem) return pdFALSE;
+  enter();
+  return give((RtosObject *)sem) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken) {
+  if (!sem) return pdFALSE;
+  RtosObject *o = (RtosObject *)sem;
+  bool waiting = !o->takers.waiters.empty();
+  bool ok = give(o);
+  if (woken && ok && waiting) *woken = pdTRUE;
+  return ok ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t) {
+  // Objects live until the node powers off
+}
+
+// ---------------------------------------------------------------------------
+// Queues
+// ---------------------------------------------------------------------------
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  RtosObject *o = newObject(RtosObject::QUEUE);
+  if (o) {
+    o->length = length;
+    o->itemSize = itemSize;
+  }
+  return o;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks) {
+  if (!q) return pdFAIL;
+  spend(RTOS_CALL_NS);
+  return push((RtosObject *)q, item, ticks) ? pdPASS : pdFAIL;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken) {
+  if (!q) return pdFAIL;
+  RtosObject *o = (RtosObject *)q;
+  bool waiting = !o->takers.waiters.empty();
+  bool ok = push(o, item, 0);
+  if (woken && ok && waiting) *woken = pdTRUE;
+  return ok ? pdPASS : pdFAIL;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks) {
+  if (!q) return pdFALSE;
+  spend(RTOS_CALL_NS);
+  return pop((RtosObject *)q, item, ticks) ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+  if (!q) return 0;
+  sync();
+  return (UBaseType_t)((RtosObject *)q)->items.size();
+}
+
+BaseType_t xQueueReset(QueueHandle_t q) {
+  if (!q) return pdFAIL;
+  RtosObject *o = (RtosObject *)q;
+  o->items.clear();
+  while (wake(o->senders, WAKE_LATENCY)) {
+  }
+  return pdPASS;
+}
+
+// ---------------------------------------------------------------------------
+// Hardware timers: the counter runs off the node's crystal
+// ---------------------------------------------------------------------------
+
+static uint64_t timerCount(HwTimer *t, Time at) {
+  if (!t->running) return t->baseCount;
+  int64_t us = t->node->localUs(at) - t->baseUs;
+  return t->baseCount + (uint64_t)((double)us * t->frequency / 1e6);
+}
+
+static void timerSet(HwTimer *t, uint64_t count, Time at) {
+  t->baseCount = count;
+  t->baseUs = t->node->localUs(at);
+}
+
+static void timerArm(HwTimer *t) {
+  uint32_t armed = ++t->armed;
+  if (!t->running || !t->alarmEnabled || !t->isr) return;
+  Time cur = now();
+  uint64_t count = timerCount(t, cur);
+  Time fire = cur;
+  if (t->alarm > count) {
+    int64_t us = t->baseUs + (int64_t)ceil((double)(t->alarm - t->baseCount) * 1e6 / t->frequency);
+    fire = std::max(cur, t->node->trueTime(us));
+  }
+  Node *n = t->node;
+  uint32_t gen = n->gen;
+  at(fire + TIMER_ISR_LATENCY, [t, n, gen, armed, fire] {
+    if (n->gen != gen || t->armed != armed) return;
+    if (t->autoreload) {
+      timerSet(t, t->reloadCount, fire);
+      timerArm(t);
+    } else {
+      t->alarmEnabled = false;
+    }
+    NodeContext ctx(n);
+    t->isr();
+  });
+}
+
+hw_timer_t *timerBegin(uint32_t frequency) {
+  Node *n = curNode;
+  if (!n || frequency == 0) return nullptr;
+  n->timers.emplace_back(new HwTimer);
+  HwTimer *t = n->timers.back().get();
+  t->node = n;
+  t->frequency = frequency;
+  timerSet(t, 0, now());
+  return (hw_timer_t *)t;
+}
+
+void timerEnd(hw_timer_t *timer) {
+  HwTimer *t = (HwTimer *)timer;
+  if (!t) return;
+  t->armed++;
+  t->running = false;
+  t->isr = nullptr;
+}
+
+void timerAttachInterrupt(hw_timer_t *timer, void (*isr)(void)) {
+  HwTimer *t = (HwTimer *)timer;
+  if (!t) return;
+  t->isr = isr;
+  timerArm(t);
+}
+
+void timerDetachInterrupt(hw_timer_t *timer) {
+  HwTimer *t = (HwTimer *)timer;
+  if (!t) return;
+  t->isr = nullptr;
+  t->armed++;
+}
+
+void timerAlarm(hw_timer_t *timer, uint64_t alarmValue, bool autoreload, uint64_t reloadCount) {
+  HwTimer *t = (HwTimer *)timer;
+  if (!t) return;
+  sync();
+  t->alarm = alarmValue;
+  t->autoreload = autoreload;
+  t->reloadCount = reloadCount;
+  t->alarmEnabled = true;
+  timerArm(t);
+}
+
+void timerWrite(hw_timer_t *timer, uint64_t value) {
+  HwTimer *t = (HwTimer *)timer;
+  if (!t) return;
+  sync();
+  timerSet(t, value, now());
+  timerArm(t);
+}
+
+uint64_t timerRead(hw_timer_t *timer) {
+  HwTimer *t = (HwTimer *)timer;
+  return t ? timerCount(t, now()) : 0;
+}
+
+void timerStart(hw_timer_t *timer) {
+  HwTimer *t = (HwTimer *)timer;
+  if (!t || t->running) return;
+  timerSet(t, t->baseCount, now());
+  t->running = true;
+  timerArm(t);
+}
+
+void timerStop(hw_timer_t *timer) {
+  HwTimer *t = (HwTimer *)timer;
+  if (!t || !t->running) return;
+  timerSet(t, timerCount(t, now()), now());
+  t->running = false;
+  t->armed++;
+}
@@ -0,0 +1,381 @@
+// lora-mesh-sim: runs the unmodified firmware of every node of a topology on one
+// virtual clock and writes the monitoring CSV of data_collection/.
+//
+//   ./lora-mesh-sim examples/line5.topo -t 600 -o line5.csv
+//   ./lora-mesh-sim examples/line5.topo -t 480 -e examples/line5_failover.scn --stats stats.txt
+//   ./lora-mesh-sim --grid 10x10:60 -t 300
+#include "sim.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+namespace sim {
+Config cfg;
+}
+
+using namespace sim;
+
+namespace {
+
+const Time PROGRESS_EVERY = 10 * SEC;
+
+struct Options {
+  std::string topology;
+  int gridCols = 0, gridRows = 0;
+  double gridSpacing = 60;
+  double duration = 600;
+  std::string output = "sim_events.csv";
+  std::string scenario;
+  std::string logDir;
+  std::string images = "build";
+  std::string statsFile;
+  bool quiet = false;
+};
+
+std::map<int, Node *> byId;
+
+[[noreturn]] void fail(const std::string &where, const std::string &what) {
+  fprintf(stderr, "%s: %s\n", where.c_str(), what.c_str());
+  exit(2);
+}
+
+Node *nodeById(int id, const std::string &where) {
+  auto it = byId.find(id);
+  if (it == byId.end()) fail(where, "unknown node " + std::to_string(id));
+  return it->second;
+}
+
+Node *addNode(int id, double x, double y, bool gateway) {
+  if (id < 1 || id > 65535) fail("topology", "node ID out of range: " + std::to_string(id));
+  if (byId.count(id)) fail("topology", "duplicate node " + std::to_string(id));
+  nodes.emplace_back(new Node);
+  Node *n = nodes.back().get();
+  n->index = (int)nodes.size() - 1;
+  n->id = (uint16_t)id;
+  n->x = x;
+  n->y = y;
+  n->gateway = gateway;
+  n->slot = (uint8_t)(n->index % 8);
+  n->ppm = NAN;
+  n->bootDelay = -1;
+  byId[id] = n;
+  return n;
+}
+
+// "off" cuts a link, "auto" hands it back to the path loss model
+double parseLoss(const std::string &v, const std::string &where) {
+  if (v == "off") return INFINITY;
+  if (v == "auto") return NAN;
+  char *end;
+  double db = strtod(v.c_str(), &end);
+  if (*end) fail(where, "bad link loss '" + v + "'");
+  return db;
+}
+
+void loadTopology(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) fail(path, "cannot open");
+  std::string line;
+  std::vector<std::tuple<int, int, double>> links;
+  for (int lineNo = 1; std::getline(in, line); lineNo++) {
+    std::string where = path + ":" + std::to_string(lineNo);
+    line = line.substr(0, line.find('#'));
+    std::istringstream ss(line);
+    std::string kw;
+    if (!(ss >> kw)) continue;
+    if (kw == "node") {
+      int id;
+      double x, y;
+      if (!(ss >> id >> x >> y)) fail(where, "expected: node <id> <x> <y> [gateway] [ppm=] [boot=] [slot=]");
+      Node *n = addNode(id, x, y, false);
+      std::string opt;
+      while (ss >> opt) {
+        if (opt == "gateway") {
+          n->gateway = true;
+        } else if (opt.compare(0, 4, "ppm=") == 0) {
+          n->ppm = atof(opt.c_str() + 4);
+        } else if (opt.compare(0, 5, "boot=") == 0) {
+          n->bootDelay = (Time)(atof(opt.c_str() + 5) * SEC);
+        } else if (opt.compare(0, 5, "slot=") == 0) {
+          n->slot = (uint8_t)atoi(opt.c_str() + 5);
+        } else {
+          fail(where, "unknown node option '" + opt + "'");
+        }
+      }
+    } else if (kw == "link") {
+      int a, b;
+      std::string v;
+      if (!(ss >> a >> b >> v)) fail(where, "expected: link <id> <id> <loss dB>|off");
+      links.emplace_back(a, b, parseLoss(v, where));
+    } else {
+      fail(where, "unknown keyword '" + kw + "'");
+    }
+  }
+  for (auto &l : links) {
+    setLinkLoss(nodeById(std::get<0>(l), path)->index, nodeById(std::get<1>(l), path)->index, std::get<2>(l));
+  }
+}
+
+// Gateway in a corner, so the far corner is as many hops out as the grid allows
+void makeGrid(int cols, int rows, double spacing) {
+  for (int r = 0; r < rows; r++) {
+    for (int c = 0; c < cols; c++) {
+      int id = r * cols + c + 1;
+      addNode(id, c * spacing, r * spacing, id == 1);
+    }
+  }
+}
+
+// Scenario lines: "<t_s> <action> ...", applied when the clock gets there
+void loadScenario(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) fail(path, "cannot open");
+  std::string line;
+  for (int lineNo = 1; std::getline(in, line); lineNo++) {
+    std::string where = path + ":" + std::to_string(lineNo);
+    line = line.substr(0, line.find('#'));
+    std::istringstream ss(line);
+    double ts;
+    std::string action;
+    if (!(ss >> ts)) continue;
+    if (!(ss >> action)) fail(where, "missing action");
+    Time t = (Time)(ts * SEC);
+    int id = 0;
+    if (action == "off" || action == "on" || action == "reboot") {
+      if (!(ss >> id)) fail(where, "expected: <t> " + action + " <id>");
+      Node *n = nodeById(id, where);
+      if (action == "off") at(t, [n] { powerOff(n); });
+      if (action == "on") at(t, [n] { powerOn(n); });
+      if (action == "reboot") at(t, [n] { reboot(n); });
+    } else if (action == "cmd") {
+      std::string cmd;
+      if (!(ss >> id >> cmd)) fail(where, "expected: <t> cmd <id|0> <COMMAND>");
+      if (id != 0) nodeById(id, where);
+      std::string rest;
+      std::getline(ss, rest);
+      cmd += rest;
+      at(t, [id, cmd] { sendCommand(id, cmd); });
+    } else if (action == "serial") {
+      if (!(ss >> id)) fail(where, "expected: <t> serial <id> <text>");
+      Node *n = nodeById(id, where);
+      std::string text;
+      std::getline(ss, text);
+      size_t b = text.find_first_not_of(" \t");
+      text = (b == std::string::npos) ? "" : text.substr(b);
+      text += "\n";
+      at(t, [n, text] { n->serialIn.insert(n->serialIn.end(), text.begin(), text.end()); });
+    } else if (action == "link") {
+      int a, b;
+      std::string v;
+      if (!(ss >> a >> b >> v)) fail(where, "expected: <t> link <id> <id> <loss dB>|off|auto");
+      int ia = nodeById(a, where)->index, ib = nodeById(b, where)->index;
+      double loss = parseLoss(v, where);
+      at(t, [ia, ib, loss] { setLinkLoss(ia, ib, loss); });
+    } else if (action == "move") {
+      double x, y;
+      if (!(ss >> id >> x >> y)) fail(where, "expected: <t> move <id> <x> <y>");
+      Node *n = nodeById(id, where);
+      at(t, [n, x, y] {
+        n->x = x;
+        n->y = y;
+        nodeMoved(n);
+      });
+    } else {
+      fail(where, "unknown action '" + action + "'");
+    }
+  }
+}
+
+double wallSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double wallStart;
+
+void progress(Time end) {
+  double simSeconds = (double)now() / SEC;
+  double wall = wallSeconds() - wallStart;
+  fprintf(stderr, "\r[sim] %7.1f / %.0f s  x%-6.1f  %llu events  %llu datagrams  ", simSeconds, (double)end / SEC,
+          wall > 0 ? simSeconds / wall : 0.0, (unsigned long long)eventsRun(), (unsigned long long)collectorDatagrams());
+  fflush(stderr);
+  if (now() + PROGRESS_EVERY <= end) at(now() + PROGRESS_EVERY, [end] { progress(end); });
+}
+
+void printSummary(FILE *f, double simSeconds, double wall, size_t csvEvents, const std::string &csv) {
+  fprintf(f, "simulated %.1f s of %zu nodes in %.1f s wall (x%.1f), %llu events\n", simSeconds, nodes.size(), wall,
+          wall > 0 ? simSeconds / wall : 0.0, (unsigned long long)eventsRun());
+  fprintf(f, "%zu monitoring events -> %s\n", csvEvents, csv.c_str());
+  fprintf(f, "medium: %llu frames, %llu delivered, %llu collisions, %llu too weak, %llu header mismatches\n",
+          (unsigned long long)mediumStats.transmissions, (unsigned long long)mediumStats.delivered,
+          (unsigned long long)mediumStats.collisions, (unsigned long long)mediumStats.weak,
+          (unsigned long long)mediumStats.headerMismatch);
+  fprintf(f, "%6s %4s %6s %8s %8s %8s %8s %9s %8s %8s\n", "node", "gw", "boots", "tx", "rx_ok", "rx_crc", "rx_coll",
+          "airtime_s", "udp", "join_s");
+  for (auto &n : nodes) {
+    const NodeStats &s = n->stats;
+    char join[16] = "-";
+    if (s.joinDelay >= 0) snprintf(join, sizeof(join), "%.1f", (double)s.joinDelay / SEC);
+    fprintf(f, "%6u %4s %6u %8u %8u %8u %8u %9.2f %8u %8s\n", n->id, n->gateway ? "*" : "", s.boots, s.txFrames,
+            s.rxOk, s.rxCrcErr, s.rxCollisions, (double)s.txAirtime / SEC, s.datagrams, join);
+  }
+}
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [options] <topology file>\n"
+          "       %s [options] --grid COLSxROWS[:SPACING_M]\n"
+          "\n"
+          "  -t, --duration S      simulated seconds (default 600)\n"
+          "  -o, --output FILE     event CSV (default sim_events.csv)\n"
+          "  -e, --scenario FILE   timed power, link, command and serial events\n"
+          "  -s, --seed N          random seed (default 1)\n"
+          "  -l, --logs DIR        serial console of every node to DIR/node<ID>.log\n"
+          "      --images DIR      node.so and gateway.so (default build)\n"
+          "      --stats FILE      also write the run summary to FILE\n"
+          "      --path-loss N     log-distance exponent (default 3.0)\n"
+          "      --shadowing DB    sigma of the static per-link shadowing (default 4)\n"
+          "      --fading DB       sigma of the per-packet fading (default 2)\n"
+          "      --capture DB      co-SF capture threshold (default 6)\n"
+          "      --epoch S         wall clock at t=0, Unix seconds (default 2026-01-01)\n"
+          "      --no-uart-timing  Serial output costs no time\n"
+          "  -q, --quiet           no progress line\n",
+          argv0, argv0);
+  exit(2);
+}
+
+volatile sig_atomic_t interrupted = 0;
+
+void onSigint(int) {
+  interrupted = 1;
+  stop();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  enum { OPT_IMAGES = 1000, OPT_STATS, OPT_GRID, OPT_PATHLOSS, OPT_SHADOW, OPT_FADING, OPT_CAPTURE, OPT_EPOCH,
+         OPT_NOUART };
+  static const struct option longOpts[] = {
+    {"duration", required_argument, nullptr, 't'},
+    {"output", required_argument, nullptr, 'o'},
+    {"scenario", required_argument, nullptr, 'e'},
+    {"seed", required_argument, nullptr, 's'},
+    {"logs", required_argument, nullptr, 'l'},
+    {"quiet", no_argument, nullptr, 'q'},
+    {"help", no_argument, nullptr, 'h'},
+    {"images", required_argument, nullptr, OPT_IMAGES},
+    {"stats", required_argument, nullptr, OPT_STATS},
+    {"grid", required_argument, nullptr, OPT_GRID},
+    {"path-loss", required_argument, nullptr, OPT_PATHLOSS},
+    {"shadowing", required_argument, nullptr, OPT_SHADOW},
+    {"fading", required_argument, nullptr, OPT_FADING},
+    {"capture", required_argument, nullptr, OPT_CAPTURE},
+    {"epoch", required_argument, nullptr, OPT_EPOCH},
+    {"no-uart-timing", no_argument, nullptr, OPT_NOUART},
+    {nullptr, 0, nullptr, 0},
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "t:o:e:s:l:qh", longOpts, nullptr)) != -1) {
+    switch (c) {
+      case 't': opt.duration = atof(optarg); break;
+      case 'o': opt.output = optarg; break;
+      case 'e': opt.scenario = optarg; break;
+      case 's': cfg.seed = strtoull(optarg, nullptr, 10); break;
+      case 'l': opt.logDir = optarg; break;
+      case 'q': opt.quiet = true; break;
+      case OPT_IMAGES: opt.images = optarg; break;
+      case OPT_STATS: opt.statsFile = optarg; break;
+      case OPT_GRID:
+        if (sscanf(optarg, "%dx%d:%lf", &opt.gridCols, &opt.gridRows, &opt.gridSpacing) < 2 || opt.gridCols < 1 ||
+            opt.gridRows < 1) {
+          usage(argv[0]);
+        }
+        break;
+      case OPT_PATHLOSS: cfg.pathLossExp = atof(optarg); break;
+      case OPT_SHADOW: cfg.shadowingDb = atof(optarg); break;
+      case OPT_FADING: cfg.fadingDb = atof(optarg); break;
+      case OPT_CAPTURE: cfg.captureDb = atof(optarg); break;
+      case OPT_EPOCH: cfg.epochUs = (int64_t)(atof(optarg) * 1e6); break;
+      case OPT_NOUART: cfg.uartTiming = false; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind < argc) opt.topology = argv[optind++];
+  if (optind < argc || (opt.topology.empty() == (opt.gridCols == 0)) || opt.duration <= 0) usage(argv[0]);
+
+  if (opt.gridCols) {
+    makeGrid(opt.gridCols, opt.gridRows, opt.gridSpacing);
+  } else {
+    loadTopology(opt.topology);
+  }
+  if (nodes.empty()) fail(opt.topology, "no nodes");
+
+  // Every node holds its image open through a memfd
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  if (!loadImages(opt.images)) return 1;
+
+  // Unset crystal errors and boot times are drawn from the seed
+  std::mt19937_64 rng(cfg.seed);
+  std::uniform_real_distribution<double> ppm(-20.0, 20.0), boot(0.0, 1.0);
+  for (auto &n : nodes) {
+    if (std::isnan(n->ppm)) n->ppm = ppm(rng);
+    if (n->bootDelay < 0) n->bootDelay = (Time)(boot(rng) * SEC);
+  }
+
+  if (!opt.logDir.empty()) {
+    mkdir(opt.logDir.c_str(), 0755);
+    for (auto &n : nodes) {
+      std::string path = opt.logDir + "/node" + std::to_string(n->id) + ".log";
+      n->log = fopen(path.c_str(), "w");
+      if (!n->log) fail(path, strerror(errno));
+    }
+  }
+
+  Time end = (Time)(opt.duration * SEC);
+  mediumInit();
+  collectorInit(end);
+  for (auto &owned : nodes) {
+    Node *n = owned.get();
+    at(n->bootDelay, [n] { powerOn(n); });
+  }
+  if (!opt.scenario.empty()) loadScenario(opt.scenario);
+
+  signal(SIGINT, onSigint);
+  wallStart = wallSeconds();
+  if (!opt.quiet) at(0, [end] { progress(end); });
+  run(end);
+  double wall = wallSeconds() - wallStart;
+  double simSeconds = (double)now() / SEC;
+  if (!opt.quiet) fprintf(stderr, "\n");
+  if (interrupted) fprintf(stderr, "interrupted at %.1f s\n", simSeconds);
+
+  size_t written = writeEventCsv(opt.output);
+  printSummary(stdout, simSeconds, wall, written, opt.output);
+  if (!opt.statsFile.empty()) {
+    FILE *f = fopen(opt.statsFile.c_str(), "w");
+    if (!f) fail(opt.statsFile, strerror(errno));
+    printSummary(f, simSeconds, wall, written, opt.output);
+    fclose(f);
+  }
+
+  closeNodes();
+  return 0;
+}
@@ -0,0 +1,146 @@
+// Radio medium: who hears a transmission, and how strongly.
+//
+// Received power = TX power - log-distance path loss - static shadowing of the
+// link (log-normal, symmetric) - per-packet fading. Links can be forced to a fixed
+// loss or cut entirely from the topology or scenario file. Reception itself
+// (detection, capture, collisions) is decided by each receiving chip (sx1262.cpp).
+#include "sim.h"
+
+#include <math.h>
+
+#include <map>
+
+namespace sim {
+
+MediumStats mediumStats;
+
+namespace {
+
+std::deque<std::shared_ptr<Transmission>> onAir;   // ordered by start time
+std::vector<double> shadowing;                      // n x n, symmetric
+std::map<std::pair<int, int>, double> overrides;
+uint64_t nextTxId = 1;
+std::mt19937_64 fadingRng;
+Time longestAirtime = 0;
+
+size_t idx(int a, int b) { return (size_t)a * nodes.size() + (size_t)b; }
+
+// Transmissions are kept this long after they end: a receiver locked on a long
+// frame still needs everything that overlapped it
+const Time KEEP_ENDED = 1 * SEC;
+
+void prune(Time t) {
+  while (!onAir.empty() && onAir.front()->end + longestAirtime + KEEP_ENDED < t) onAir.pop_front();
+}
+
+}  // namespace
+
+double symbolTimeNs(uint8_t sf, uint8_t bw) {
+  uint32_t hz = bandwidthHz(bw);
+  return hz ? (double)(1ULL << sf) * 1e9 / hz : 1e9;
+}
+
+double noiseFloorDbm(uint8_t bw) {
+  uint32_t hz = bandwidthHz(bw);
+  return -174.0 + 10.0 * log10((double)(hz ? hz : 125000)) + cfg.noiseFigureDb;
+}
+
+// Demodulation floor of the SX126x (datasheet sensitivity table)
+double snrLimitDb(uint8_t sf) { return -2.5 * ((int)sf - 4); }
+
+void mediumInit() {
+  size_t n = nodes.size();
+  shadowing.assign(n * n, 0.0);
+  std::mt19937_64 rng(cfg.seed * 2654435761ULL + 17);
+  std::normal_distribution<double> gauss(0.0, cfg.shadowingDb);
+  for (size_t a = 0; a < n; a++) {
+    for (size_t b = a + 1; b < n; b++) {
+      double s = cfg.shadowingDb > 0 ? gauss(rng) : 0.0;
+      shadowing[idx((int)a, (int)b)] = s;
+      shadowing[idx((int)b, (int)a)] = s;
+    }
+  }
+  fadingRng.seed(cfg.seed * 40503ULL + 3);
+}
+
+double linkLossDb(int a, int b, double freqHz) {
+  auto it = overrides.find(std::make_pair(std::min(a, b), std::max(a, b)));
+  if (it != overrides.end()) return it->second;
+
+  const Node *na = nodes[(size_t)a].get();
+  const Node *nb = nodes[(size_t)b].get();
+  double d = hypot(na->x - nb->x, na->y - nb->y);
+  if (d < 1.0) d = 1.0;
+  // Free space up to 1 m, then the log-distance slope
+  double fspl1m = 20.0 * log10(4.0 * M_PI * freqHz / 299792458.0);
+  return fspl1m + 10.0 * cfg.pathLossExp * log10(d) + shadowing[idx(a, b)];
+}
+
+void setLinkLoss(int a, int b, double lossDb) {
+  auto key = std::make_pair(std::min(a, b), std::max(a, b));
+  if (isnan(lossDb)) {
+    overrides.erase(key);
+  } else {
+    overrides[key] = lossDb;
+  }
+}
+
+void nodeMoved(Node *) {
+  // Path loss is computed from the positions on every transmission, nothing cached
+}
+
+void transmit(const std::shared_ptr<Transmission> &tx) {
+  prune(tx->start);
+  tx->id = nextTxId++;
+  size_t n = nodes.size();
+  tx->rxDbm.assign(n, -INFINITY);
+  std::normal_distribution<double> fade(0.0, cfg.fadingDb);
+  for (size_t i = 0; i < n; i++) {
+    if ((int)i == tx->src->index) continue;
+    double loss = linkLossDb(tx->src->index, (int)i, tx->freq);
+    if (!isfinite(loss)) continue;
+    tx->rxDbm[i] = (float)(tx->txDbm - loss + (cfg.fadingDb > 0 ? fade(fadingRng) : 0.0));
+  }
+  onAir.push_back(tx);
+  if (tx->end - tx->start > longestAirtime) longestAirtime = tx->end - tx->start;
+  mediumStats.transmissions++;
+
+  // Receivers decide at the start of the frame whether they can pick it up
+  for (size_t i = 0; i < n; i++) {
+    Node *rx = nodes[i].get();
+    if (rx == tx->src || !rx->on || !rx->chip) continue;
+    if (!isfinite(tx->rxDbm[i])) continue;
+    chipOnAir(rx->chip.get(), tx.get());
+  }
+}
+
+void abortTransmission(Transmission *tx, Time t) {
+  if (t < tx->end) {
+    tx->end = t;
+    tx->aborted = true;
+  }
+}
+
+void overlapping(Time from, Time to, std::vector<Transmission *> &out) {
+  out.clear();
+  for (auto it = onAir.rbegin(); it != onAir.rend(); ++it) {
+    Transmission *tx = it->get();
+    if (tx->start + longestAirtime < from) break;  // everything earlier ended before `from`
+    if (tx->start <= to && tx->end >= from) out.push_back(tx);
+  }
+}
+
+double totalPowerMw(Node *rx, uint32_t freq, Time t) {
+  double mw = 0;
+  for (auto it = onAir.rbegin(); it != onAir.rend(); ++it) {
+    Transmission *tx = it->get();
+    if (tx->start + longestAirtime < t) break;
+    if (tx->start <= t && tx->end > t && tx->freq == freq) {
+      float p = tx->rxDbm[(size_t)rx->index];
+      if (isfinite(p)) mw += pow(10.0, p / 10.0);
+    }
+  }
+  return mw;
+}
+
+}  // namespace sim
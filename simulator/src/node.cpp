@@ -0,0 +1,180 @@
+// Virtual nodes: local clock, power cycling and the private firmware image per node.
+//
+// dlopen() shares a library that is already loaded, so every boot loads a fresh
+// copy of the image from an anonymous memfd. Each node thereby gets its own set
+// of firmware globals while calling into the single set of Arduino/FreeRTOS shims
+// this binary exports.
+#include "sim.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sim {
+
+std::vector<std::unique_ptr<Node>> nodes;
+Node *curNode = nullptr;
+
+namespace {
+
+struct Image {
+  std::string path;
+  std::vector<char> bytes;
+};
+Image nodeImage, gatewayImage;
+
+// ESP32: first instruction of setup() some 300 ms after power-on
+const Time BOOT_TIME = 300 * MS;
+
+bool readImage(const std::string &path, Image &img) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  img.path = path;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) img.bytes.insert(img.bytes.end(), buf, buf + n);
+  fclose(f);
+  return !img.bytes.empty();
+}
+
+}  // namespace
+
+Node::Node() : eeprom(4096, 0xFF) {}
+
+Node::~Node() {
+  if (log) fclose(log);
+}
+
+int64_t Node::localUs(Time t) const {
+  if (t <= bootTime) return 0;
+  return (int64_t)floor((double)(t - bootTime) * (1.0 + ppm * 1e-6) / 1000.0);
+}
+
+Time Node::trueTime(int64_t us) const {
+  return bootTime + (Time)ceil((double)us * 1000.0 / (1.0 + ppm * 1e-6));
+}
+
+bool loadImages(const std::string &dir) {
+  if (!readImage(dir + "/node.so", nodeImage)) {
+    fprintf(stderr, "cannot read %s/node.so (run make first)\n", dir.c_str());
+    return false;
+  }
+  if (!readImage(dir + "/gateway.so", gatewayImage)) {
+    fprintf(stderr, "cannot read %s/gateway.so (run make first)\n", dir.c_str());
+    return false;
+  }
+  return true;
+}
+
+static void openImage(Node *n) {
+  const Image &img = n->gateway ? gatewayImage : nodeImage;
+  int fd = memfd_create(n->gateway ? "gateway.so" : "node.so", MFD_CLOEXEC);
+  if (fd < 0) {
+    perror("memfd_create");
+    exit(1);
+  }
+  size_t off = 0;
+  while (off < img.bytes.size()) {
+    ssize_t w = write(fd, img.bytes.data() + off, img.bytes.size() - off);
+    if (w <= 0) {
+      perror("write image");
+      exit(1);
+    }
+    off += (size_t)w;
+  }
+
+  // Static constructors of the image (SX126x, Serial users) run inside dlopen()
+  NodeContext ctx(n);
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+  void *h = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!h) {
+    fprintf(stderr, "dlopen %s: %s\n", img.path.c_str(), dlerror());
+    exit(1);
+  }
+  // The fd stays open while the image is loaded: its /proc path is the library name,
+  // and a reused name would make dlopen() hand out the already loaded copy
+  n->imageFd = fd;
+  n->image = h;
+  n->info = (const SimImageInfo *)dlsym(h, "sim_image_info");
+  if (!n->info || n->info->abi != SIM_IMAGE_ABI) {
+    fprintf(stderr, "%s: not a simulator image of this version\n", img.path.c_str());
+    exit(1);
+  }
+  *(uint16_t *)dlsym(h, "sim_device_id") = n->id;
+  *(uint8_t *)dlsym(h, "sim_slot_device") = n->slot;
+}
+
+static void closeImage(Node *n) {
+  if (!n->image) return;
+  NodeContext ctx(n);
+  dlclose(n->image);
+  close(n->imageFd);
+  n->image = nullptr;
+  n->imageFd = -1;
+  n->info = nullptr;
+}
+
+void powerOn(Node *n) {
+  if (n->on) return;
+  Time t = now();
+  n->on = true;
+  n->bootTime = t;
+  n->stats.boots++;
+  n->stats.joinDelay = -1;
+  n->rng.seed(cfg.seed * 1000003ULL + (uint64_t)n->index * 7919ULL + n->stats.boots);
+  memset(n->pinLevel, 0, sizeof(n->pinLevel));
+  for (auto &isr : n->isr) isr = Isr();
+  n->uartFreeAt = t;
+  n->logLineStart = true;
+  n->wifiBegun = false;
+  n->ntpRequested = false;
+  n->spiClock = 1000000;
+  n->chip.reset(makeChip(n));
+
+  openImage(n);
+
+  void (*loopTask)(void *) = (void (*)(void *))dlsym(n->image, "sim_loop_task");
+  n->tasks.push_back(spawn(n, "loopTask", loopTask, nullptr, t + BOOT_TIME));
+}
+
+void powerOff(Node *n) {
+  if (!n->on) return;
+  n->on = false;
+  n->gen++;
+  for (Task *t : n->tasks) kill(t);
+  n->tasks.clear();
+  if (n->chip) chipPowerOff(n->chip.get());
+  closeImage(n);
+  n->chip.reset();
+  n->rtos.clear();
+  n->timers.clear();
+  n->sockets.clear();
+  n->serialIn.clear();
+}
+
+void reboot(Node *n) {
+  powerOff(n);
+  powerOn(n);
+}
+
+void runIsr(Node *n, int pin) {
+  if (!n->on || pin < 0 || pin >= 64) return;
+  Isr &isr = n->isr[pin];
+  NodeContext ctx(n);
+  if (isr.fnArg) {
+    isr.fnArg(isr.arg);
+  } else if (isr.fn) {
+    isr.fn();
+  }
+}
+
+void closeNodes() {
+  for (auto &n : nodes) powerOff(n.get());
+}
+
+}  // namespace sim
@@ -0,0 +1,308 @@
+// Event loop and the coroutines the firmware tasks run on.
+//
+// Everything runs on one host thread, so a run is deterministic for a given seed.
+// Tasks switch with a few instructions of assembly on x86-64 (ucontext elsewhere):
+// a 100-node network wakes some 10^5 tasks per simulated second.
+#include "sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <queue>
+
+#if !defined(__x86_64__)
+#include <ucontext.h>
+#endif
+
+namespace sim {
+
+namespace {
+
+struct Event {
+  Time t;
+  uint64_t seq;
+  std::function<void()> fn;
+};
+
+struct Later {
+  bool operator()(const Event &a, const Event &b) const {
+    return a.t > b.t || (a.t == b.t && a.seq > b.seq);
+  }
+};
+
+std::priority_queue<Event, std::vector<Event>, Later> queue;
+uint64_t eventSeq = 0;
+uint64_t eventCount = 0;
+Time clock = 0;
+bool stopping = false;
+Task *running = nullptr;
+std::vector<std::unique_ptr<Task>> allTasks;
+
+const size_t STACK_SIZE = 256 * 1024;
+const size_t GUARD_SIZE = 4096;
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// Context switch
+// ---------------------------------------------------------------------------
+
+#if defined(__x86_64__)
+
+extern "C" void sim_switch(void **save, void *to);
+extern "C" void sim_task_trampoline();
+
+// Callee-saved registers go on the stack, the stack pointer into *save
+asm(R"(
+    .text
+    .globl sim_switch
+    .type sim_switch, @function
+sim_switch:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size sim_switch, .-sim_switch
+
+    .globl sim_task_trampoline
+    .type sim_task_trampoline, @function
+sim_task_trampoline:
+    movq %r13, %rdi
+    callq *%r12
+    ud2
+    .size sim_task_trampoline, .-sim_task_trampoline
+)");
+
+static void *schedulerSp = nullptr;
+
+static void taskMain(Task *t);
+
+static void prepareStack(Task *t) {
+  uintptr_t top = ((uintptr_t)t->stack + t->stackSize) & ~(uintptr_t)15;
+  // After the six pops and the ret into the trampoline the stack is 16-byte aligned
+  void **sp = (void **)(top - 16 - 8 - 6 * sizeof(void *));
+  sp[0] = nullptr;                              // r15
+  sp[1] = nullptr;                              // r14
+  sp[2] = t;                                    // r13: argument
+  sp[3] = (void *)&taskMain;                    // r12: entry
+  sp[4] = nullptr;                              // rbx
+  sp[5] = nullptr;                              // rbp
+  sp[6] = (void *)&sim_task_trampoline;         // return address
+  t->sp = sp;
+}
+
+static void switchToTask(Task *t) { sim_switch(&schedulerSp, t->sp); }
+static void switchToScheduler(Task *t) { sim_switch(&t->sp, schedulerSp); }
+
+#else
+
+static ucontext_t schedulerCtx;
+struct TaskCtx {
+  ucontext_t ctx;
+};
+static void taskMain(Task *t);
+
+static void ucontextEntry(unsigned hi, unsigned lo) {
+  taskMain((Task *)(((uintptr_t)hi << 32) | lo));
+}
+
+static void prepareStack(Task *t) {
+  TaskCtx *c = new TaskCtx;
+  getcontext(&c->ctx);
+  c->ctx.uc_stack.ss_sp = t->stack;
+  c->ctx.uc_stack.ss_size = t->stackSize;
+  c->ctx.uc_link = nullptr;
+  uintptr_t p = (uintptr_t)t;
+  makecontext(&c->ctx, (void (*)())ucontextEntry, 2, (unsigned)(p >> 32), (unsigned)p);
+  t->sp = c;
+}
+
+static void switchToTask(Task *t) { swapcontext(&schedulerCtx, &((TaskCtx *)t->sp)->ctx); }
+static void switchToScheduler(Task *t) { swapcontext(&((TaskCtx *)t->sp)->ctx, &schedulerCtx); }
+
+#endif
+
+// ---------------------------------------------------------------------------
+// Event loop
+// ---------------------------------------------------------------------------
+
+Time now() { return running ? running->now : clock; }
+
+void at(Time t, std::function<void()> fn) {
+  if (t < clock) t = clock;
+  queue.push(Event{t, eventSeq++, std::move(fn)});
+}
+
+bool run(Time end) {
+  stopping = false;
+  while (!queue.empty() && !stopping) {
+    if (queue.top().t > end) break;
+    // The handler may schedule more events, so take it out of the heap first
+    Event ev = std::move(const_cast<Event &>(queue.top()));
+    queue.pop();
+    clock = ev.t;
+    eventCount++;
+    ev.fn();
+  }
+  if (!stopping && clock < end) clock = end;
+  return !stopping;
+}
+
+void stop() { stopping = true; }
+
+uint64_t eventsRun() { return eventCount; }
+
+// ---------------------------------------------------------------------------
+// Tasks
+// ---------------------------------------------------------------------------
+
+Task *current() { return running; }
+
+static void resume(Task *t, uint64_t seq) {
+  if (t->dead || t->seq != seq) return;
+  Task *outer = running;
+  Node *outerNode = curNode;
+  if (t->now < clock) t->now = clock;
+  running = t;
+  curNode = t->node;
+  switchToTask(t);
+  running = outer;
+  curNode = outerNode;
+}
+
+// Give the CPU back to the event loop; returns once something resumed this task
+static void block() {
+  Task *t = running;
+  switchToScheduler(t);
+}
+
+static void taskMain(Task *t) {
+  t->fn(t->arg);
+  // A FreeRTOS task must not return; treat it like vTaskDelete(NULL)
+  t->dead = true;
+  block();
+  abort();
+}
+
+Task *spawn(Node *node, const char *name, void (*fn)(void *), void *arg, Time start) {
+  std::unique_ptr<Task> owned(new Task);
+  Task *t = owned.get();
+  t->node = node;
+  t->name = name ? name : "";
+  t->fn = fn;
+  t->arg = arg;
+  t->stackSize = STACK_SIZE;
+  void *mem = mmap(nullptr, STACK_SIZE + GUARD_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mem == MAP_FAILED) {
+    perror("mmap task stack");
+    exit(1);
+  }
+  mprotect(mem, GUARD_SIZE, PROT_NONE);  // overflow faults instead of corrupting a neighbour
+  t->stack = (char *)mem + GUARD_SIZE;
+  prepareStack(t);
+  t->now = start;
+  uint64_t seq = ++t->seq;
+  at(start, [t, seq] { resume(t, seq); });
+  allTasks.push_back(std::move(owned));
+  return t;
+}
+
+void kill(Task *t) {
+  if (t->dead && t->stack == nullptr) return;
+  t->dead = true;
+  t->seq++;
+  if (t->stack) {
+    munmap(t->stack - GUARD_SIZE, t->stackSize + GUARD_SIZE);
+    t->stack = nullptr;
+  }
+#if !defined(__x86_64__)
+  delete (TaskCtx *)t->sp;
+#endif
+  t->sp = nullptr;
+}
+
+void spend(Time dt) {
+  if (running) running->now += dt;
+}
+
+void sync() {
+  Task *t = running;
+  if (!t) return;
+  if (!queue.empty() && queue.top().t < t->now) {
+    uint64_t seq = ++t->seq;
+    at(t->now, [t, seq] { resume(t, seq); });
+    block();
+  } else {
+    clock = t->now;
+  }
+}
+
+void sleepUntil(Time when) {
+  Task *t = running;
+  if (!t) return;
+  if (when < t->now) when = t->now;
+  uint64_t seq = ++t->seq;
+  at(when, [t, seq] { resume(t, seq); });
+  block();
+}
+
+bool wait(WaitList &list, Time deadline) {
+  Task *t = running;
+  if (!t) return false;
+  t->waitingOn = &list;
+  t->notified = false;
+  list.waiters.push_back(t);
+  uint64_t seq = ++t->seq;
+  if (deadline >= 0) {
+    at(deadline < t->now ? t->now : deadline, [t, seq] {
+      if (t->dead || t->seq != seq) return;
+      WaitList *l = t->waitingOn;
+      for (auto it = l->waiters.begin(); it != l->waiters.end(); ++it) {
+        if (*it == t) {
+          l->waiters.erase(it);
+          break;
+        }
+      }
+      t->waitingOn = nullptr;
+      resume(t, seq);
+    });
+  }
+  block();
+  return t->notified;
+}
+
+bool wake(WaitList &list, Time latency) {
+  while (!list.waiters.empty()) {
+    Task *t = list.waiters.front();
+    list.waiters.pop_front();
+    if (t->dead) continue;
+    t->waitingOn = nullptr;
+    t->notified = true;
+    // New sequence number: the pending timeout of this wait is now stale
+    uint64_t seq = ++t->seq;
+    at(now() + latency, [t, seq] { resume(t, seq); });
+    return true;
+  }
+  return false;
+}
+
+void park() {
+  Task *t = running;
+  t->seq++;
+  for (;;) block();
+}
+
+}  // namespace sim
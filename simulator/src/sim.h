@@ -0,0 +1,305 @@
+// Simulator internals shared by the host modules.
+//
+// One event loop drives everything on a single virtual clock (ns). Firmware tasks
+// are coroutines: a task runs on its own time line (Task::now), which is ahead of
+// the event loop while it computes, and sync() lines the two up again before the
+// task touches anything another node or an interrupt could have changed.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sim_image.h"
+
+namespace sim {
+
+typedef int64_t Time;  // simulated time, ns
+constexpr Time US = 1000;
+constexpr Time MS = 1000 * US;
+constexpr Time SEC = 1000 * MS;
+
+struct Node;
+struct Chip;
+struct Transmission;
+
+// ---------------------------------------------------------------------------
+// Event loop and tasks (scheduler.cpp)
+// ---------------------------------------------------------------------------
+
+// Time as seen by whoever runs: the running task's time or the current event's
+Time now();
+void at(Time t, std::function<void()> fn);
+// Run events up to and including `end`, false if stopped early
+bool run(Time end);
+void stop();
+uint64_t eventsRun();
+
+struct WaitList;
+
+struct Task {
+  Node *node = nullptr;
+  std::string name;
+  Time now = 0;
+  uint64_t seq = 0;           // bumped on every block and wake, older wake-ups are stale
+  WaitList *waitingOn = nullptr;
+  bool notified = false;
+  bool dead = false;
+  void (*fn)(void *) = nullptr;
+  void *arg = nullptr;
+  void *sp = nullptr;
+  char *stack = nullptr;
+  size_t stackSize = 0;
+};
+
+struct WaitList {
+  std::deque<Task *> waiters;
+};
+
+Task *current();
+Task *spawn(Node *node, const char *name, void (*fn)(void *), void *arg, Time start);
+void kill(Task *task);
+// CPU time used by the running task (ignored in interrupt context)
+void spend(Time dt);
+// Let every event earlier than the running task's time happen first
+void sync();
+// Block the running task until t
+void sleepUntil(Time t);
+// Block on a wait list until woken or `deadline` (< 0: no deadline). True if woken.
+bool wait(WaitList &list, Time deadline);
+// Wake the first waiter after `latency`, false if nobody waits
+bool wake(WaitList &list, Time latency);
+// Block the running task for good (it is about to be killed)
+[[noreturn]] void park();
+
+// ---------------------------------------------------------------------------
+// Model parameters (main.cpp fills them from the command line)
+// ---------------------------------------------------------------------------
+
+struct Config {
+  uint64_t seed = 1;
+  double pathLossExp = 3.0;      // log-distance exponent
+  double shadowingDb = 4.0;      // sigma of the static per-link shadowing
+  double fadingDb = 2.0;         // sigma of the per-packet fading
+  double captureDb = 6.0;        // co-SF signal-to-interference needed to survive a collision
+  double interSfDb = -16.0;      // same, for interferers on another spreading factor
+  double noiseFigureDb = 6.0;
+  int64_t epochUs = 1767225600LL * 1000000;  // wall clock at t=0 (2026-01-01 00:00:00 UTC)
+  Time wifiLatency = 3 * MS;     // node -> collector UDP delay
+  bool uartTiming = true;        // Serial writes block like the 115200 Bd UART does
+};
+extern Config cfg;
+
+// ---------------------------------------------------------------------------
+// Nodes (node.cpp)
+// ---------------------------------------------------------------------------
+
+struct Isr {
+  void (*fn)(void) = nullptr;
+  void (*fnArg)(void *) = nullptr;
+  void *arg = nullptr;
+  int mode = 0;
+};
+
+// Semaphore, mutex or queue created by the firmware (freertos.cpp)
+struct RtosObject {
+  enum Kind { SEMAPHORE, MUTEX, QUEUE } kind = SEMAPHORE;
+  uint32_t count = 0, maxCount = 1;  // semaphores
+  size_t itemSize = 0, length = 0;   // queues
+  std::deque<std::vector<uint8_t>> items;
+  WaitList takers;                   // waiting for a token or an item
+  WaitList senders;                  // waiting for room in a queue
+};
+
+// Hardware timer of the Arduino-ESP32 3.x API (freertos.cpp)
+struct HwTimer {
+  Node *node = nullptr;
+  uint32_t frequency = 1000000;
+  bool running = true;
+  int64_t baseUs = 0;       // local time the counter was last set
+  uint64_t baseCount = 0;   // counter value then
+  uint64_t alarm = 0;
+  bool alarmEnabled = false;
+  bool autoreload = false;
+  uint64_t reloadCount = 0;
+  uint32_t armed = 0;       // bumped on every (re)arm, drops stale alarm events
+  void (*isr)(void) = nullptr;
+};
+
+// UDP endpoint of a WiFiUDP object (wifi.cpp)
+struct UdpSocket {
+  uint16_t port = 0;
+  std::deque<std::string> inbox;
+  std::string reading;      // datagram returned by the last parsePacket()
+  size_t readPos = 0;
+  std::string outgoing;
+  uint16_t destPort = 0;
+  bool sending = false;
+};
+
+struct ChipDeleter {
+  void operator()(Chip *c) const;
+};
+
+struct NodeStats {
+  uint32_t boots = 0;
+  uint32_t txFrames = 0;
+  uint32_t rxOk = 0;
+  uint32_t rxCrcErr = 0;
+  uint32_t rxCollisions = 0;  // CRC errors caused by interference
+  uint32_t datagrams = 0;     // UDP messages that reached the collector
+  Time txAirtime = 0;
+  Time joinDelay = -1;        // last boot to its JOIN event, -1 while not joined
+};
+
+struct Node {
+  int index = 0;
+  uint16_t id = 0;
+  bool gateway = false;
+  double x = 0, y = 0;
+  double ppm = 0;             // crystal error
+  Time bootDelay = 0;         // first power-on
+  uint8_t slot = 0;           // SLOT_DEVICE for FIX_SLOT 1 builds
+
+  // power and firmware image
+  bool on = false;
+  uint32_t gen = 0;           // bumped at power-off, drops the node's pending events
+  Time bootTime = 0;          // true time the local clock started
+  int imageFd = -1;
+  void *image = nullptr;
+  const SimImageInfo *info = nullptr;
+  std::vector<Task *> tasks;
+
+  // peripherals
+  uint8_t pinLevel[64] = {0};
+  Isr isr[64];
+  std::unique_ptr<Chip, ChipDeleter> chip;
+  std::vector<std::unique_ptr<RtosObject>> rtos;
+  std::vector<std::unique_ptr<HwTimer>> timers;
+  std::vector<uint8_t> eeprom;
+  size_t eepromSize = 0;
+  uint32_t spiClock = 1000000;
+  Time uartFreeAt = 0;        // the UART FIFO has drained by then
+
+  // serial console
+  FILE *log = nullptr;
+  bool logLineStart = true;
+  std::deque<char> serialIn;
+
+  // WiFi / NTP
+  bool wifiBegun = false;
+  Time wifiUpAt = 0;
+  bool ntpRequested = false;
+  Time ntpAt = 0;
+  double ntpErrorUs = 0;
+  std::vector<std::unique_ptr<UdpSocket>> sockets;
+
+  // sensors
+  float temperature = 0, humidity = 0, voltage = 0;
+
+  std::mt19937_64 rng;
+  NodeStats stats;
+
+  Node();
+  ~Node();
+
+  // Local crystal: microseconds since power-on
+  int64_t localUs(Time t) const;
+  // True time at which the local clock reads `us` (rounded up)
+  Time trueTime(int64_t us) const;
+  // FreeRTOS tick (1 ms) the local clock is in at t, and the start of tick k
+  uint32_t tick(Time t) const { return (uint32_t)(localUs(t) / 1000); }
+  Time tickTime(uint64_t k) const { return trueTime((int64_t)k * 1000); }
+};
+
+extern std::vector<std::unique_ptr<Node>> nodes;
+// Node whose code runs right now (task or interrupt), null outside node context
+extern Node *curNode;
+
+struct NodeContext {
+  Node *saved;
+  explicit NodeContext(Node *n) : saved(curNode) { curNode = n; }
+  ~NodeContext() { curNode = saved; }
+};
+
+bool loadImages(const std::string &dir);
+void powerOn(Node *n);
+void powerOff(Node *n);
+void reboot(Node *n);
+void runIsr(Node *n, int pin);
+void closeNodes();
+
+// ---------------------------------------------------------------------------
+// Radio medium (medium.cpp)
+// ---------------------------------------------------------------------------
+
+struct Transmission : std::enable_shared_from_this<Transmission> {
+  uint64_t id = 0;
+  Node *src = nullptr;
+  Time start = 0, end = 0;    // first preamble symbol .. last payload symbol
+  bool aborted = false;
+  uint32_t freq = 0;
+  uint8_t sf = 0, bw = 0, cr = 0;
+  uint16_t preamble = 0;
+  bool implicitHeader = false;
+  bool crcOn = false;
+  bool invertIq = false;
+  std::vector<uint8_t> payload;
+  double txDbm = 0;
+  std::vector<float> rxDbm;   // per node index, fading included
+};
+
+double symbolTimeNs(uint8_t sf, uint8_t bw);
+double noiseFloorDbm(uint8_t bw);
+double snrLimitDb(uint8_t sf);
+
+void mediumInit();
+void transmit(const std::shared_ptr<Transmission> &tx);
+void abortTransmission(Transmission *tx, Time t);
+// Transmissions on air at some point in [from, to]
+void overlapping(Time from, Time to, std::vector<Transmission *> &out);
+double totalPowerMw(Node *rx, uint32_t freq, Time t);
+// Static link budget overrides: NAN clears, +INF disconnects
+void setLinkLoss(int a, int b, double lossDb);
+double linkLossDb(int a, int b, double freqHz = 915e6);
+void nodeMoved(Node *n);
+
+struct MediumStats {
+  uint64_t transmissions = 0;
+  uint64_t delivered = 0;       // RX_DONE without error
+  uint64_t collisions = 0;      // lost to interference
+  uint64_t weak = 0;            // locked on but faded below the demodulation limit
+  uint64_t headerMismatch = 0;  // implicit/explicit header or length disagreement
+};
+extern MediumStats mediumStats;
+
+// ---------------------------------------------------------------------------
+// SX1262 (sx1262.cpp)
+// ---------------------------------------------------------------------------
+
+// LoRa timing from the driver's own formulas (Ra01S.h)
+uint32_t bandwidthHz(uint8_t bw);
+
+Chip *makeChip(Node *n);
+void chipPinWrite(Chip *c, int pin, int level, Time t);
+bool chipBusy(Chip *c, Time t);
+bool chipDio1(Chip *c);
+void chipTransfer(Chip *c, const uint8_t *out, uint8_t *in, size_t len, Time t);
+void chipPowerOff(Chip *c);
+void chipOnAir(Chip *c, Transmission *tx);
+
+// ---------------------------------------------------------------------------
+// WiFi, UDP and the monitoring collector (wifi.cpp)
+// ---------------------------------------------------------------------------
+
+void collectorInit(Time end);
+void sendCommand(int nodeId, const std::string &cmd);
+size_t writeEventCsv(const std::string &path);
+uint64_t collectorDatagrams();
+
+}  // namespace sim
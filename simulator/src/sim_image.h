@@ -0,0 +1,27 @@
+// Interface between the simulator and a node image (build/node.so, build/gateway.so)
+#pragma once
+
+#include <stdint.h>
+
+#define SIM_IMAGE_ABI 1
+
+extern "C" {
+
+typedef struct {
+  int abi;          // SIM_IMAGE_ABI
+  int isReference;  // IS_REFERENCE the image was built with
+  int pinNss;
+  int pinReset;
+  int pinBusy;
+  int pinDio1;
+  int pinTxen;
+  int pinRxen;
+  int monitorPort;  // MONITOR_UDP_PORT
+  int commandPort;  // COMMAND_UDP_PORT
+  int packetLength; // FIXED_PACKET_LENGTH
+} SimImageInfo;
+
+// Defined by every image (sim_node.inc), looked up with dlsym()
+extern const SimImageInfo sim_image_info;
+
+}
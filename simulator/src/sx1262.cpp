@@ -0,0 +1,677 @@
+// SX1262 at the SPI level: the unmodified Ra01S driver talks to this model byte by byte.
+//
+// The chip decodes opcodes and parameters, answers with status bytes, keeps the
+// 256-byte data buffer and the registers, raises IRQ flags and the DIO1 line, and
+// holds BUSY for as long as the real part needs to execute a command. On the air
+// side it transmits through the medium and receives with preamble detection,
+// capture of a stronger frame, and co-/inter-SF collision rules.
+#include "Arduino.h"
+#include "Ra01S.h"
+#include "sim.h"
+
+#include <math.h>
+
+namespace sim {
+
+namespace {
+
+// BUSY high times, roughly the SX1262 datasheet switching times
+const Time BUSY_DEFAULT = 2 * US;
+const Time BUSY_STANDBY = 10 * US;
+const Time BUSY_RX = 85 * US;        // STDBY_RC -> RX, receiver live when BUSY drops
+const Time BUSY_TX = 120 * US;       // STDBY_RC -> TX, PA ramp starts when BUSY drops
+const Time BUSY_FS = 50 * US;
+const Time BUSY_CALIBRATE = 3500 * US;
+const Time BUSY_CALIBRATE_IMAGE = 1500 * US;
+const Time BUSY_FREQUENCY = 20 * US;
+const Time WAKE_WARM = 340 * US;     // NSS edge in sleep -> STDBY_RC
+const Time WAKE_COLD = 3500 * US;
+const Time RESET_BUSY = 3500 * US;
+const Time ISR_LATENCY = 2 * US;
+// Preamble symbols the demodulator needs to lock
+const int DETECT_SYMBOLS = 4;
+
+const Time PA_RAMP_NS[8] = {10 * US, 20 * US, 40 * US, 80 * US, 200 * US, 800 * US, 1700 * US, 3400 * US};
+
+double mwOf(double dbm) { return pow(10.0, dbm / 10.0); }
+double dbmOf(double mw) { return 10.0 * log10(mw); }
+
+}  // namespace
+
+uint32_t bandwidthHz(uint8_t bw) { return SX126xBandwidthHz(bw); }
+
+struct Chip {
+  enum Mode { SLEEP, STBY_RC, STBY_XOSC, FS, TX, RX, CAD };
+
+  Node *node;
+  Mode mode = STBY_RC;
+  uint32_t epoch = 0;          // bumped whenever the mode changes
+  Time busyUntil = 0;
+  bool inReset = false;
+  bool warmSleep = true;
+
+  // SPI transaction in progress
+  bool selected = false;
+  bool waking = false;         // NSS edge that only wakes the chip, bytes are ignored
+  std::vector<uint8_t> cmd;
+
+  // configuration
+  uint8_t packetType = 0;
+  uint8_t sf = 7, bw = SX126X_LORA_BW_125_0, cr = SX126X_LORA_CR_4_5, ldro = 0;
+  uint8_t pkt[6] = {0, 8, 0, 0xFF, 1, 0};  // preamble, header type, length, CRC, IQ
+  uint32_t freqHz = 915000000;
+  int8_t txPower = 14;
+  uint8_t ramp = SX126X_PA_RAMP_200U;
+  uint16_t irqMask = 0, dio1Mask = 0;
+  uint16_t irq = 0;
+  bool dio1 = false;
+  bool stopOnPreamble = false;
+  uint8_t cadSymbols = SX126X_CAD_ON_2_SYMB, cadExit = SX126X_CAD_GOTO_STDBY;
+  uint32_t cadTimeout = 0;
+  uint8_t txBase = 0, rxBase = 0x80, rxPtr = 0x80;
+  uint8_t buffer[256];
+  std::vector<uint8_t> regs;
+
+  // last received frame
+  uint8_t rxLen = 0, rxStart = 0x80;
+  int8_t pktRssiDbm = -127;
+  float pktSnrDb = 0;
+
+  // TX
+  std::shared_ptr<Transmission> tx;
+  bool txOnAir = false;
+
+  // RX / CAD
+  bool rxContinuous = false;
+  Time rxLive = 0;             // receiver actually listening from
+  bool timerStopped = false;
+  std::shared_ptr<Transmission> locked;
+  Time lockedAt = 0;
+  Time headerAt = 0;
+  uint32_t lockSeq = 0;
+  Time cadStart = 0, cadEnd = 0;
+
+  std::vector<Transmission *> scratch;
+
+  explicit Chip(Node *n) : node(n), regs(65536, 0) { defaults(); }
+
+  void defaults() {
+    packetType = 0;
+    sf = 7;
+    bw = SX126X_LORA_BW_125_0;
+    cr = SX126X_LORA_CR_4_5;
+    ldro = 0;
+    uint8_t p[6] = {0, 8, 0, 0xFF, 1, 0};
+    memcpy(pkt, p, sizeof(pkt));
+    freqHz = 915000000;
+    txPower = 14;
+    ramp = SX126X_PA_RAMP_200U;
+    irqMask = dio1Mask = 0;
+    irq = 0;
+    dio1 = false;
+    stopOnPreamble = false;
+    txBase = 0;
+    rxBase = rxPtr = 0x80;
+    std::fill(regs.begin(), regs.end(), 0);
+    regs[SX126X_REG_LORA_SYNC_WORD_MSB] = SX126X_SYNC_WORD_PRIVATE >> 8;
+    regs[SX126X_REG_LORA_SYNC_WORD_LSB] = SX126X_SYNC_WORD_PRIVATE & 0xFF;
+    regs[SX126X_REG_OCP_CONFIGURATION] = 0x18;
+    regs[SX126X_REG_TX_MODULETION] = 0x04;
+    memset(buffer, 0, sizeof(buffer));
+  }
+
+  // ---- helpers ----
+
+  bool implicitHeader() const { return pkt[2] != 0; }
+  uint16_t preambleLength() const { return (uint16_t)(pkt[0] << 8 | pkt[1]); }
+  double symbolNs() const { return symbolTimeNs(sf, bw); }
+
+  // Run f(chip) at t unless the node was power-cycled or the chip changed mode meanwhile
+  template <typename F>
+  void later(Time t, F f, bool sameMode = true) {
+    Node *n = node;
+    uint32_t gen = n->gen, e = epoch;
+    at(t, [n, gen, e, sameMode, f] {
+      if (n->gen != gen || !n->chip) return;
+      Chip *c = n->chip.get();
+      if (sameMode && c->epoch != e) return;
+      f(c);
+    });
+  }
+
+  void setMode(Mode m, Time t) {
+    if (mode == TX && m != TX) stopTx(t);
+    if ((mode == RX || mode == CAD) && m != mode) unlock();
+    mode = m;
+    epoch++;
+  }
+
+  uint8_t status() const {
+    uint8_t chipMode;
+    switch (mode) {
+      case STBY_RC: chipMode = 2; break;
+      case STBY_XOSC: chipMode = 3; break;
+      case FS: chipMode = 4; break;
+      case RX:
+      case CAD: chipMode = 5; break;
+      case TX: chipMode = 6; break;
+      default: chipMode = 0; break;
+    }
+    return (uint8_t)(chipMode << 4 | 1 << 1);
+  }
+
+  void raise(uint16_t bits) {
+    irq |= bits & irqMask;
+    updateDio1();
+  }
+
+  void updateDio1() {
+    bool level = (irq & dio1Mask) != 0;
+    if (level && !dio1) {
+      // Rising edge: the ESP32 GPIO interrupt fires a moment later
+      Node *n = node;
+      uint32_t gen = n->gen;
+      int pin = n->info ? n->info->pinDio1 : -1;
+      at(now() + ISR_LATENCY, [n, gen, pin] {
+        if (n->gen != gen) return;
+        if (n->isr[pin].mode == RISING || n->isr[pin].mode == CHANGE) runIsr(n, pin);
+      });
+    }
+    dio1 = level;
+  }
+
+  uint8_t readRegister(uint16_t addr) {
+    if (addr >= SX126X_REG_RANDOM_NUMBER_0 && addr <= SX126X_REG_RANDOM_NUMBER_3) return (uint8_t)node->rng();
+    return regs[addr];
+  }
+
+  // ---- SPI ----
+
+  void nss(bool high, Time t) {
+    if (inReset) return;
+    if (!high) {
+      selected = true;
+      cmd.clear();
+      waking = false;
+      if (mode == SLEEP) {
+        // Any NSS falling edge wakes the chip; this transaction itself is lost
+        waking = true;
+        if (!warmSleep) defaults();
+        setMode(STBY_RC, t);
+        busyUntil = t + (warmSleep ? WAKE_WARM : WAKE_COLD);
+      }
+      return;
+    }
+    if (!selected) return;
+    selected = false;
+    if (!waking && !cmd.empty()) execute(t);
+    waking = false;
+  }
+
+  uint8_t respond(size_t pos) {
+    if (pos == 0) return status();
+    uint8_t op = cmd[0];
+    switch (op) {
+      case SX126X_CMD_READ_REGISTER:
+        if (pos < 4) return status();
+        return readRegister((uint16_t)((cmd[1] << 8 | cmd[2]) + (pos - 4)));
+      case SX126X_CMD_READ_BUFFER:
+        if (pos < 3) return status();
+        return buffer[(uint8_t)(cmd[1] + (pos - 3))];
+      case SX126X_CMD_GET_IRQ_STATUS:
+        if (pos == 1) return status();
+        return pos == 2 ? (uint8_t)(irq >> 8) : (uint8_t)irq;
+      case SX126X_CMD_GET_RX_BUFFER_STATUS:
+        if (pos == 1) return status();
+        return pos == 2 ? rxLen : rxStart;
+      case SX126X_CMD_GET_PACKET_STATUS: {
+        if (pos == 1) return status();
+        if (pos == 3) {
+          float snr = std::max(-32.0f, std::min(31.75f, pktSnrDb));
+          return (uint8_t)(int8_t)lrintf(snr * 4.0f);
+        }
+        return (uint8_t)std::min(255, -pktRssiDbm * 2);
+      }
+      case SX126X_CMD_GET_RSSI_INST: {
+        if (pos == 1) return status();
+        double dbm = dbmOf(mwOf(noiseFloorDbm(bw)) + totalPowerMw(node, freqHz, now()));
+        return (uint8_t)std::max(0.0, std::min(255.0, -dbm * 2.0));
+      }
+      case SX126X_CMD_GET_PACKET_TYPE:
+        return pos == 1 ? status() : packetType;
+      case SX126X_CMD_GET_DEVICE_ERRORS:
+      case SX126X_CMD_GET_STATS:
+        return pos == 1 ? status() : 0;
+      default:
+        return status();
+    }
+  }
+
+  void transfer(const uint8_t *out, uint8_t *in, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      size_t pos = cmd.size();
+      cmd.push_back(out ? out[i] : 0);
+      uint8_t r = (!selected || waking) ? 0xFF : respond(pos);
+      if (in) in[i] = r;
+    }
+  }
+
+  void execute(Time t) {
+    const uint8_t *p = cmd.data() + 1;
+    size_t n = cmd.size() - 1;
+    auto u24 = [&](size_t i) { return n >= i + 3 ? (uint32_t)(p[i] << 16 | p[i + 1] << 8 | p[i + 2]) : 0u; };
+    Time busy = BUSY_DEFAULT;
+
+    switch (cmd[0]) {
+      case SX126X_CMD_SET_SLEEP:
+        setMode(SLEEP, t);
+        warmSleep = n > 0 && (p[0] & SX126X_SLEEP_START_WARM);
+        memset(buffer, 0, sizeof(buffer));  // the data buffer does not survive sleep
+        busy = 0;
+        break;
+      case SX126X_CMD_SET_STANDBY:
+        if (mode != STBY_RC && mode != STBY_XOSC) busy = BUSY_STANDBY;
+        setMode(n > 0 && p[0] ? STBY_XOSC : STBY_RC, t);
+        break;
+      case SX126X_CMD_SET_FS:
+        setMode(FS, t);
+        busy = BUSY_FS;
+        break;
+      case SX126X_CMD_SET_TX:
+        busy = BUSY_TX;
+        startTx(t, t + busy, u24(0));
+        break;
+      case SX126X_CMD_SET_RX:
+        busy = BUSY_RX;
+        startRx(t, t + busy, u24(0), true);
+        break;
+      case SX126X_CMD_SET_CAD:
+        busy = BUSY_RX;
+        startCad(t, t + busy);
+        break;
+      case SX126X_CMD_STOP_TIMER_ON_PREAMBLE:
+        stopOnPreamble = n > 0 && p[0];
+        break;
+      case SX126X_CMD_SET_CAD_PARAMS:
+        if (n >= 7) {
+          cadSymbols = p[0];
+          cadExit = p[3];
+          cadTimeout = u24(4);
+        }
+        break;
+      case SX126X_CMD_CALIBRATE:
+        busy = BUSY_CALIBRATE;
+        break;
+      case SX126X_CMD_CALIBRATE_IMAGE:
+        busy = BUSY_CALIBRATE_IMAGE;
+        break;
+      case SX126X_CMD_WRITE_REGISTER:
+        if (n >= 2) {
+          uint16_t addr = (uint16_t)(p[0] << 8 | p[1]);
+          for (size_t i = 2; i < n; i++) regs[(uint16_t)(addr + i - 2)] = p[i];
+        }
+        break;
+      case SX126X_CMD_WRITE_BUFFER:
+        if (n >= 1) {
+          for (size_t i = 1; i < n; i++) buffer[(uint8_t)(p[0] + i - 1)] = p[i];
+        }
+        break;
+      case SX126X_CMD_SET_DIO_IRQ_PARAMS:
+        if (n >= 4) {
+          irqMask = (uint16_t)(p[0] << 8 | p[1]);
+          dio1Mask = (uint16_t)(p[2] << 8 | p[3]);
+          irq &= irqMask;
+          updateDio1();
+        }
+        break;
+      case SX126X_CMD_CLEAR_IRQ_STATUS:
+        if (n >= 2) {
+          irq &= (uint16_t)~(p[0] << 8 | p[1]);
+          updateDio1();
+        }
+        break;
+      case SX126X_CMD_SET_RF_FREQUENCY:
+        if (n >= 4) {
+          uint32_t raw = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+          freqHz = (uint32_t)llround((double)raw * 32e6 / (double)(1 << 25));
+        }
+        busy = BUSY_FREQUENCY;
+        break;
+      case SX126X_CMD_SET_PACKET_TYPE:
+        if (n >= 1) packetType = p[0];
+        break;
+      case SX126X_CMD_SET_TX_PARAMS:
+        if (n >= 2) {
+          txPower = (int8_t)p[0];
+          ramp = p[1] & 7;
+        }
+        break;
+      case SX126X_CMD_SET_MODULATION_PARAMS:
+        if (n >= 4) {
+          sf = p[0];
+          bw = p[1];
+          cr = p[2];
+          ldro = p[3];
+        }
+        break;
+      case SX126X_CMD_SET_PACKET_PARAMS:
+        for (size_t i = 0; i < 6 && i < n; i++) pkt[i] = p[i];
+        break;
+      case SX126X_CMD_SET_BUFFER_BASE_ADDRESS:
+        if (n >= 2) {
+          txBase = p[0];
+          rxBase = p[1];
+        }
+        break;
+      default:
+        // Regulator, PA config, DIO2/DIO3 control, symbol timeout, ...: accepted, nothing to model
+        break;
+    }
+    busyUntil = t + busy;
+  }
+
+  // ---- TX ----
+
+  void startTx(Time t, Time ready, uint32_t timeoutTicks) {
+    setMode(TX, t);
+    uint8_t len = pkt[3];
+    auto frame = std::make_shared<Transmission>();
+    frame->src = node;
+    frame->freq = freqHz;
+    frame->sf = sf;
+    frame->bw = bw;
+    frame->cr = cr;
+    frame->preamble = preambleLength();
+    frame->implicitHeader = implicitHeader();
+    frame->crcOn = pkt[4] != 0;
+    frame->invertIq = pkt[5] != 0;
+    frame->payload.resize(len);
+    for (uint8_t i = 0; i < len; i++) frame->payload[i] = buffer[(uint8_t)(txBase + i)];
+    frame->txDbm = txPower;
+    frame->start = ready + PA_RAMP_NS[ramp & 7];
+    frame->end = frame->start + (Time)SX126xTimeOnAirUs(sf, bw, cr, frame->preamble, len,
+                                                        frame->implicitHeader, frame->crcOn) * US;
+    tx = frame;
+    txOnAir = false;
+
+    later(frame->start, [](Chip *c) {
+      c->txOnAir = true;
+      c->node->stats.txFrames++;
+      c->node->stats.txAirtime += c->tx->end - c->tx->start;
+      transmit(c->tx);
+    });
+    later(frame->end, [](Chip *c) {
+      c->txOnAir = false;
+      c->tx.reset();
+      c->setMode(STBY_RC, now());
+      c->raise(SX126X_IRQ_TX_DONE);
+    });
+    if (timeoutTicks != 0) {
+      Time deadline = t + (Time)timeoutTicks * 15625;
+      if (deadline < frame->end) {
+        later(deadline, [](Chip *c) {
+          c->setMode(STBY_RC, now());
+          c->raise(SX126X_IRQ_TIMEOUT);
+        });
+      }
+    }
+  }
+
+  // Leaving TX early cuts the frame short for everyone listening
+  void stopTx(Time t) {
+    if (tx && txOnAir) abortTransmission(tx.get(), t);
+    tx.reset();
+    txOnAir = false;
+  }
+
+  // ---- RX ----
+
+  void startRx(Time t, Time live, uint32_t timeoutTicks, bool fromCommand) {
+    setMode(RX, t);
+    rxContinuous = (timeoutTicks == 0xFFFFFF);
+    rxLive = live;
+    timerStopped = false;
+    if (fromCommand) rxPtr = rxBase;
+    if (!rxContinuous && timeoutTicks != 0) {
+      later(live + (Time)timeoutTicks * 15625, [](Chip *c) { c->rxTimeout(); });
+    }
+    scan(live);
+  }
+
+  void unlock() {
+    locked.reset();
+    lockSeq++;
+  }
+
+  // Frames already on air that the receiver can still lock on when it starts listening at `from`
+  void scan(Time from) {
+    overlapping(from, from, scratch);
+    std::vector<Transmission *> candidates(scratch);
+    for (Transmission *t : candidates) consider(t, from);
+  }
+
+  double rxDbm(const Transmission *t) const { return t->rxDbm[(size_t)node->index]; }
+
+  bool decodable(const Transmission *t) const {
+    return t->freq == freqHz && t->sf == sf && t->bw == bw && t->invertIq == (pkt[5] != 0);
+  }
+
+  // Schedule preamble detection of t if the receiver can still catch enough of its preamble
+  void consider(Transmission *t, Time from) {
+    if (mode != RX || t->src == node || t->aborted || !decodable(t)) return;
+    double ts = symbolNs();
+    Time listen = std::max(std::max(t->start, rxLive), from);
+    Time detect = listen + (Time)(DETECT_SYMBOLS * ts);
+    if (detect > t->start + (Time)(t->preamble * ts)) return;
+    double p = rxDbm(t);
+    if (!std::isfinite(p) || p - noiseFloorDbm(bw) < snrLimitDb(sf)) return;
+    if (locked && !(p >= rxDbm(locked.get()) + cfg.captureDb && detect < headerAt)) return;
+
+    // The event keeps the frame alive until it has run
+    std::shared_ptr<Transmission> ref = t->shared_from_this();
+    later(detect, [ref](Chip *c) { c->detected(ref); });
+  }
+
+  void detected(const std::shared_ptr<Transmission> &t) {
+    if (mode != RX || t->aborted || t == locked) return;
+    // A clearly stronger frame takes over a lock that has not reached its header yet
+    if (locked && (now() >= headerAt || rxDbm(t.get()) < rxDbm(locked.get()) + cfg.captureDb)) return;
+    lock(t);
+  }
+
+  void lock(const std::shared_ptr<Transmission> &t) {
+    unlock();
+    locked = t;
+    lockedAt = now();
+    double ts = symbolNs();
+    headerAt = t->start + (Time)((t->preamble + 4.25 + 8) * ts);
+    raise(SX126X_IRQ_PREAMBLE_DETECTED);
+    if (stopOnPreamble) timerStopped = true;
+    uint32_t seq = lockSeq;
+    Time end = t->end;
+    later(headerAt, [seq](Chip *c) {
+      if (c->lockSeq == seq) c->header();
+    });
+    later(end, [seq](Chip *c) {
+      if (c->lockSeq == seq) c->rxEnd();
+    });
+  }
+
+  // Strongest interference against the locked frame in [from, to]: same SF and other SF, in mW
+  void interference(Time from, Time to, double &coMw, double &otherMw) {
+    coMw = otherMw = 0;
+    overlapping(from, to, scratch);
+    for (Transmission *o : scratch) {
+      if (o == locked.get() || o->src == node || o->freq != freqHz) continue;
+      double p = rxDbm(o);
+      if (!std::isfinite(p)) continue;
+      if (o->sf == sf && o->bw == bw) {
+        coMw = std::max(coMw, mwOf(p));
+      } else {
+        otherMw = std::max(otherMw, mwOf(p));
+      }
+    }
+  }
+
+  bool survives(Time from, Time to, double *sinrDb) {
+    double p = rxDbm(locked.get());
+    double coMw, otherMw;
+    interference(from, to, coMw, otherMw);
+    double noiseMw = mwOf(noiseFloorDbm(bw));
+    if (sinrDb) *sinrDb = p - dbmOf(noiseMw + coMw + otherMw);
+    if (p - dbmOf(noiseMw) < snrLimitDb(sf)) return false;
+    if (coMw > 0 && p - dbmOf(coMw) < cfg.captureDb) return false;
+    if (otherMw > 0 && p - dbmOf(otherMw) < cfg.interSfDb) return false;
+    return true;
+  }
+
+  void header() {
+    // The RX timer stops on a valid sync word / header
+    timerStopped = true;
+    if (implicitHeader()) return;
+    bool ok = !locked->implicitHeader && !locked->aborted && survives(lockedAt, now(), nullptr);
+    if (ok) {
+      raise(SX126X_IRQ_HEADER_VALID);
+      return;
+    }
+    raise(SX126X_IRQ_HEADER_ERR);
+    unlock();
+    scan(now());
+  }
+
+  void rxEnd() {
+    std::shared_ptr<Transmission> frame = locked;
+    Transmission *t = frame.get();
+    double sinr = 0;
+    bool weak = rxDbm(t) - noiseFloorDbm(bw) < snrLimitDb(sf);
+    bool clean = survives(lockedAt, now(), &sinr);
+    bool mismatch = t->implicitHeader != implicitHeader() ||
+                    (implicitHeader() && t->payload.size() != pkt[3]);
+    bool crcErr = t->aborted || !clean || mismatch;
+
+    uint8_t len = implicitHeader() ? pkt[3] : (uint8_t)t->payload.size();
+    rxStart = rxPtr;
+    rxLen = len;
+    for (uint8_t i = 0; i < len; i++) {
+      uint8_t b = i < t->payload.size() ? t->payload[i] : 0;
+      if (crcErr) b ^= (uint8_t)node->rng();
+      buffer[(uint8_t)(rxPtr + i)] = b;
+    }
+    rxPtr = (uint8_t)(rxPtr + len);
+    pktRssiDbm = (int8_t)std::max(-127.0, std::min(0.0, floor(rxDbm(t) + 0.5)));
+    pktSnrDb = (float)sinr;
+
+    if (crcErr) {
+      node->stats.rxCrcErr++;
+      if (mismatch) {
+        mediumStats.headerMismatch++;
+      } else if (weak) {
+        mediumStats.weak++;
+      } else if (!t->aborted) {
+        mediumStats.collisions++;
+        node->stats.rxCollisions++;
+      }
+    } else {
+      node->stats.rxOk++;
+      mediumStats.delivered++;
+    }
+
+    unlock();
+    if (rxContinuous) {
+      scan(now());
+    } else {
+      setMode(STBY_RC, now());
+    }
+    raise(SX126X_IRQ_RX_DONE | (crcErr && t->crcOn ? SX126X_IRQ_CRC_ERR : 0));
+  }
+
+  void rxTimeout() {
+    if (mode != RX || timerStopped) return;
+    setMode(STBY_RC, now());
+    raise(SX126X_IRQ_TIMEOUT);
+  }
+
+  // ---- CAD ----
+
+  void startCad(Time t, Time live) {
+    setMode(CAD, t);
+    static const int symbols[] = {1, 2, 4, 8, 16};
+    int nsym = symbols[std::min<int>(cadSymbols, 4)];
+    cadStart = live;
+    cadEnd = live + (Time)((nsym + 0.5) * symbolNs());
+    later(cadEnd, [](Chip *c) { c->cadDone(); });
+  }
+
+  void cadDone() {
+    bool detected = false;
+    Time window = cadEnd - cadStart;
+    overlapping(cadStart, cadEnd, scratch);
+    for (Transmission *t : scratch) {
+      if (t->src == node || !decodable(t)) continue;
+      Time overlap = std::min(t->end, cadEnd) - std::max(t->start, cadStart);
+      if (overlap * 2 < window) continue;
+      double p = rxDbm(t);
+      if (std::isfinite(p) && p - noiseFloorDbm(bw) >= snrLimitDb(sf)) {
+        detected = true;
+        break;
+      }
+    }
+    if (detected && cadExit == SX126X_CAD_GOTO_RX) {
+      startRx(now(), now(), cadTimeout, false);
+    } else {
+      setMode(STBY_RC, now());
+    }
+    raise(SX126X_IRQ_CAD_DONE | (detected ? SX126X_IRQ_CAD_DETECTED : 0));
+  }
+
+  // ---- pins and power ----
+
+  void resetPin(bool high, Time t) {
+    if (!high) {
+      if (!inReset) {
+        setMode(STBY_RC, t);
+        defaults();
+        warmSleep = true;
+        selected = waking = false;
+        inReset = true;
+      }
+      return;
+    }
+    if (inReset) {
+      inReset = false;
+      busyUntil = t + RESET_BUSY;
+    }
+  }
+
+  bool busy(Time t) const { return inReset || mode == SLEEP || t < busyUntil; }
+
+  void powerOff() {
+    setMode(STBY_RC, now());
+  }
+};
+
+void ChipDeleter::operator()(Chip *c) const { delete c; }
+
+Chip *makeChip(Node *n) { return new Chip(n); }
+
+void chipPinWrite(Chip *c, int pin, int level, Time t) {
+  const SimImageInfo *info = c->node->info;
+  if (!info) return;
+  if (pin == info->pinNss) {
+    c->nss(level != 0, t);
+  } else if (pin == info->pinReset) {
+    c->resetPin(level != 0, t);
+  }
+}
+
+bool chipBusy(Chip *c, Time t) { return c->busy(t); }
+
+bool chipDio1(Chip *c) { return c->dio1; }
+
+void chipTransfer(Chip *c, const uint8_t *out, uint8_t *in, size_t len, Time) { c->transfer(out, in, len); }
+
+void chipPowerOff(Chip *c) { c->powerOff(); }
+
+void chipOnAir(Chip *c, Transmission *tx) { c->consider(tx, tx->start); }
+
+}  // namespace sim
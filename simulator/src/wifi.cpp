@@ -0,0 +1,384 @@
+// WiFi, NTP and UDP of the virtual nodes, and the monitoring server they report to.
+//
+// The collector plays data_collection/wifi_monitor_control.py: it parses every
+// datagram that reaches the monitor port the same way and writes the same CSV, so
+// the analysis scripts run unchanged on simulated runs.
+#include "Arduino.h"
+#include "WiFi.h"
+#include "WiFiUdp.h"
+#include "sim.h"
+
+#include <map>
+
+#undef vsnprintf
+#undef snprintf
+#undef sprintf
+
+using namespace sim;
+
+WiFiClass WiFi;
+
+namespace {
+
+const Time WIFI_CALL_NS = 5 * US;
+const Time UDP_SEND_NS = 60 * US;     // lwIP + driver for a small datagram
+const Time NTP_DELAY = 300 * MS;      // configTime() until the first SNTP answer
+const int64_t NTP_ERROR_US = 3000;    // SNTP offset error, uniform +-
+
+struct CollectedEvent {
+  int64_t timestampUs;
+  int nodeId;
+  std::string type;
+  std::string details;
+  Time received;
+};
+
+std::vector<int> nodeOrder;                          // nodes in order of their first event
+std::map<int, std::vector<CollectedEvent>> events;
+uint64_t datagrams = 0;
+uint64_t parseErrors = 0;
+
+bool connected(Node *n, Time t) { return n->wifiBegun && t >= n->wifiUpAt; }
+
+bool parseInt(const std::string &s, long long &out) {
+  size_t b = s.find_first_not_of(" \t");
+  size_t e = s.find_last_not_of(" \t");
+  if (b == std::string::npos) return false;
+  std::string v = s.substr(b, e - b + 1);
+  char *end;
+  out = strtoll(v.c_str(), &end, 10);
+  return *end == '\0';
+}
+
+// Type of an "EVENT,<ts>,<id>,<type>,<details>" message, empty for the other kinds
+std::string eventType(const std::string &msg) {
+  if (msg.compare(0, 6, "EVENT,") != 0) return std::string();
+  size_t b = msg.find(',', 6);
+  if (b != std::string::npos) b = msg.find(',', b + 1);
+  if (b == std::string::npos) return std::string();
+  size_t e = msg.find(',', b + 1);
+  return msg.substr(b + 1, e == std::string::npos ? std::string::npos : e - b - 1);
+}
+
+// parse_event() of wifi_monitor_control.py
+void collect(const std::string &raw, Time t) {
+  datagrams++;
+  size_t b = raw.find_first_not_of(" \t\r\n");
+  size_t e = raw.find_last_not_of(" \t\r\n");
+  std::string msg = (b == std::string::npos) ? std::string() : raw.substr(b, e - b + 1);
+
+  std::vector<std::string> parts;
+  size_t pos = 0;
+  while (parts.size() < 4) {
+    size_t comma = msg.find(',', pos);
+    if (comma == std::string::npos) break;
+    parts.push_back(msg.substr(pos, comma - pos));
+    pos = comma + 1;
+  }
+  parts.push_back(msg.substr(pos));
+
+  static const char *const TYPES[] = {"EVENT", "LATENCY", "PDR_NETWORK", "PDR_NODE", "PKT_RX"};
+  long long ts, id;
+  if (parts.size() < 4 || std::find(std::begin(TYPES), std::end(TYPES), parts[0]) == std::end(TYPES) ||
+      !parseInt(parts[1], ts) || !parseInt(parts[2], id)) {
+    parseErrors++;
+    return;
+  }
+  CollectedEvent ev;
+  ev.timestampUs = ts;
+  ev.nodeId = (int)id;
+  ev.received = t;
+  if (parts[0] == "EVENT") {
+    if (parts.size() < 5) return;
+    ev.type = parts[3];
+    ev.details = parts[4];
+  } else {
+    ev.type = parts[0];
+    ev.details = parts[3];
+    if (parts.size() > 4) ev.details += "," + parts[4];
+  }
+  if (!events.count(ev.nodeId)) nodeOrder.push_back(ev.nodeId);
+  events[ev.nodeId].push_back(std::move(ev));
+}
+
+UdpSocket *socketOf(Node *n, int &handle) {
+  if (handle < 0 || (size_t)handle >= n->sockets.size()) {
+    n->sockets.emplace_back(new UdpSocket);
+    handle = (int)n->sockets.size() - 1;
+  }
+  return n->sockets[(size_t)handle].get();
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// NTP and the wall clock
+// ---------------------------------------------------------------------------
+
+void configTime(long gmtOffset_sec, int daylightOffset_sec, const char *, const char *, const char *) {
+  Node *n = curNode;
+  if (!n) return;
+  // POSIX TZ counts west of Greenwich as positive
+  long offset = gmtOffset_sec + daylightOffset_sec;
+  char tz[32];
+  snprintf(tz, sizeof(tz), "UTC%c%ld:%02ld", offset > 0 ? '-' : '+', labs(offset) / 3600, labs(offset) % 3600 / 60);
+  setenv("TZ", tz, 1);
+  tzset();
+
+  n->ntpRequested = true;
+  n->ntpAt = now() + NTP_DELAY + (Time)(n->rng() % 200) * MS;
+  n->ntpErrorUs = (double)((int64_t)(n->rng() % (2 * NTP_ERROR_US + 1)) - NTP_ERROR_US);
+}
+
+int sim_gettimeofday(struct timeval *tv, void *) {
+  Node *n = curNode;
+  if (!tv) return 0;
+  int64_t us = 0;
+  if (n) {
+    spend(1 * US);
+    sync();
+    Time t = now();
+    us = n->localUs(t);
+    if (n->ntpRequested && connected(n, n->ntpAt) && t >= n->ntpAt) {
+      // Set once from the server, then kept by the node's own crystal
+      int64_t atSync = cfg.epochUs + n->ntpAt / US + (int64_t)n->ntpErrorUs;
+      us = atSync + (n->localUs(t) - n->localUs(n->ntpAt));
+    }
+  }
+  tv->tv_sec = (time_t)(us / 1000000);
+  tv->tv_usec = (suseconds_t)(us % 1000000);
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// WiFi station
+// ---------------------------------------------------------------------------
+
+bool WiFiClass::mode(wifi_mode_t mode) {
+  if (mode == WIFI_OFF) disconnect(true);
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char *, const char *) {
+  Node *n = curNode;
+  if (!n) return WL_CONNECT_FAILED;
+  spend(WIFI_CALL_NS);
+  if (!n->wifiBegun) {
+    n->wifiBegun = true;
+    n->wifiUpAt = now() + 500 * MS + (Time)(n->rng() % 1500) * MS;
+  }
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool) {
+  Node *n = curNode;
+  if (n) n->wifiBegun = false;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  Node *n = curNode;
+  if (!n) return WL_DISCONNECTED;
+  spend(WIFI_CALL_NS);
+  sync();
+  return connected(n, now()) ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+IPAddress WiFiClass::localIP() {
+  Node *n = curNode;
+  if (!n || !connected(n, now())) return IPAddress();
+  int host = 100 + n->index;
+  return IPAddress(192, 168, (uint8_t)(1 + host / 254), (uint8_t)(host % 254 + 1));
+}
+
+IPAddress WiFiClass::gatewayIP() {
+  Node *n = curNode;
+  if (!n || !connected(n, now())) return IPAddress();
+  return IPAddress(192, 168, 1, 1);
+}
+
+int8_t WiFiClass::RSSI() {
+  Node *n = curNode;
+  return (n && connected(n, now())) ? -55 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// UDP
+// ---------------------------------------------------------------------------
+
+WiFiUDP::WiFiUDP() : handle_(-1) {}
+
+WiFiUDP::~WiFiUDP() {}
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+  Node *n = curNode;
+  if (!n) return 0;
+  UdpSocket *s = socketOf(n, handle_);
+  s->port = port;
+  return 1;
+}
+
+void WiFiUDP::stop() {
+  Node *n = curNode;
+  if (!n || handle_ < 0) return;
+  UdpSocket *s = socketOf(n, handle_);
+  s->port = 0;
+  s->inbox.clear();
+}
+
+int WiFiUDP::beginPacket(const char *, uint16_t port) {
+  Node *n = curNode;
+  if (!n) return 0;
+  UdpSocket *s = socketOf(n, handle_);
+  s->outgoing.clear();
+  s->destPort = port;
+  s->sending = true;
+  return 1;
+}
+
+int WiFiUDP::beginPacket(IPAddress, uint16_t port) { return beginPacket("", port); }
+
+size_t WiFiUDP::write(const uint8_t *buf, size_t size) {
+  Node *n = curNode;
+  if (!n) return 0;
+  UdpSocket *s = socketOf(n, handle_);
+  if (!s->sending) return 0;
+  s->outgoing.append((const char *)buf, size);
+  return size;
+}
+
+int WiFiUDP::endPacket() {
+  Node *n = curNode;
+  if (!n) return 0;
+  UdpSocket *s = socketOf(n, handle_);
+  if (!s->sending) return 0;
+  s->sending = false;
+  spend(UDP_SEND_NS);
+  sync();
+  if (!connected(n, now())) return 0;
+  if (n->info && s->destPort == n->info->monitorPort) {
+    std::string msg = s->outgoing;
+    Time arrive = now() + cfg.wifiLatency;
+    n->stats.datagrams++;
+    if (n->stats.joinDelay < 0 && eventType(msg) == "JOIN") n->stats.joinDelay = now() - n->bootTime;
+    at(arrive, [msg, arrive] { collect(msg, arrive); });
+  }
+  return 1;
+}
+
+int WiFiUDP::parsePacket() {
+  Node *n = curNode;
+  if (!n) return 0;
+  spend(WIFI_CALL_NS);
+  sync();
+  UdpSocket *s = socketOf(n, handle_);
+  if (s->inbox.empty()) return 0;
+  s->reading = s->inbox.front();
+  s->inbox.pop_front();
+  s->readPos = 0;
+  return (int)s->reading.size();
+}
+
+int WiFiUDP::available() {
+  Node *n = curNode;
+  if (!n) return 0;
+  UdpSocket *s = socketOf(n, handle_);
+  return (int)(s->reading.size() - s->readPos);
+}
+
+int WiFiUDP::read() {
+  Node *n = curNode;
+  if (!n) return -1;
+  UdpSocket *s = socketOf(n, handle_);
+  if (s->readPos >= s->reading.size()) return -1;
+  return (uint8_t)s->reading[s->readPos++];
+}
+
+int WiFiUDP::read(unsigned char *buf, size_t len) {
+  Node *n = curNode;
+  if (!n) return 0;
+  UdpSocket *s = socketOf(n, handle_);
+  size_t k = std::min(len, s->reading.size() - s->readPos);
+  memcpy(buf, s->reading.data() + s->readPos, k);
+  s->readPos += k;
+  return (int)k;
+}
+
+// ---------------------------------------------------------------------------
+// Collector
+// ---------------------------------------------------------------------------
+
+namespace sim {
+
+void collectorInit(Time) {
+  nodeOrder.clear();
+  events.clear();
+  datagrams = 0;
+  parseErrors = 0;
+}
+
+uint64_t collectorDatagrams() { return datagrams; }
+
+// send_command() of wifi_monitor_control.py: node 0 goes to every node
+void sendCommand(int nodeId, const std::string &cmd) {
+  std::string msg = "CMD," + std::to_string(nodeId) + "," + cmd;
+  at(now() + cfg.wifiLatency, [nodeId, msg] {
+    for (auto &owned : nodes) {
+      Node *n = owned.get();
+      if (!n->on || !n->info || (nodeId != 0 && n->id != nodeId) || !connected(n, now())) continue;
+      for (auto &s : n->sockets) {
+        if (s->port == n->info->commandPort) s->inbox.push_back(msg);
+      }
+    }
+  });
+}
+
+// save_events() of wifi_monitor_control.py
+size_t writeEventCsv(const std::string &path) {
+  std::vector<const CollectedEvent *> all;
+  for (int id : nodeOrder) {
+    for (const CollectedEvent &ev : events[id]) all.push_back(&ev);
+  }
+  std::stable_sort(all.begin(), all.end(), [](const CollectedEvent *a, const CollectedEvent *b) {
+    return a->timestampUs < b->timestampUs;
+  });
+
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f) {
+    perror(path.c_str());
+    return 0;
+  }
+  fprintf(f, "Operation,Relative_Time_S,Timestamp_US,Node_ID,Type,Details,Received_Time\n");
+  if (all.empty()) {
+    fclose(f);
+    return 0;
+  }
+  int64_t reference = all.front()->timestampUs;
+  int op = 0;
+  for (const CollectedEvent *ev : all) {
+    char opNum[16] = "";
+    const std::string &t = ev->type;
+    if (t == "NEIGHBOR_ADDED" || t == "NEIGHBOR_REMOVED" || t == "BIDIR_LINK" || t == "HOP_CHANGE" ||
+        t == "CMD_EXECUTED" || t == "RSSI_LOW") {
+      snprintf(opNum, sizeof(opNum), "%d", ++op);
+    }
+    std::string details;
+    for (char c : ev->details) {
+      if (c == '"') details += '"';
+      details += c;
+    }
+    int64_t wallUs = cfg.epochUs + ev->received / US;
+    time_t sec = (time_t)(wallUs / 1000000);
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    char recv[32];
+    strftime(recv, sizeof(recv), "%Y-%m-%d %H:%M:%S", &tm);
+    fprintf(f, "%s,%.1f,%lld,%d,%s,\"%s\",%s.%06lld\n", opNum, (double)(ev->timestampUs - reference) / 1e6,
+            (long long)ev->timestampUs, ev->nodeId, t.c_str(), details.c_str(), recv,
+            (long long)(wallUs % 1000000));
+  }
+  fclose(f);
+  return all.size();
+}
+
+}  // namespace sim
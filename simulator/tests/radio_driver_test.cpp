@@ -0,0 +1,261 @@
+// Host tests of the Ra01S driver against the simulated SX1262 (make test).
+//
+// Built into both images of build/test: the gateway image is an echo peer, the
+// node image the device under test. The peer answers every frame that starts with
+// ECHO_REQUEST with the same bytes and the first one flipped, so a frame makes a
+// round trip through both FIFOs and both burst paths (WriteBuffer and ReadBuffer).
+// The device under test prints "[TEST] <name>: ok|FAIL ..." per check, an SPI
+// timing table ("[BENCH]") and a closing "[TEST] ... passed" line that make test
+// looks for.
+#include "Arduino.h"
+#include <SPI.h>
+#include "esp_timer.h"
+#include "Ra01S.h"
+#include "sim_image.h"
+
+// Pins and radio settings of settings_template.h
+#define LORA_PIN_RESET 4
+#define LORA_PIN_DIO_1 21
+#define LORA_PIN_BUSY 22
+#define LORA_PIN_NSS 5
+#define LORA_PIN_SCLK 18
+#define LORA_PIN_MISO 19
+#define LORA_PIN_MOSI 23
+#define LORA_TXEN 26
+#define LORA_RXEN 27
+#define RF_FREQUENCY 915000000UL
+#define TX_POWER_DBM 10
+
+#define ECHO_REQUEST 0x01
+#define ECHO_REPLY   0x81
+#define NO_ECHO      0x00
+#define MAX_FRAME    (SX126x_RX_BASE_ADDRESS - SX126x_TX_BASE_ADDRESS)
+
+SX126x radio(LORA_PIN_NSS, LORA_PIN_RESET, LORA_PIN_BUSY, LORA_TXEN, LORA_RXEN);
+
+static uint8_t frame[256];
+static uint16_t failures = 0;
+static uint16_t checks = 0;
+
+static void check(bool ok, const char *name, const char *detail) {
+  checks++;
+  if (!ok) failures++;
+  Serial.printf("[TEST] %s: %s%s%s\n", name, ok ? "ok" : "FAIL", detail[0] ? " " : "", detail);
+}
+
+static void fillFrame(uint8_t *buf, uint8_t len, uint8_t kind, uint8_t seed) {
+  buf[0] = kind;
+  for (uint8_t i = 1; i < len; i++) buf[i] = (uint8_t)(seed + i * 7);
+}
+
+static bool frameMatches(const uint8_t *buf, uint8_t len, uint8_t kind, uint8_t seed) {
+  if (buf[0] != kind) return false;
+  for (uint8_t i = 1; i < len; i++) {
+    if (buf[i] != (uint8_t)(seed + i * 7)) return false;
+  }
+  return true;
+}
+
+static void initRadio() {
+  SPI.begin(LORA_PIN_SCLK, LORA_PIN_MISO, LORA_PIN_MOSI, LORA_PIN_NSS);
+  radio.SetSpiFrequency(8000000);
+  if (radio.begin(RF_FREQUENCY, TX_POWER_DBM, 0.0, false) != ERR_NONE) {
+    Serial.println("[TEST] radio begin: FAIL");
+    while (1) delay(1000);
+  }
+  radio.EnableDio1Irq(LORA_PIN_DIO_1);
+  radio.LoRaConfig(7, SX126X_LORA_BW_125_0, SX126X_LORA_CR_4_5, 8, 0, true, false);
+}
+
+// ---- echo peer (gateway image) ----
+
+static void peerLoop() {
+  uint8_t rxLen = radio.ReceiveWindow(frame, sizeof(frame), 200000000UL);
+  if (rxLen == 0 || frame[0] != ECHO_REQUEST) return;
+  frame[0] = ECHO_REPLY;
+  delay(2);
+  radio.Send(frame, rxLen, SX126x_TXMODE_SYNC);
+}
+
+// ---- device under test (node image) ----
+
+struct TxDone {
+  uint8_t calls;
+  bool success;
+  void *arg;
+};
+
+static void onTxDone(bool success, void *arg) {
+  TxDone *done = (TxDone *)arg;
+  done->calls++;
+  done->success = success;
+  done->arg = arg;
+}
+
+static void testSpiClock() {
+  char detail[64];
+  radio.SetSpiFrequency(20000000);
+  snprintf(detail, sizeof(detail), "(20 MHz -> %lu Hz)", (unsigned long)radio.GetSpiFrequency());
+  check(radio.GetSpiFrequency() == SX126x_SPI_MAX_FREQ, "spi clock clamped to 16 MHz", detail);
+  radio.SetSpiFrequency(8000000);
+  check(radio.GetSpiFrequency() == 8000000, "spi clock 8 MHz", "");
+}
+
+// SendAsync() returns with the frame on air, FinishTx() blocks until TX_DONE and runs the
+// callback once
+static void testSendAsync() {
+  char detail[80];
+  TxDone done = {0, false, NULL};
+  fillFrame(frame, 48, NO_ECHO, 11);
+
+  uint32_t start = micros();
+  bool started = radio.SendAsync(frame, 48, onTxDone, &done, SX126x_TXMODE_BACK2STBY);
+  uint32_t startUs = micros() - start;
+  snprintf(detail, sizeof(detail), "(returned after %lu us)", (unsigned long)startUs);
+  check(started && startUs < 2000, "SendAsync returns before TX_DONE", detail);
+  check(radio.TxBusy(), "TxBusy while on air", "");
+  check(!radio.SendAsync(frame, 48, onTxDone, &done), "second SendAsync refused while busy", "");
+  check(done.calls == 0, "no callback before FinishTx", "");
+
+  start = micros();
+  bool ok = radio.FinishTx(1000);
+  uint32_t finishUs = micros() - start;
+  snprintf(detail, sizeof(detail), "(blocked %lu us)", (unsigned long)finishUs);
+  check(ok && finishUs > 50000, "FinishTx waits for TX_DONE", detail);
+  check(done.calls == 1 && done.success && done.arg == &done, "callback once, success, own arg", "");
+  check(!radio.TxBusy() && !radio.FinishTx(10), "nothing in flight afterwards", "");
+}
+
+// DIO1 wakes the waiting task: no IRQ polling over SPI while idle, and the frame is
+// read right after its RX_DONE edge
+static void testDio1Wake() {
+  char detail[80];
+  SX126xSpiStats stats;
+
+  // The peer stays silent unless asked: a window with nothing on air
+  radio.ResetSpiStats();
+  uint32_t start = micros();
+  uint8_t rxLen = radio.ReceiveWindow(frame, sizeof(frame), 50000);
+  uint32_t waitUs = micros() - start;
+  radio.GetSpiStats(&stats);
+  snprintf(detail, sizeof(detail), "(%lu us, %lu SPI transactions)", (unsigned long)waitUs,
+           (unsigned long)stats.transactions);
+  check(rxLen == 0 && waitUs >= 50000 && waitUs < 55000, "empty RX window ends on the chip timeout", detail);
+  check(stats.transactions <= 8, "no IRQ polling while waiting", detail);
+
+  // Echo round trip
+  fillFrame(frame, 48, ECHO_REQUEST, 23);
+  radio.Send(frame, 48, SX126x_TXMODE_SYNC | SX126x_TXMODE_BACK2STBY);
+  memset(frame, 0, sizeof(frame));
+  radio.ResetSpiStats();
+  rxLen = radio.ReceiveWindow(frame, sizeof(frame), 500000);
+  int64_t wakeUs = esp_timer_get_time() - radio.GetRxTimestamp();
+  radio.GetSpiStats(&stats);
+  snprintf(detail, sizeof(detail), "(%u bytes, %lu SPI transactions)", rxLen, (unsigned long)stats.transactions);
+  check(rxLen == 48 && frameMatches(frame, 48, ECHO_REPLY, 23), "echo received intact", detail);
+  check(stats.transactions <= 12, "no IRQ polling while the echo is on air", detail);
+  snprintf(detail, sizeof(detail), "(%ld us from RX_DONE)", (long)wakeUs);
+  check(rxLen > 0 && wakeUs >= 0 && wakeUs < 500, "frame read right after the DIO1 edge", detail);
+}
+
+// Whole-buffer transfers: a full TX half of the FIFO goes out in one command and comes
+// back through the peer's FIFO unchanged
+static void testBurstTransfers() {
+  char detail[80];
+  SX126xSpiStats stats;
+
+  fillFrame(frame, MAX_FRAME, ECHO_REQUEST, 101);
+  radio.Send(frame, MAX_FRAME, SX126x_TXMODE_SYNC | SX126x_TXMODE_BACK2STBY);
+  radio.GetSpiStats(&stats);
+  snprintf(detail, sizeof(detail), "(%u commands)", stats.lastTxPrepareCmds);
+  check(stats.lastTxPrepareCmds <= 5, "TX prepare: packet params, IRQ clear, FIFO write, standby, SetTx", detail);
+
+  memset(frame, 0, sizeof(frame));
+  uint8_t rxLen = radio.ReceiveWindow(frame, sizeof(frame), 800000);
+  radio.GetSpiStats(&stats);
+  snprintf(detail, sizeof(detail), "(%u bytes)", rxLen);
+  check(rxLen == MAX_FRAME && frameMatches(frame, MAX_FRAME, ECHO_REPLY, 101), "128-byte frame round trip", detail);
+  snprintf(detail, sizeof(detail), "(%u commands)", stats.lastRxReadCmds);
+  check(stats.lastRxReadCmds == 2, "RX read: buffer status and one FIFO read", detail);
+}
+
+// SPI cost of one TX and one RX per bus clock (the fixed share of TX_PREPARE_TIME_US)
+static void benchSpi() {
+  static const uint32_t clocks[] = {2000000, 4000000, 8000000, 16000000};
+  static const uint8_t lengths[] = {48, MAX_FRAME};
+  SX126xSpiStats stats;
+
+  Serial.println("[BENCH] SPI clock  length  tx prepare      rx setup        rx read");
+  for (uint8_t c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++) {
+    radio.SetSpiFrequency(clocks[c]);
+    for (uint8_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+      uint8_t len = lengths[l];
+      fillFrame(frame, len, ECHO_REQUEST, c * 16 + l);
+      radio.ResetSpiStats();
+      radio.Send(frame, len, SX126x_TXMODE_SYNC | SX126x_TXMODE_BACK2STBY);
+      uint8_t rxLen = radio.ReceiveWindow(frame, sizeof(frame), 800000);
+      radio.GetSpiStats(&stats);
+      if (rxLen != len) check(false, "benchmark echo", "(lost)");
+      Serial.printf("[BENCH] %5.1f MHz  %6u  %5lu us (%u cmd)  %5lu us (%u cmd)  %5lu us (%u cmd)\n",
+                    clocks[c] / 1e6, len,
+                    (unsigned long)stats.lastTxPrepareUs, stats.lastTxPrepareCmds,
+                    (unsigned long)stats.lastRxSetupUs, stats.lastRxSetupCmds,
+                    (unsigned long)stats.lastRxReadUs, stats.lastRxReadCmds);
+    }
+  }
+  radio.SetSpiFrequency(8000000);
+}
+
+void setup() {
+  Serial.begin(115200);
+  initRadio();
+  if (sim_image_info.isReference) return;
+
+  delay(200);  // peer listening
+  testSpiClock();
+  testSendAsync();
+  testDio1Wake();
+  testBurstTransfers();
+  benchSpi();
+  if (failures == 0) {
+    Serial.printf("[TEST] all %u passed\n", checks);
+  } else {
+    Serial.printf("[TEST] %u of %u failed\n", failures, checks);
+  }
+}
+
+void loop() {
+  if (sim_image_info.isReference) {
+    peerLoop();
+  } else {
+    delay(1000);
+  }
+}
+
+extern "C" {
+
+uint16_t sim_device_id = 0;
+uint8_t sim_slot_device = 0;
+
+const SimImageInfo sim_image_info = {
+  SIM_IMAGE_ABI,
+  IS_REFERENCE,
+  LORA_PIN_NSS,
+  LORA_PIN_RESET,
+  LORA_PIN_BUSY,
+  LORA_PIN_DIO_1,
+  LORA_TXEN,
+  LORA_RXEN,
+  5001,
+  5002,
+  48,
+};
+
+void sim_loop_task(void *) {
+  setup();
+  for (;;) {
+    loop();
+  }
+}
+
+}
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""
+Regression check: run every topology over several seeds and hold each node
+to the minimums in the topology's "# check:" line.
+
+  # check: duration=300 seeds=1-6 min_tx=50 min_pdr=90 max_join=60
+
+  duration   simulated seconds per run
+  seeds      seed list, "1-6" or "1,4,9"
+  min_tx     frames every node sends (gateway included)
+  min_rx     good frames every node receives
+  min_pdr    % of a sensor node's messages the gateway got (last PDR_NODE)
+  min_avg_pdr  the same, averaged over every sensor node of every seed
+  max_join   seconds from boot to the JOIN event of every sensor node
+  scenario   scenario file, relative to the topology
+
+Keys left out are not checked. Exits non-zero when any run misses one.
+
+A "# check(<variant>):" line holds the minimums for a build with other settings,
+checked with --variant <variant> against that build's --sim. Topologies without
+a line for the variant are skipped; without --variant, every topology runs.
+"""
+
+import argparse
+import csv
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+DEFAULTS = {'duration': '300', 'seeds': '1-3'}
+
+
+def parse_check(path, variant=None):
+    """Options of the topology's check line for the variant. None when the variant has
+    no line; the default build runs every topology, with or without one."""
+    opts = None if variant else dict(DEFAULTS)
+    with open(path) as f:
+        for line in f:
+            m = re.match(r'#\s*check(?:\((\w+)\))?:\s*(.*)', line)
+            if m and m.group(1) == variant:
+                opts = dict(DEFAULTS)
+                for kv in m.group(2).split():
+                    key, _, value = kv.partition('=')
+                    opts[key] = value
+    return opts
+
+
+def parse_seeds(spec):
+    seeds = []
+    for part in spec.split(','):
+        lo, _, hi = part.partition('-')
+        seeds.extend(range(int(lo), int(hi or lo) + 1))
+    return seeds
+
+
+def read_summary(path):
+    """Per-node columns of the run summary, keyed by node ID"""
+    nodes = {}
+    header = None
+    with open(path) as f:
+        for line in f:
+            cols = line.split()
+            if cols and cols[0] == 'node':
+                header = cols
+            elif header and cols and cols[0].isdigit():
+                if len(cols) == len(header) - 1:
+                    cols.insert(1, '')    # empty gateway column
+                nodes[int(cols[0])] = dict(zip(header, cols))
+    return nodes
+
+
+def read_events(path):
+    """Last PDR_NODE per sensor node, as seen by the gateway"""
+    pdr = {}
+    with open(path, newline='') as f:
+        for row in csv.DictReader(f):
+            if row['Type'] != 'PDR_NODE':
+                continue
+            m = re.match(r'Node(\d+),.*PDR:([\d.]+)%', row['Details'])
+            if m:
+                pdr[int(m.group(1))] = float(m.group(2))
+    return pdr
+
+
+def join_seconds(value):
+    return None if value == '-' else float(value)
+
+
+def run(sim, topo, seed, opts, workdir):
+    base = os.path.join(workdir, '%s-%d' % (os.path.basename(topo), seed))
+    cmd = [sim, topo, '-q', '--images', os.path.dirname(sim) or '.', '-t', opts['duration'], '-s', str(seed),
+           '-o', base + '.csv', '--stats', base + '.txt']
+    if 'scenario' in opts:
+        cmd += ['-e', os.path.join(os.path.dirname(topo), opts['scenario'])]
+    subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+    return read_summary(base + '.txt'), read_events(base + '.csv')
+
+
+def check(nodes, pdr, opts):
+    failures = []
+    for nid, n in sorted(nodes.items()):
+        gateway = n['gw'] == '*'
+        if 'min_tx' in opts and int(n['tx']) < int(opts['min_tx']):
+            failures.append('node %d sent %s frames (min %s)' % (nid, n['tx'], opts['min_tx']))
+        if 'min_rx' in opts and int(n['rx_ok']) < int(opts['min_rx']):
+            failures.append('node %d received %s frames (min %s)' % (nid, n['rx_ok'], opts['min_rx']))
+        if gateway:
+            continue
+        if 'min_pdr' in opts:
+            got = pdr.get(nid)
+            if got is None or got < float(opts['min_pdr']):
+                failures.append('node %d PDR %s (min %s%%)' %
+                                (nid, 'none' if got is None else '%.1f%%' % got, opts['min_pdr']))
+        if 'max_join' in opts:
+            got = join_seconds(n['join_s'])
+            if got is None or got > float(opts['max_join']):
+                failures.append('node %d joined after %s s (max %s)' % (nid, n['join_s'], opts['max_join']))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('topologies', nargs='+')
+    parser.add_argument('--sim', default='build/lora-mesh-sim')
+    parser.add_argument('--seeds', help='override the seeds of every topology')
+    parser.add_argument('--variant', help='use the "# check(<variant>):" lines')
+    args = parser.parse_args()
+
+    failed = 0
+    with tempfile.TemporaryDirectory(prefix='lora-mesh-check-') as workdir:
+        for topo in args.topologies:
+            opts = parse_check(topo, args.variant)
+            if opts is None:
+                continue
+            if args.seeds:
+                opts['seeds'] = args.seeds
+            pdrs = []
+            for seed in parse_seeds(opts['seeds']):
+                nodes, pdr = run(args.sim, topo, seed, opts, workdir)
+                failures = check(nodes, pdr, opts)
+                tx = ' '.join('%d:%s' % (nid, n['tx']) for nid, n in sorted(nodes.items()))
+                print('%-4s %s seed %d  tx %s' % ('ok' if not failures else 'FAIL', topo, seed, tx))
+                for f in failures:
+                    print('       ' + f)
+                failed += bool(failures)
+                pdrs += [pdr.get(nid, 0.0) for nid, n in nodes.items() if n['gw'] != '*']
+            if 'min_avg_pdr' in opts and pdrs:
+                avg = sum(pdrs) / len(pdrs)
+                ok = avg >= float(opts['min_avg_pdr'])
+                print('%-4s %s average PDR %.1f%% (min %s%%)' % ('ok' if ok else 'FAIL', topo, avg, opts['min_avg_pdr']))
+                failed += not ok
+    if failed:
+        print('%d run(s) failed' % failed)
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
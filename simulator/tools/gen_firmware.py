@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""
+Turn firmware.ino into a C++ translation unit for the simulator.
+
+Writes two files into --out:
+  settings.h    settings_template.h with the --set overrides applied and
+                sim_settings.h spliced in before its closing #endif
+  firmware.cpp  firmware.ino with the prototypes the Arduino builder would
+                generate, placed before the first function definition, and
+                the --append files included at the end (settings.h defines
+                globals, so whatever needs it must share this translation unit)
+
+#line directives keep compiler errors and gdb pointing at firmware.ino.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+# Same rules as the Arduino builder: a top-level "type name(args) {" that is
+# not a control statement, a type definition or a preprocessor line
+FUNC_DEF = re.compile(
+    r'^(?!static|inline|if|else|for|while|switch|return|struct|class|typedef|#)'
+    r'([A-Za-z_][\w:<>\* ]*?\b(\w+)\s*\([^;{}]*\))\s*\{',
+    re.M)
+
+
+def apply_settings(template, overlay, overrides):
+    out = template
+    for key, value in overrides:
+        pattern = re.compile(r'^#define\s+%s\b.*$' % re.escape(key), re.M)
+        if not pattern.search(out):
+            sys.exit("gen_firmware: %s is not defined in the settings template" % key)
+        out = pattern.sub(lambda m: '#define %s %s' % (key, value), out, count=1)
+
+    tail = out.rfind('#endif')
+    if tail < 0:
+        sys.exit("gen_firmware: settings template has no closing #endif")
+    return out[:tail] + overlay.rstrip() + '\n\n' + out[tail:]
+
+
+def add_prototypes(ino, path):
+    protos = []
+    for m in FUNC_DEF.finditer(ino):
+        if m.group(2) in ('setup', 'loop'):
+            continue
+        protos.append(m.group(1).replace('IRAM_ATTR', '').strip() + ';')
+
+    first = FUNC_DEF.search(ino)
+    if first is None:
+        return '#line 1 "%s"\n%s' % (path, ino)
+    line = ino.count('\n', 0, first.start()) + 1
+    return ('#line 1 "%s"\n%s\n// prototypes generated by gen_firmware.py\n%s\n#line %d "%s"\n%s'
+            % (path, ino[:first.start()], '\n'.join(protos), line, path, ino[first.start():]))
+
+
+def write_if_changed(path, text):
+    # Unchanged outputs keep their mtime so make does not rebuild every node image
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == text:
+                return
+    with open(path, 'w') as f:
+        f.write(text)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('--firmware', required=True, help='firmware directory (firmware.ino)')
+    ap.add_argument('--settings', required=True, help='settings header to start from')
+    ap.add_argument('--overlay', required=True, help='simulator additions (sim_settings.h)')
+    ap.add_argument('--out', required=True, help='output directory')
+    ap.add_argument('--set', action='append', default=[], metavar='KEY=VALUE',
+                    help='replace a #define of the settings header')
+    ap.add_argument('--append', action='append', default=[], metavar='FILE',
+                    help='source to #include at the end of firmware.cpp')
+    args = ap.parse_args()
+
+    overrides = []
+    for kv in args.set:
+        if '=' not in kv:
+            sys.exit("gen_firmware: --set expects KEY=VALUE, got %r" % kv)
+        key, value = kv.split('=', 1)
+        overrides.append((key.strip(), value.strip()))
+
+    with open(args.settings) as f:
+        template = f.read()
+    with open(args.overlay) as f:
+        overlay = f.read()
+    ino_path = os.path.abspath(os.path.join(args.firmware, 'firmware.ino'))
+    with open(ino_path) as f:
+        ino = f.read()
+
+    os.makedirs(args.out, exist_ok=True)
+    write_if_changed(os.path.join(args.out, 'settings.h'), apply_settings(template, overlay, overrides))
+    firmware = add_prototypes(ino, ino_path)
+    for extra in args.append:
+        firmware += '\n#include "%s"\n' % os.path.abspath(extra)
+    write_if_changed(os.path.join(args.out, 'firmware.cpp'), firmware)
+
+
+if __name__ == '__main__':
+    main()